@@ -0,0 +1,46 @@
+/*
+ *  UVCCamera
+ *  library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ *  All files in the folder are under this Apache License, Version 2.0.
+ *  Files in the libjpeg-turbo, libusb, libuvc, rapidjson folder
+ *  may have a different license, see the respective files.
+ */
+
+package com.jiangdg.uvc;
+
+/**
+ * Callback interface for UVCCamera#setFrameBufferCallback
+ * Frames are written into the direct ByteBuffers registered with UVCCamera#setFrameBufferCallback,
+ * so no ByteBuffer is created for each frame unlike IFrameCallback.
+ */
+public interface IFrameBufferCallback {
+	/**
+	 * This method is called from native library via JNI on the frame callback thread
+	 * when a registered buffer was filled with a frame.
+	 * The buffer is not filled again until it is returned with UVCCamera#releaseFrameBuffer,
+	 * you can return it in this method or later from any thread.
+	 * Frames are dropped while all buffers are not returned.
+	 * @param index index of the buffer in the array passed to UVCCamera#setFrameBufferCallback
+	 * @param bytes number of bytes written from the start of the buffer
+	 * @param width width of the frame
+	 * @param height height of the frame
+	 * @param sequence frame number, strictly increasing but may skip
+	 * @param timestampNs capture time of the frame in the time base of System#nanoTime, 0 if unknown
+	 */
+	public void onFrameBuffer(int index, int bytes, int width, int height, long sequence, long timestampNs);
+}
@@ -0,0 +1,41 @@
+/*
+ *  UVCCamera
+ *  library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ *  All files in the folder are under this Apache License, Version 2.0.
+ *  Files in the libjpeg-turbo, libusb, libuvc, rapidjson folder
+ *  may have a different license, see the respective files.
+ */
+
+package com.jiangdg.uvc;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Callback interface for UVCCamera#setFrameMetaCallback
+ * Same as IFrameCallback but each frame comes with its metadata,
+ * read it with the static methods of UVCCamera.FrameMeta.
+ */
+public interface IFrameMetaCallback {
+	/**
+	 * This method is called from native library via JNI on the frame callback thread.
+	 * Both ByteBuffers are only valid in this method, copy what you need before returning.
+	 * @param frame pixels of the frame in the pixel format passed to UVCCamera#setFrameMetaCallback
+	 * @param meta metadata of the frame, the same ByteBuffer is reused for every frame
+	 */
+	public void onFrame(ByteBuffer frame, ByteBuffer meta);
+}
@@ -38,6 +38,8 @@ import org.json.JSONArray;
 import org.json.JSONException;
 import org.json.JSONObject;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.ArrayList;
 import java.util.List;
 
@@ -60,6 +62,20 @@ public class UVCCamera {
 	public static final int PIXEL_FORMAT_YUV420SP = 4;	// NV12
 	public static final int PIXEL_FORMAT_NV21 = 5;		// = YVU420SemiPlanar,NV21，但是保存到jpg颜色失真
 
+	public static final int COLOR_MATRIX_BT601 = 0;
+	public static final int COLOR_MATRIX_BT709 = 1;
+	public static final int COLOR_MATRIX_BT2020 = 2;
+	public static final int COLOR_RANGE_FULL = 0;
+	public static final int COLOR_RANGE_LIMITED = 1;
+
+	public static final int QUEUE_STAGE_PREVIEW = 0;	// camera => preview
+	public static final int QUEUE_STAGE_CAPTURE = 1;	// preview => capture Surface
+	public static final int QUEUE_STAGE_CALLBACK = 2;	// preview => IFrameCallback
+	public static final int FRAME_DROP_NEWEST = 0;
+	public static final int FRAME_DROP_OLDEST = 1;
+	public static final int FRAME_DROP_NONE = 2;
+	public static final int MAX_QUEUE_DEPTH = 16;
+
 	//--------------------------------------------------------------------------------
     public static final int	CTRL_SCANNING		= 0x00000001;	// D0:  Scanning Mode
     public static final int CTRL_AE				= 0x00000002;	// D1:  Auto-Exposure Mode
@@ -439,6 +455,55 @@ public class UVCCamera {
     	}
     }
 
+    /**
+     * set frame callback that also gets the metadata of each frame,
+     * this replaces IFrameCallback set by #setFrameCallback and vice versa
+     * @param callback
+     * @param pixelFormat same as #setFrameCallback
+     */
+    public void setFrameMetaCallback(final IFrameMetaCallback callback, final int pixelFormat) {
+    	if (mNativePtr != 0) {
+    		nativeSetFrameMetaCallback(mNativePtr, callback, pixelFormat);
+    	}
+    }
+
+    /**
+     * deliver frames into the direct ByteBuffers allocated by the app instead of IFrameCallback,
+     * no ByteBuffer is created for each frame.
+     * a filled buffer is passed to IFrameBufferCallback#onFrameBuffer by its index
+     * and is not filled again until it is returned with #releaseFrameBuffer.
+     * when the app holds all buffers, frames are dropped and counted by #getFrameBufferDrops
+     * instead of delaying the preview.
+     * IFrameCallback is not called while this is set
+     * @param callback null to stop delivering
+     * @param buffers direct ByteBuffers large enough for a frame of the pixel format, at most 16
+     * @param pixelFormat same as #setFrameCallback
+     */
+    public void setFrameBufferCallback(final IFrameBufferCallback callback, final ByteBuffer[] buffers, final int pixelFormat) {
+    	if (mNativePtr != 0) {
+    		nativeSetFrameBufferCallback(mNativePtr, callback, buffers, pixelFormat);
+    	}
+    }
+
+    /**
+     * return the buffer passed to IFrameBufferCallback#onFrameBuffer so that it is filled again,
+     * this can be called from any thread. the buffers of a previous #setFrameBufferCallback
+     * must not be returned, and a buffer returned twice is ignored
+     * @param index index of the buffer in the array passed to the last #setFrameBufferCallback
+     */
+    public void releaseFrameBuffer(final int index) {
+    	if (mNativePtr != 0) {
+    		nativeReleaseFrameBuffer(mNativePtr, index);
+    	}
+    }
+
+    /**
+     * number of frames dropped because the app held all buffers of #setFrameBufferCallback
+     */
+    public long getFrameBufferDrops() {
+    	return mNativePtr != 0 ? nativeGetFrameBufferDrops(mNativePtr) : 0;
+    }
+
     /**
      * start preview
      */
@@ -453,6 +518,7 @@ public class UVCCamera {
      */
     public synchronized void stopPreview() {
     	setFrameCallback(null, 0);
+    	setFrameBufferCallback(null, null, 0);
     	if (mCtrlBlock != null) {
     		nativeStopPreview(mNativePtr);
     	}
@@ -1094,6 +1160,10 @@ public class UVCCamera {
 	private static final native int nativeStopPreview(final long id_camera);
 	private static final native int nativeSetPreviewDisplay(final long id_camera, final Surface surface);
 	private static final native int nativeSetFrameCallback(final long mNativePtr, final IFrameCallback callback, final int pixelFormat);
+	private static final native int nativeSetFrameMetaCallback(final long mNativePtr, final IFrameMetaCallback callback, final int pixelFormat);
+	private static final native int nativeSetFrameBufferCallback(final long mNativePtr, final IFrameBufferCallback callback, final ByteBuffer[] buffers, final int pixelFormat);
+	private static final native int nativeReleaseFrameBuffer(final long mNativePtr, final int index);
+	private static final native long nativeGetFrameBufferDrops(final long mNativePtr);
 
 //**********************************************************************
 	/**
@@ -1117,6 +1187,300 @@ public class UVCCamera {
 	}
 	private static final native int nativeSetCaptureDisplay(final long id_camera, final Surface surface);
 
+//**********************************************************************
+	/**
+	 * transport statistics of the stream, counted since the preview started
+	 */
+	public static final class StreamStats {
+		/** payload packets received(isochronous packets or bulk transfers) */
+		public final long packets;
+		/** bytes received including payload headers */
+		public final long bytes;
+		/** isochronous packets with error */
+		public final long packetErrors;
+		/** frames completed by EOF bit */
+		public final long framesEof;
+		/** frames completed by toggle of FID bit without EOF */
+		public final long framesFid;
+		/** frames dropped because of error in the payloads */
+		public final long framesError;
+		/** payloads truncated because the frame exceeded the buffer */
+		public final long truncations;
+		/** frames dropped because the frame queue was full */
+		public final long framesOverwritten;
+		/** frames per second received from the camera */
+		public final float fps;
+
+		private StreamStats(final long[] values) {
+			packets = values[0];
+			bytes = values[1];
+			packetErrors = values[2];
+			framesEof = values[3];
+			framesFid = values[4];
+			framesError = values[5];
+			truncations = values[6];
+			framesOverwritten = values[7];
+			fps = values[8] / 1000.0f;
+		}
+
+		@Override
+		public String toString() {
+			return "StreamStats{packets=" + packets + ",bytes=" + bytes + ",packetErrors=" + packetErrors
+				+ ",framesEof=" + framesEof + ",framesFid=" + framesFid + ",framesError=" + framesError
+				+ ",truncations=" + truncations + ",framesOverwritten=" + framesOverwritten + ",fps=" + fps + "}";
+		}
+	}
+
+	/**
+	 * get the transport statistics of current preview,
+	 * or of the last preview if not previewing
+	 * @return null if not opened
+	 */
+	public synchronized StreamStats getStreamStats() {
+		if (mCtrlBlock != null) {
+			final long[] values = nativeGetStreamStats(mNativePtr);
+			if (values != null) {
+				return new StreamStats(values);
+			}
+		}
+		return null;
+	}
+	private static final native long[] nativeGetStreamStats(final long id_camera);
+
+	/**
+	 * record the USB payloads of the preview into the file,
+	 * the file can be replayed by uvc_replay without the camera.
+	 * this takes effect from the next startPreview
+	 * @param path path of the trace file, null to stop recording
+	 */
+	public synchronized void setTraceFile(final String path) {
+		if (mCtrlBlock != null) {
+			nativeSetTraceFile(mNativePtr, path);
+		}
+	}
+	private static final native int nativeSetTraceFile(final long id_camera, final String path);
+
+	/**
+	 * set the number of threads to decode MJPEG frames of the preview,
+	 * decoded frames are still displayed and passed to IFrameCallback in the order of arrival.
+	 * this takes effect from the next startPreview
+	 * @param num_threads 1: decode on the preview thread(default), 0: number of cpu cores, max 4
+	 */
+	public synchronized void setDecodeThreads(final int num_threads) {
+		if (mCtrlBlock != null) {
+			nativeSetDecodeThreads(mNativePtr, num_threads);
+		}
+	}
+	private static final native int nativeSetDecodeThreads(final long id_camera, final int num_threads);
+
+	/**
+	 * decode MJPEG frames of the preview at 1/2, 1/4 or 1/8 of their size in the IDCT
+	 * when the preview Surface is that much smaller than the frames,
+	 * frames for IFrameCallback and the capture Surface are still decoded in full size.
+	 * the size of the Surface is taken when it is set by setPreviewDisplay.
+	 * this takes effect from the next startPreview
+	 * @param enable false: always decode in full size(default)
+	 */
+	public synchronized void setPreviewScaling(final boolean enable) {
+		if (mCtrlBlock != null) {
+			nativeSetPreviewScaling(mNativePtr, enable);
+		}
+	}
+	private static final native int nativeSetPreviewScaling(final long id_camera, final boolean enable);
+
+	/**
+	 * set the color matrix and the quantization range of the camera to convert YUV frames into RGB,
+	 * MJPEG frames are decoded into YUYV first for the preview unless they are BT.601 full range.
+	 * this takes effect immediately
+	 * @param matrix COLOR_MATRIX_BT601(default), COLOR_MATRIX_BT709 or COLOR_MATRIX_BT2020
+	 * @param range COLOR_RANGE_FULL(default) or COLOR_RANGE_LIMITED
+	 */
+	public synchronized void setColor(final int matrix, final int range) {
+		if (mCtrlBlock != null) {
+			nativeSetColor(mNativePtr, matrix, range);
+		}
+	}
+	private static final native int nativeSetColor(final long id_camera, final int matrix, final int range);
+
+	/**
+	 * set how frames are queued between the stages of the preview.
+	 * defaults are depth 4 with FRAME_DROP_NEWEST for QUEUE_STAGE_PREVIEW,
+	 * depth 1 with FRAME_DROP_OLDEST(latest frame wins) for QUEUE_STAGE_CAPTURE and QUEUE_STAGE_CALLBACK.
+	 * FRAME_DROP_NONE blocks the previous stage up to 1 second, so it is not allowed
+	 * for QUEUE_STAGE_PREVIEW whose previous stage delivers the frames from USB.
+	 * this takes effect immediately
+	 * @param stage QUEUE_STAGE_PREVIEW, QUEUE_STAGE_CAPTURE or QUEUE_STAGE_CALLBACK
+	 * @param depth number of frames the stage can hold, 1 to MAX_QUEUE_DEPTH
+	 * @param drop FRAME_DROP_NEWEST, FRAME_DROP_OLDEST or FRAME_DROP_NONE, what to do when the queue is full
+	 * @param deadlineMs frames captured more than this before are dropped instead of being processed, 0: no deadline
+	 * @throws IllegalArgumentException FRAME_DROP_NONE for QUEUE_STAGE_PREVIEW
+	 */
+	public synchronized void setQueuePolicy(final int stage, final int depth, final int drop, final int deadlineMs) {
+		if ((stage == QUEUE_STAGE_PREVIEW) && (drop == FRAME_DROP_NONE)) {
+			throw new IllegalArgumentException("FRAME_DROP_NONE can not be used for QUEUE_STAGE_PREVIEW");
+		}
+		if (mCtrlBlock != null) {
+			nativeSetQueuePolicy(mNativePtr, stage, depth, drop, deadlineMs);
+		}
+	}
+	private static final native int nativeSetQueuePolicy(final long id_camera,
+		final int stage, final int depth, final int drop, final int deadline_ms);
+
+	/**
+	 * set the number of threads to convert uncompressed(YUYV/UYVY) frames of 720p or larger
+	 * to RGB/RGBX/RGB565, each frame is split into horizontal bands and converted in parallel.
+	 * this applies to all cameras
+	 * @param num_threads 1: convert on the calling thread(default), 0: number of cpu cores
+	 */
+	public static void setConvertThreads(final int num_threads) {
+		nativeSetConvertThreads(num_threads);
+	}
+	private static final native int nativeSetConvertThreads(final int num_threads);
+
+	/**
+	 * statistics of the frame buffers shared by all cameras in the process
+	 */
+	public static final class FramePoolStats {
+		/** frames taken from the pool */
+		public final long hits;
+		/** frames allocated because the pool had no buffer of the size */
+		public final long misses;
+		/** frames freed instead of being kept in the pool */
+		public final long releases;
+		/** frames kept in the pool now */
+		public final long cachedFrames;
+		/** bytes of the buffers kept in the pool now */
+		public final long cachedBytes;
+
+		private FramePoolStats(final long[] values) {
+			hits = values[0];
+			misses = values[1];
+			releases = values[2];
+			cachedFrames = values[3];
+			cachedBytes = values[4];
+		}
+
+		@Override
+		public String toString() {
+			return "FramePoolStats{hits=" + hits + ",misses=" + misses + ",releases=" + releases
+				+ ",cachedFrames=" + cachedFrames + ",cachedBytes=" + cachedBytes + "}";
+		}
+	}
+
+	/**
+	 * reads the metadata passed to IFrameMetaCallback#onFrame without allocating,
+	 * the layout is frame_meta_t of UVCPreview.h.
+	 * all times are in the time base of System#nanoTime, 0 if the frame did not pass the stage
+	 */
+	public static final class FrameMeta {
+		/** bytes of the metadata */
+		public static final int SIZE = 112;
+
+		/** the first packet of the frame was received */
+		public static final int STAGE_RECEIVED = 0;
+		/** the last packet of the frame was received */
+		public static final int STAGE_COMPLETED = 1;
+		/** libuvc passed the frame to the preview */
+		public static final int STAGE_HANDED = 2;
+		/** the preview thread took the frame from its queue */
+		public static final int STAGE_DEQUEUED = 3;
+		/** the MJPEG frame was decoded */
+		public static final int STAGE_DECODED = 4;
+		/** the frame was passed to the callback thread */
+		public static final int STAGE_QUEUED = 5;
+		/** just before calling IFrameMetaCallback#onFrame */
+		public static final int STAGE_DELIVERED = 6;
+		public static final int STAGE_COUNT = 8;
+
+		private static final int OFFSET_WIDTH = 0;
+		private static final int OFFSET_HEIGHT = 4;
+		private static final int OFFSET_PIXEL_FORMAT = 8;
+		private static final int OFFSET_BYTES = 12;
+		private static final int OFFSET_SEQUENCE = 16;
+		private static final int OFFSET_SKIPPED = 20;
+		private static final int OFFSET_CAPTURE_NS = 24;
+		private static final int OFFSET_STAGE_NS = 32;
+		private static final int OFFSET_PREVIEW_DROPPED = OFFSET_STAGE_NS + STAGE_COUNT * 8;
+		private static final int OFFSET_CALLBACK_DROPPED = OFFSET_PREVIEW_DROPPED + 8;
+
+		private FrameMeta() {
+		}
+
+		private static ByteBuffer order(final ByteBuffer meta) {
+			// NewDirectByteBuffer is big endian by default
+			return meta.order() == ByteOrder.nativeOrder() ? meta : meta.order(ByteOrder.nativeOrder());
+		}
+
+		public static int getWidth(final ByteBuffer meta) {
+			return order(meta).getInt(OFFSET_WIDTH);
+		}
+
+		public static int getHeight(final ByteBuffer meta) {
+			return order(meta).getInt(OFFSET_HEIGHT);
+		}
+
+		/** PIXEL_FORMAT_XXX of the frame */
+		public static int getPixelFormat(final ByteBuffer meta) {
+			return order(meta).getInt(OFFSET_PIXEL_FORMAT);
+		}
+
+		/** bytes of the frame */
+		public static int getBytes(final ByteBuffer meta) {
+			return order(meta).getInt(OFFSET_BYTES);
+		}
+
+		/** frame number of the stream */
+		public static long getSequence(final ByteBuffer meta) {
+			return order(meta).getInt(OFFSET_SEQUENCE) & 0xffffffffL;
+		}
+
+		/** frames lost since the previous frame passed to the callback for any reason */
+		public static int getSkipped(final ByteBuffer meta) {
+			return order(meta).getInt(OFFSET_SKIPPED);
+		}
+
+		/** capture time of the frame by the camera, 0 if unknown */
+		public static long getCaptureTimeNs(final ByteBuffer meta) {
+			return order(meta).getLong(OFFSET_CAPTURE_NS);
+		}
+
+		/**
+		 * @param stage STAGE_XXX
+		 */
+		public static long getStageTimeNs(final ByteBuffer meta, final int stage) {
+			return order(meta).getLong(OFFSET_STAGE_NS + stage * 8);
+		}
+
+		/** frames dropped by QUEUE_STAGE_PREVIEW since the camera was opened */
+		public static long getPreviewDropped(final ByteBuffer meta) {
+			return order(meta).getLong(OFFSET_PREVIEW_DROPPED);
+		}
+
+		/** frames dropped by QUEUE_STAGE_CALLBACK since the camera was opened */
+		public static long getCallbackDropped(final ByteBuffer meta) {
+			return order(meta).getLong(OFFSET_CALLBACK_DROPPED);
+		}
+	}
+
+	/**
+	 * get the statistics of the frame buffers shared by all cameras
+	 */
+	public static FramePoolStats getFramePoolStats() {
+		final long[] values = nativeGetFramePoolStats();
+		return values != null ? new FramePoolStats(values) : null;
+	}
+	private static final native long[] nativeGetFramePoolStats();
+
+	/**
+	 * release the frame buffers kept in the pool but not used now,
+	 * call this when the app goes to background
+	 * @return bytes released
+	 */
+	public static long trimFramePool() {
+		return nativeTrimFramePool();
+	}
+	private static final native long nativeTrimFramePool();
+
 	private static final native long nativeGetCtrlSupports(final long id_camera);
 	private static final native long nativeGetProcSupports(final long id_camera);
 
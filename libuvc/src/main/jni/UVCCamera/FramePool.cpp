@@ -0,0 +1,234 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FramePool.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#include "utilbase.h"
+#include "FramePool.h"
+
+/**
+ * index of the smallest size class that can hold bytes
+ * @return -1 if bytes is larger than the largest size class
+ */
+static int ceil_class(const size_t bytes) {
+	if (bytes <= ((size_t)1 << FRAME_POOL_MIN_SHIFT)) {
+		return 0;
+	}
+	// 2^msb <= bytes - 1 < 2^(msb + 1)
+	const int msb = (int)(sizeof(unsigned long) * 8) - 1 - __builtin_clzl((unsigned long)(bytes - 1));
+	if (msb >= FRAME_POOL_MAX_SHIFT) {
+		return -1;
+	}
+	// number of quarters of 2^msb in bytes - 1, 4 to 7
+	const int quarters = (int)((bytes - 1) >> (msb - 2));
+	return (msb - FRAME_POOL_MIN_SHIFT) * 4 + (quarters - 4) + 1;
+}
+
+/**
+ * buffer size of the size class
+ */
+static size_t class_bytes(const int index) {
+	if (!index) {
+		return (size_t)1 << FRAME_POOL_MIN_SHIFT;
+	}
+	const int msb = FRAME_POOL_MIN_SHIFT + (index - 1) / 4;
+	return ((size_t)1 << msb) + (((index - 1) % 4) + 1) * ((size_t)1 << (msb - 2));
+}
+
+/**
+ * index of the largest size class whose buffers a frame of data_bytes can serve
+ * @return -1 if the frame can not be kept
+ */
+static int floor_class(const size_t data_bytes) {
+	int index = ceil_class(data_bytes);
+	if ((index >= 0) && (class_bytes(index) > data_bytes)) {
+		index--;
+	}
+	return index;
+}
+
+/**
+ * size of the buffer of the frame, data_bytes can be smaller than this
+ * because uvc_ensure_frame_size does not shrink the buffer
+ */
+static inline size_t buffer_bytes(const uvc_frame_t *frame) {
+	return frame->alloc_bytes > frame->data_bytes ? frame->alloc_bytes : frame->data_bytes;
+}
+
+/**
+ * allocate a frame with an aligned buffer owned by libuvc,
+ * the buffer can still be reallocated by uvc_ensure_frame_size
+ */
+static uvc_frame_t *allocate_frame(const size_t data_bytes) {
+	uvc_frame_t *frame = uvc_allocate_frame(0);
+	if (LIKELY(frame)) {
+		memset(frame, 0, sizeof(*frame));
+		frame->color_matrix = UVC_COLOR_MATRIX_BT601;
+		frame->color_range = UVC_COLOR_RANGE_FULL;
+		frame->ref_count = 1;
+		void *data = NULL;
+		if (UNLIKELY(posix_memalign(&data, FRAME_POOL_ALIGNMENT, data_bytes))) {
+			LOGE("failed to allocate frame buffer:%d", (int)data_bytes);
+			uvc_free_frame(frame);
+			return NULL;
+		}
+		frame->data = data;
+		frame->data_bytes = frame->actual_bytes = frame->alloc_bytes = data_bytes;
+		frame->library_owns_data = 1;
+	}
+	return frame;
+}
+
+FramePool::FramePool()
+:	hits(0),
+	misses(0),
+	releases(0),
+	cached_frames(0),
+	cached_bytes(0) {
+}
+
+FramePool::~FramePool() {
+	trim();
+}
+
+/**
+ * get a frame whose buffer has data_bytes at least,
+ * a new frame is allocated if there is no frame in the size class
+ */
+uvc_frame_t *FramePool::obtainFrame(size_t data_bytes) {
+	const int index = ceil_class(data_bytes);
+	uvc_frame_t *frame = index >= 0 ? classes[index].take() : NULL;
+	if (LIKELY(frame)) {
+		frame->ref_count = 1;
+		// the previous user may have used only a part of the buffer
+		frame->data_bytes = frame->actual_bytes = frame->alloc_bytes;
+		__atomic_fetch_add(&hits, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_sub(&cached_frames, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_sub(&cached_bytes, frame->alloc_bytes, __ATOMIC_RELAXED);
+	} else {
+		__atomic_fetch_add(&misses, 1, __ATOMIC_RELAXED);
+		LOGD("allocate new frame:%d", (int)data_bytes);
+		frame = allocate_frame(index >= 0 ? class_bytes(index) : data_bytes);
+	}
+	return frame;
+}
+
+/**
+ * add a reference to the frame for another consumer,
+ * every consumer has to call recycleFrame when it does not use the frame any more.
+ * the consumers must not modify the frame
+ */
+uvc_frame_t *FramePool::retainFrame(uvc_frame_t *frame) {
+	if (LIKELY(frame)) {
+		__atomic_fetch_add(&frame->ref_count, 1, __ATOMIC_RELAXED);
+	}
+	return frame;
+}
+
+/**
+ * release a reference to the frame, when it is the last one
+ * keep the frame in the size class of its buffer.
+ * the frame is freed if the size class is full or the buffer was reallocated without the alignment
+ */
+void FramePool::recycleFrame(uvc_frame_t *frame) {
+	if (UNLIKELY(!frame)) {
+		return;
+	}
+	if (__atomic_sub_fetch(&frame->ref_count, 1, __ATOMIC_ACQ_REL)) {
+		// other consumers still use the frame
+		return;
+	}
+	if (LIKELY(frame->library_owns_data && frame->data
+		&& !((uintptr_t)frame->data & (FRAME_POOL_ALIGNMENT - 1)))) {
+
+		// file the frame by its buffer, not by data_bytes that the converters shrink to the image size,
+		// so that it returns to the size class it was obtained from
+		const size_t bytes = buffer_bytes(frame);
+		const int index = floor_class(bytes);
+		if (LIKELY(index >= 0)) {
+			frame->alloc_bytes = bytes;
+			// count before put so that the counters never go below zero
+			__atomic_fetch_add(&cached_frames, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&cached_bytes, bytes, __ATOMIC_RELAXED);
+			if (LIKELY(classes[index].put(frame))) {
+				return;
+			}
+			__atomic_fetch_sub(&cached_frames, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_sub(&cached_bytes, bytes, __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_fetch_add(&releases, 1, __ATOMIC_RELAXED);
+	uvc_free_frame(frame);
+}
+
+/**
+ * free all frames kept in the pool, frames in use are not affected
+ * @return bytes of the buffers freed
+ */
+size_t FramePool::trim() {
+	ENTER();
+
+	size_t bytes = 0;
+	for (int i = 0; i < FRAME_POOL_NUM_CLASSES; i++) {
+		for (uvc_frame_t *frame = classes[i].take(); frame; frame = classes[i].take()) {
+			__atomic_fetch_sub(&cached_frames, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_sub(&cached_bytes, frame->alloc_bytes, __ATOMIC_RELAXED);
+			bytes += frame->alloc_bytes;
+			uvc_free_frame(frame);
+		}
+	}
+	LOGI("trimmed %d bytes", (int)bytes);
+
+	RETURN(bytes, size_t);
+}
+
+void FramePool::getStats(frame_pool_stats_t *stats) {
+	stats->hits = __atomic_load_n(&hits, __ATOMIC_RELAXED);
+	stats->misses = __atomic_load_n(&misses, __ATOMIC_RELAXED);
+	stats->releases = __atomic_load_n(&releases, __ATOMIC_RELAXED);
+	stats->cached_frames = __atomic_load_n(&cached_frames, __ATOMIC_RELAXED);
+	stats->cached_bytes = __atomic_load_n(&cached_bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * the pool shared in the process, it is never destroyed
+ * because frames may be recycled by threads still running on exit
+ */
+// static
+FramePool &FramePool::shared() {
+	static FramePool *pool = new FramePool();
+	return *pool;
+}
@@ -0,0 +1,78 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FramePool.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef FRAMEPOOL_H_
+#define FRAMEPOOL_H_
+
+#include "libUVCCamera.h"
+#include "objectqueue.h"
+
+#pragma interface
+
+#define FRAME_POOL_ALIGNMENT 64		// alignment of the frame buffers for SIMD
+#define FRAME_POOL_MIN_SHIFT 12		// smallest size class is 4KB
+#define FRAME_POOL_MAX_SHIFT 26		// frames larger than 64MB are not pooled
+// 4 size classes between powers of 2, so at most 25% of a buffer is unused
+#define FRAME_POOL_NUM_CLASSES ((FRAME_POOL_MAX_SHIFT - FRAME_POOL_MIN_SHIFT) * 4 + 1)
+#define FRAME_POOL_CLASS_FRAMES 16	// frames kept for each size class
+
+typedef struct frame_pool_stats {
+	uint64_t hits;			// frames taken from the pool
+	uint64_t misses;		// frames allocated because the size class was empty
+	uint64_t releases;		// frames freed because the size class was full, too large or no longer aligned
+	uint32_t cached_frames;	// frames kept in the pool now
+	size_t cached_bytes;	// bytes of the buffers kept in the pool now
+} frame_pool_stats_t;
+
+/**
+ * frame buffers shared by the previews.
+ * the buffers are aligned to FRAME_POOL_ALIGNMENT and sorted by the size,
+ * so a request gets a buffer of about the size it needs
+ * and YUYV, RGBX and NV21 frames do not reallocate each other.
+ * a frame can be shared by several consumers with retainFrame,
+ * it goes back to the pool when all of them have called recycleFrame
+ */
+class FramePool {
+private:
+	FreeList<uvc_frame_t *, FRAME_POOL_CLASS_FRAMES> classes[FRAME_POOL_NUM_CLASSES];
+	uint64_t hits, misses, releases;
+	uint32_t cached_frames;
+	size_t cached_bytes;
+	// force inhibiting copy/assignment
+	FramePool(const FramePool &src);
+	void operator =(const FramePool &src);
+public:
+	FramePool();
+	~FramePool();
+
+	uvc_frame_t *obtainFrame(size_t data_bytes);
+	uvc_frame_t *retainFrame(uvc_frame_t *frame);
+	void recycleFrame(uvc_frame_t *frame);
+	size_t trim();
+	void getStats(frame_pool_stats_t *stats);
+
+	static FramePool &shared();
+};
+
+#endif /* FRAMEPOOL_H_ */
@@ -0,0 +1,203 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FrameQueue.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#include <time.h>
+
+#include "utilbase.h"
+#include "FrameQueue.h"
+#include "FramePool.h"
+
+#define FRAME_QUEUE_BLOCK_STEP_MS 100	// FRAME_DROP_NONE checks close() at this interval
+
+FrameQueue::FrameQueue(const int depth, const int drop)
+:	m_depth(depth),
+	m_drop(drop),
+	m_deadline_ms(0),
+	m_closed(false),
+	m_dropped(0) {
+}
+
+/**
+ * change the policy, this can be called while the frames flow
+ * @param depth 1..FRAME_QUEUE_CAPACITY
+ * @param drop FRAME_DROP_NEWEST, FRAME_DROP_OLDEST or FRAME_DROP_NONE
+ * @param deadline_ms drop frames older than this when they are taken, 0: no deadline
+ */
+int FrameQueue::setPolicy(const int depth, const int drop, const int deadline_ms) {
+	if (UNLIKELY((depth < 1) || (depth > FRAME_QUEUE_CAPACITY)
+		|| (drop < FRAME_DROP_NEWEST) || (drop > FRAME_DROP_NONE) || (deadline_ms < 0))) {
+		return UVC_ERROR_INVALID_PARAM;
+	}
+	__atomic_store_n(&m_depth, depth, __ATOMIC_RELAXED);
+	__atomic_store_n(&m_drop, drop, __ATOMIC_RELAXED);
+	__atomic_store_n(&m_deadline_ms, deadline_ms, __ATOMIC_RELAXED);
+	// let a producer blocked with the old depth check again
+	m_freed.wake();
+	return 0;
+}
+
+/**
+ * whether the frame was captured more than deadline_ms before,
+ * capture_time of the frames is in CLOCK_MONOTONIC
+ */
+bool FrameQueue::is_stale(const uvc_frame_t *frame, const int deadline_ms) const {
+	const int64_t captured_ns = (int64_t)frame->capture_time.tv_sec * 1000000000LL
+		+ (int64_t)frame->capture_time.tv_usec * 1000LL;
+	if (UNLIKELY(!captured_ns)) {
+		return false;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec - captured_ns > (int64_t)deadline_ms * 1000000LL;
+}
+
+/**
+ * add the frame, the queue takes the reference of the caller
+ * @return false if the frame was dropped(and recycled)
+ */
+bool FrameQueue::put(uvc_frame_t *frame) {
+	const int depth = __atomic_load_n(&m_depth, __ATOMIC_RELAXED);
+	bool drop = false;
+	if (is_full(depth)) {
+		switch (__atomic_load_n(&m_drop, __ATOMIC_RELAXED)) {
+		case FRAME_DROP_OLDEST:
+			for ( ; is_full(depth) ; ) {
+				uvc_frame_t *oldest = m_frames.take();
+				if (!oldest) break;
+				__atomic_fetch_add(&m_dropped, 1, __ATOMIC_RELAXED);
+				FramePool::shared().recycleFrame(oldest);
+			}
+			break;
+		case FRAME_DROP_NONE:
+			// never wait forever so that stopping the stream can not be blocked by a dead consumer
+			for (int waited = 0; !is_closed() && is_full(__atomic_load_n(&m_depth, __ATOMIC_RELAXED))
+				&& (waited < FRAME_QUEUE_MAX_BLOCK_MS); waited += FRAME_QUEUE_BLOCK_STEP_MS) {
+
+				const uint32_t seq = m_freed.prepare();
+				if (!is_closed() && is_full(__atomic_load_n(&m_depth, __ATOMIC_RELAXED))) {
+					m_freed.wait(seq, FRAME_QUEUE_BLOCK_STEP_MS);
+				}
+				m_freed.finish();
+			}
+			// drop the new frame if the consumer did not take any
+			drop = is_full(__atomic_load_n(&m_depth, __ATOMIC_RELAXED));
+			break;
+		default:
+			drop = true;
+			break;
+		}
+	}
+	if (UNLIKELY(drop || !m_frames.put(frame))) {
+		__atomic_fetch_add(&m_dropped, 1, __ATOMIC_RELAXED);
+		FramePool::shared().recycleFrame(frame);
+		return false;
+	}
+	m_filled.wake();
+	return true;
+}
+
+/**
+ * remove the oldest frame, the frames over the deadline are dropped
+ * @param ticket if not NULL, receives the ticket of the frame that counts up by one in the order of put,
+ * 		the frames dropped by the deadline also use up their tickets
+ * @return NULL if there is no frame
+ */
+uvc_frame_t *FrameQueue::take(uint32_t *ticket) {
+	const int deadline_ms = __atomic_load_n(&m_deadline_ms, __ATOMIC_RELAXED);
+	uvc_frame_t *frame;
+	for (frame = m_frames.take(ticket); frame; frame = m_frames.take(ticket)) {
+		m_freed.wake();
+		if (!deadline_ms || !is_stale(frame, deadline_ms)) {
+			break;
+		}
+		__atomic_fetch_add(&m_dropped, 1, __ATOMIC_RELAXED);
+		FramePool::shared().recycleFrame(frame);
+	}
+	return frame;
+}
+
+/**
+ * remove the oldest frame, sleeps while the queue is empty
+ * @param timeout_ms negative value waits infinitely
+ * @param ticket if not NULL, receives the ticket of the frame, see take
+ * @return NULL on timeout, when wakeup is called or when the queue is closed and empty
+ */
+uvc_frame_t *FrameQueue::wait(const int timeout_ms, uint32_t *ticket) {
+	uvc_frame_t *frame = take(ticket);
+	if (!frame) {
+		const uint32_t seq = m_filled.prepare();
+		frame = take(ticket);
+		if (!frame && !is_closed()) {
+			m_filled.wait(seq, timeout_ms);
+			frame = take(ticket);
+		}
+		m_filled.finish();
+	}
+	return frame;
+}
+
+/**
+ * let the consumer return from wait without a frame
+ */
+void FrameQueue::wakeup() {
+	m_filled.wake();
+}
+
+/**
+ * let the producer block again with FRAME_DROP_NONE, call before the frames flow
+ */
+void FrameQueue::open() {
+	__atomic_store_n(&m_closed, false, __ATOMIC_RELEASE);
+}
+
+/**
+ * release the producer and the consumer, the producer drops frames instead of blocking
+ * and the consumer does not sleep in wait after this
+ */
+void FrameQueue::close() {
+	__atomic_store_n(&m_closed, true, __ATOMIC_RELEASE);
+	m_freed.wake();
+	m_filled.wake();
+}
+
+/**
+ * recycle the frames not taken yet
+ */
+void FrameQueue::clear() {
+	for (uvc_frame_t *frame = m_frames.take(); frame; frame = m_frames.take()) {
+		FramePool::shared().recycleFrame(frame);
+	}
+	m_freed.wake();
+}
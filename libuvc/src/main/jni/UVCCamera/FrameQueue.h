@@ -0,0 +1,81 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FrameQueue.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef FRAMEQUEUE_H_
+#define FRAMEQUEUE_H_
+
+#include "libUVCCamera.h"
+#include "objectqueue.h"
+
+#pragma interface
+
+#define FRAME_QUEUE_CAPACITY 16		// max depth of the queues
+#define FRAME_QUEUE_MAX_BLOCK_MS 1000	// FRAME_DROP_NONE blocks the producer at most this time
+
+// what to do when the queue has as many frames as its depth
+#define FRAME_DROP_NEWEST 0		// discard the frame being added
+#define FRAME_DROP_OLDEST 1		// discard the oldest frame not taken yet, latest frame wins
+#define FRAME_DROP_NONE 2		// block the producer until the consumer takes a frame
+
+/**
+ * queue of frames between two stages of the preview.
+ * the depth, the drop strategy and the deadline can be changed while the frames flow.
+ * frames dropped here are recycled into FramePool::shared().
+ * several threads can put (e.g. the preview thread and the decoding threads)
+ * and take, the producers also take the oldest frames with FRAME_DROP_OLDEST.
+ * FRAME_DROP_NONE must not be used when the producer is the frame callback of libuvc
+ */
+class FrameQueue {
+private:
+	FreeList<uvc_frame_t *, FRAME_QUEUE_CAPACITY> m_frames;
+	FutexSync m_filled;		// wakes the consumer waiting for a frame
+	FutexSync m_freed;		// wakes the producer blocked by FRAME_DROP_NONE
+	int m_depth;
+	int m_drop;
+	int m_deadline_ms;		// frames older than this are not passed to the consumer, 0: no deadline
+	bool m_closed;			// accessed with __atomic, producers drop instead of blocking while true
+	uint64_t m_dropped;
+	// force inhibiting copy/assignment
+	FrameQueue(const FrameQueue &src);
+	void operator =(const FrameQueue &src);
+	bool is_stale(const uvc_frame_t *frame, const int deadline_ms) const;
+	inline bool is_closed() const { return __atomic_load_n(&m_closed, __ATOMIC_ACQUIRE); }
+	inline bool is_full(const int depth) const { return m_frames.size() >= depth; }
+public:
+	FrameQueue(const int depth, const int drop);
+
+	int setPolicy(const int depth, const int drop, const int deadline_ms);
+	inline int size() const { return m_frames.size(); }
+	inline uint64_t dropped() const { return __atomic_load_n(&m_dropped, __ATOMIC_RELAXED); }
+	bool put(uvc_frame_t *frame);
+	uvc_frame_t *take(uint32_t *ticket = NULL);
+	uvc_frame_t *wait(const int timeout_ms = -1, uint32_t *ticket = NULL);
+	inline uint32_t nextTicket() const { return m_frames.head(); }
+	void wakeup();
+	void open();
+	void close();
+	void clear();
+};
+
+#endif /* FRAMEQUEUE_H_ */
@@ -78,7 +78,7 @@ UVCCamera::~UVCCamera() {
 	ENTER();
 	release();
 	if (mContext) {
-		uvc_exit(mContext);
+		uvc_exit_shared(mContext);
 		mContext = NULL;
 	}
 	if (mUsbFs) {
@@ -142,7 +142,8 @@ int UVCCamera::connect(int vid, int pid, int fd, int busnum, int devaddr, const
 			free(mUsbFs);
 		mUsbFs = strdup(usbfs);
 		if (UNLIKELY(!mContext)) {
-			result = uvc_init2(&mContext, NULL, mUsbFs);
+			// 全てのカメラで1つのコンテキストとイベントスレッドを共有する
+			result = uvc_init_shared(&mContext, mUsbFs);
 //			libusb_set_debug(mContext->usb_ctx, LIBUSB_LOG_LEVEL_DEBUG);
 			if (UNLIKELY(result < 0)) {
 				LOGD("failed to init libuvc");
@@ -264,15 +265,36 @@ int UVCCamera::setPreviewDisplay(ANativeWindow *preview_window) {
 	RETURN(result, int);
 }
 
-int UVCCamera::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format) {
+int UVCCamera::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, bool with_meta) {
 	ENTER();
 	int result = EXIT_FAILURE;
 	if (mPreview) {
-		result = mPreview->setFrameCallback(env, frame_callback_obj, pixel_format);
+		result = mPreview->setFrameCallback(env, frame_callback_obj, pixel_format, with_meta);
 	}
 	RETURN(result, int);
 }
 
+int UVCCamera::setFrameBufferCallback(JNIEnv *env, jobject callback_obj, jobjectArray buffers, int pixel_format) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setFrameBufferCallback(env, callback_obj, buffers, pixel_format);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::releaseFrameBuffer(int index) {
+	int result = EXIT_FAILURE;
+	if (LIKELY(mPreview)) {
+		result = mPreview->releaseFrameBuffer(index);
+	}
+	return result;
+}
+
+uint64_t UVCCamera::getFrameBufferDrops() {
+	return mPreview ? mPreview->getFrameBufferDrops() : 0;
+}
+
 int UVCCamera::startPreview() {
 	ENTER();
 
@@ -300,6 +322,60 @@ int UVCCamera::setCaptureDisplay(ANativeWindow *capture_window) {
 	RETURN(result, int);
 }
 
+int UVCCamera::setTraceFile(const char *path) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setTraceFile(path);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::setDecodeThreads(int num_threads) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setDecodeThreads(num_threads);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::setPreviewScaling(bool enable) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setPreviewScaling(enable);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::setColor(int matrix, int range) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setColor(matrix, range);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::setQueuePolicy(int stage, int depth, int drop, int deadline_ms) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setQueuePolicy(stage, depth, drop, deadline_ms);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::getStreamStats(uvc_stream_stats_t *stats) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->getStreamStats(stats);
+	}
+	RETURN(result, int);
+}
+
 //======================================================================
 // カメラのサポートしているコントロール機能を取得する
 int UVCCamera::getCtrlSupports(uint64_t *supports) {
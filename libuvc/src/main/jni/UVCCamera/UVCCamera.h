@@ -191,10 +191,19 @@ public:
 	char *getSupportedSize();
 	int setPreviewSize(int width, int height, int min_fps, int max_fps, int mode, float bandwidth = DEFAULT_BANDWIDTH);
 	int setPreviewDisplay(ANativeWindow *preview_window);
-	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format);
+	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, bool with_meta = false);
+	int setFrameBufferCallback(JNIEnv *env, jobject callback_obj, jobjectArray buffers, int pixel_format);
+	int releaseFrameBuffer(int index);
+	uint64_t getFrameBufferDrops();
 	int startPreview();
 	int stopPreview();
 	int setCaptureDisplay(ANativeWindow *capture_window);
+	int getStreamStats(uvc_stream_stats_t *stats);
+	int setTraceFile(const char *path);
+	int setDecodeThreads(int num_threads);
+	int setPreviewScaling(bool enable);
+	int setColor(int matrix, int range);
+	int setQueuePolicy(int stage, int depth, int drop, int deadline_ms);
 
 	int getCtrlSupports(uint64_t *supports);
 	int getProcSupports(uint64_t *supports);
@@ -42,46 +42,84 @@
 #include "libuvc_internal.h"
 
 #define	LOCAL_DEBUG 0
-#define MAX_FRAME 4
 #define PREVIEW_PIXEL_BYTES 4	// RGBA/RGBX
-#define FRAME_POOL_SZ MAX_FRAME + 2
+#define CAPTURE_WAIT_MS 1000
 
-struct timespec ts;
-struct timeval tv;
+/**
+ * current time for uvc_frame::stage_ns, same clock as libuvc
+ */
+static inline int64_t stage_time_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
 UVCPreview::UVCPreview(uvc_device_handle_t *devh)
-:	mPreviewWindow(NULL),
-	mCaptureWindow(NULL),
-	mDeviceHandle(devh),
+:	mDeviceHandle(devh),
+	mStreamHandle(NULL),
+	mTracePath(NULL),
+	requestColorMatrix(UVC_COLOR_MATRIX_BT601),
+	requestColorRange(UVC_COLOR_RANGE_FULL),
+	mPreviewWindow(NULL),
+	mIsRunning(false),
 	requestWidth(DEFAULT_PREVIEW_WIDTH),
 	requestHeight(DEFAULT_PREVIEW_HEIGHT),
+	requestMode(DEFAULT_PREVIEW_MODE),
 	requestMinFps(DEFAULT_PREVIEW_FPS_MIN),
 	requestMaxFps(DEFAULT_PREVIEW_FPS_MAX),
-	requestMode(DEFAULT_PREVIEW_MODE),
 	requestBandwidth(DEFAULT_BANDWIDTH),
 	frameWidth(DEFAULT_PREVIEW_WIDTH),
 	frameHeight(DEFAULT_PREVIEW_HEIGHT),
-	frameBytes(DEFAULT_PREVIEW_WIDTH * DEFAULT_PREVIEW_HEIGHT * 2),	// YUYV
 	frameMode(0),
-	previewBytes(DEFAULT_PREVIEW_WIDTH * DEFAULT_PREVIEW_HEIGHT * PREVIEW_PIXEL_BYTES),
+	frameBytes(DEFAULT_PREVIEW_WIDTH * DEFAULT_PREVIEW_HEIGHT * 2),	// YUYV
+	previewFrames(MAX_FRAME, FRAME_DROP_NEWEST),
 	previewFormat(WINDOW_FORMAT_RGBA_8888),
-	mIsRunning(false),
+	previewBytes(DEFAULT_PREVIEW_WIDTH * DEFAULT_PREVIEW_HEIGHT * PREVIEW_PIXEL_BYTES),
+	requestPreviewScaling(false),
+	windowWidth(0),
+	windowHeight(0),
+	bufferWidth(0),
+	bufferHeight(0),
+	previewScale(1),
+	requestDecodeThreads(DEFAULT_DECODE_THREADS),
+	decodeThreads(0),
+	decodeFrames(FRAME_QUEUE_CAPACITY, FRAME_DROP_NEWEST),	// dispatch_decode keeps it from filling up
+	mIsDecoding(false),
+	decodeInFlight(0),
+	decodeNext(0),
 	mIsCapturing(false),
-	captureQueu(NULL),
+	mCaptureWindow(NULL),
+	captureQueu(1, FRAME_DROP_OLDEST),		// keep latest frame
+	mHasCallback(false),
+	callbackQueue(1, FRAME_DROP_OLDEST),	// keep latest frame
 	mFrameCallbackObj(NULL),
 	mFrameCallbackFunc(NULL),
-	callbackPixelBytes(2) {
+	callbackPixelBytes(2),
+	mFrameCallbackWithMeta(false),
+	mFrameMetaBuf(NULL),
+	mLastCallbackSequence(0),
+	mHasLastCallbackSequence(false),
+	mFrameBufferCallbackObj(NULL),
+	mCallbackBufferNum(0),
+	mCallbackBufferDrops(0) {
 
 	ENTER();
-	pthread_cond_init(&preview_sync, NULL);
+	memset(&mLastStats, 0, sizeof(mLastStats));
+	memset(mCallbackBuffers, 0, sizeof(mCallbackBuffers));
+	memset(&mFrameMeta, 0, sizeof(mFrameMeta));
+	iframebuffercallback_fields.onFrameBuffer = NULL;
+	pthread_mutex_init(&stream_mutex, NULL);
 	pthread_mutex_init(&preview_mutex, NULL);
     // 初始化并关联 capture_clock_attr
     //pthread_condattr_init(&capture_clock_attr);
     //pthread_condattr_setclock(&capture_clock_attr, CLOCK_MONOTONIC);
 	pthread_cond_init(&capture_sync, NULL);
 	pthread_mutex_init(&capture_mutex, NULL);
+	pthread_mutex_init(&callback_mutex, NULL);
+	pthread_mutex_init(&buffer_mutex, NULL);
 
-	pthread_mutex_init(&pool_mutex, NULL);
+	pthread_cond_init(&decode_sync, NULL);
+	pthread_mutex_init(&decode_mutex, NULL);
 	EXIT();
 }
 
@@ -96,81 +134,63 @@ UVCPreview::~UVCPreview() {
 	mCaptureWindow = NULL;
 	clearPreviewFrame();
 	clearCaptureFrame();
+	clearCallbackFrame();
 	clear_pool();
 	pthread_mutex_lock(&preview_mutex);
 	pthread_mutex_destroy(&preview_mutex);
-	pthread_cond_destroy(&preview_sync);
 	pthread_mutex_lock(&capture_mutex);
 	pthread_mutex_destroy(&capture_mutex);
 	pthread_cond_destroy(&capture_sync);
+	pthread_mutex_destroy(&callback_mutex);
+	pthread_mutex_destroy(&buffer_mutex);
 	// 释放 capture_clock_aatr
     // pthread_condattr_destroy(&capture_clock_attr);
-	pthread_mutex_destroy(&pool_mutex);
+	pthread_mutex_destroy(&stream_mutex);
+	pthread_mutex_destroy(&decode_mutex);
+	pthread_cond_destroy(&decode_sync);
+	SAFE_FREE(mTracePath);
 	EXIT();
 }
 
 /**
- * get uvc_frame_t from frame pool
- * if pool is empty, create new frame
- * this function does not confirm the frame size
- * and you may need to confirm the size
+ * get uvc_frame_t from the shared frame pool
+ * if the pool has no frame of the size, create new frame
+ * the data buffer has data_bytes at least and is aligned for SIMD
  */
 uvc_frame_t *UVCPreview::get_frame(size_t data_bytes) {
-	uvc_frame_t *frame = NULL;
-	pthread_mutex_lock(&pool_mutex);
-	{
-		if (!mFramePool.isEmpty()) {
-			frame = mFramePool.last();
-		}
-	}
-	pthread_mutex_unlock(&pool_mutex);
-	if UNLIKELY(!frame) {
-		LOGW("allocate new frame");
-		frame = uvc_allocate_frame(data_bytes);
-	}
-	return frame;
+	return FramePool::shared().obtainFrame(data_bytes);
 }
 
 void UVCPreview::recycle_frame(uvc_frame_t *frame) {
-	pthread_mutex_lock(&pool_mutex);
-	if (LIKELY(mFramePool.size() < FRAME_POOL_SZ)) {
-		mFramePool.put(frame);
-		frame = NULL;
-	}
-	pthread_mutex_unlock(&pool_mutex);
-	if (UNLIKELY(frame)) {
-		uvc_free_frame(frame);
-	}
+	FramePool::shared().recycleFrame(frame);
 }
 
 
+/**
+ * allocate the frames used by the preview beforehand
+ */
 void UVCPreview::init_pool(size_t data_bytes) {
 	ENTER();
 
-	clear_pool();
-	pthread_mutex_lock(&pool_mutex);
-	{
-		for (int i = 0; i < FRAME_POOL_SZ; i++) {
-			mFramePool.put(uvc_allocate_frame(data_bytes));
-		}
+	uvc_frame_t *frames[FRAME_POOL_SZ];
+	for (int i = 0; i < FRAME_POOL_SZ; i++) {
+		frames[i] = get_frame(data_bytes);
+	}
+	for (int i = 0; i < FRAME_POOL_SZ; i++) {
+		recycle_frame(frames[i]);
 	}
-	pthread_mutex_unlock(&pool_mutex);
 
 	EXIT();
 }
 
+/**
+ * release the frames kept in the shared pool, the frames other instances are using are not affected
+ */
 void UVCPreview::clear_pool() {
 	ENTER();
 
-	pthread_mutex_lock(&pool_mutex);
-	{
-		const int n = mFramePool.size();
-		for (int i = 0; i < n; i++) {
-			uvc_free_frame(mFramePool[i]);
-		}
-		mFramePool.clear();
-	}
-	pthread_mutex_unlock(&pool_mutex);
+	FramePool::shared().trim();
+
 	EXIT();
 }
 
@@ -205,9 +225,13 @@ int UVCPreview::setPreviewDisplay(ANativeWindow *preview_window) {
 			if (mPreviewWindow)
 				ANativeWindow_release(mPreviewWindow);
 			mPreviewWindow = preview_window;
+			bufferWidth = bufferHeight = 0;
 			if (LIKELY(mPreviewWindow)) {
-				ANativeWindow_setBuffersGeometry(mPreviewWindow,
-					frameWidth, frameHeight, previewFormat);
+				// 以前に使ったSurfaceは設定したバッファサイズを返すので、Surface自体のサイズに戻してから取得する
+				ANativeWindow_setBuffersGeometry(mPreviewWindow, 0, 0, 0);
+				windowWidth = ANativeWindow_getWidth(mPreviewWindow);
+				windowHeight = ANativeWindow_getHeight(mPreviewWindow);
+				set_window_geometry(frameWidth, frameHeight);
 			}
 		}
 	}
@@ -215,19 +239,18 @@ int UVCPreview::setPreviewDisplay(ANativeWindow *preview_window) {
 	RETURN(0, int);
 }
 
-int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format) {
+/**
+ * @param with_meta true: frame_callback_obj is IFrameMetaCallback and gets the metadata of each frame
+ */
+int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, bool with_meta) {
 	
 	ENTER();
 	pthread_mutex_lock(&capture_mutex);
+	// wait finishing the callback in progress
+	pthread_mutex_lock(&callback_mutex);
 	{
-		if (isRunning() && isCapturing()) {
-			mIsCapturing = false;
-			if (mFrameCallbackObj) {
-				pthread_cond_signal(&capture_sync);
-				pthread_cond_wait(&capture_sync, &capture_mutex);	// wait finishing capturing
-			}
-		}
-		if (!env->IsSameObject(mFrameCallbackObj, frame_callback_obj))	{
+		if (!env->IsSameObject(mFrameCallbackObj, frame_callback_obj)
+			|| (with_meta != mFrameCallbackWithMeta))	{
 			iframecallback_fields.onFrame = NULL;
 			if (mFrameCallbackObj) {
 				env->DeleteGlobalRef(mFrameCallbackObj);
@@ -237,8 +260,8 @@ int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pi
 				// get method IDs of Java object for callback
 				jclass clazz = env->GetObjectClass(frame_callback_obj);
 				if (LIKELY(clazz)) {
-					iframecallback_fields.onFrame = env->GetMethodID(clazz,
-						"onFrame",	"(Ljava/nio/ByteBuffer;)V");
+					iframecallback_fields.onFrame = env->GetMethodID(clazz, "onFrame",
+						with_meta ? "(Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;)V" : "(Ljava/nio/ByteBuffer;)V");
 				} else {
 					LOGW("failed to get object class");
 				}
@@ -250,15 +273,157 @@ int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pi
 				}
 			}
 		}
+		mFrameCallbackWithMeta = frame_callback_obj && with_meta;
+		if (mFrameCallbackWithMeta && !mFrameMetaBuf) {
+			// one ByteBuffer on mFrameMeta is passed with every frame
+			jobject buf = env->NewDirectByteBuffer(&mFrameMeta, sizeof(mFrameMeta));
+			if (LIKELY(buf)) {
+				mFrameMetaBuf = env->NewGlobalRef(buf);
+				env->DeleteLocalRef(buf);
+			}
+		} else if (!mFrameCallbackWithMeta && mFrameMetaBuf) {
+			env->DeleteGlobalRef(mFrameMetaBuf);
+			mFrameMetaBuf = NULL;
+		}
 		if (frame_callback_obj) {
 			mPixelFormat = pixel_format;
 			callbackPixelFormatChanged();
 		}
 	}
+	pthread_mutex_unlock(&callback_mutex);
 	pthread_mutex_unlock(&capture_mutex);
 	RETURN(0, int);
 }
 
+/**
+ * deliver frames into the direct ByteBuffers registered by Java instead of IFrameCallback.
+ * a filled buffer is passed to IFrameBufferCallback#onFrameBuffer by its index
+ * and is not filled again until Java returns it with releaseFrameBuffer,
+ * a frame is dropped and counted when Java holds all buffers.
+ * the buffers registered before are released
+ * @param callback_obj global reference of IFrameBufferCallback, NULL to stop delivering
+ * @param buffers direct ByteBuffers, at most MAX_CALLBACK_BUFFERS
+ */
+int UVCPreview::setFrameBufferCallback(JNIEnv *env, jobject callback_obj, jobjectArray buffers, int pixel_format) {
+
+	ENTER();
+	int result = 0;
+	pthread_mutex_lock(&capture_mutex);
+	// wait finishing the callback in progress
+	pthread_mutex_lock(&callback_mutex);
+	// releaseFrameBuffer can not see the buffers half registered
+	pthread_mutex_lock(&buffer_mutex);
+	{
+		release_callback_buffers(env);
+		const int n = callback_obj && buffers ? env->GetArrayLength(buffers) : 0;
+		if (UNLIKELY(n > MAX_CALLBACK_BUFFERS)) {
+			result = UVC_ERROR_INVALID_PARAM;
+		}
+		for (int i = 0; !result && (i < n); i++) {
+			jobject buffer = env->GetObjectArrayElement(buffers, i);
+			callback_buffer_t *buf = &mCallbackBuffers[i];
+			buf->index = i;
+			buf->data = buffer ? (uint8_t *)env->GetDirectBufferAddress(buffer) : NULL;
+			buf->capacity = buffer ? (size_t)env->GetDirectBufferCapacity(buffer) : 0;
+			buf->busy = 0;
+			if (LIKELY(buf->data)) {
+				buf->buffer = env->NewGlobalRef(buffer);
+				__atomic_fetch_add(&mCallbackBufferNum, 1, __ATOMIC_RELAXED);
+			} else {
+				LOGE("buffer %d is not a direct ByteBuffer", i);
+				result = UVC_ERROR_INVALID_PARAM;
+			}
+			if (buffer) {
+				env->DeleteLocalRef(buffer);
+			}
+		}
+		if (!result && callback_obj) {
+			jclass clazz = env->GetObjectClass(callback_obj);
+			if (LIKELY(clazz)) {
+				iframebuffercallback_fields.onFrameBuffer = env->GetMethodID(clazz,
+					"onFrameBuffer", "(IIIIJJ)V");
+				env->DeleteLocalRef(clazz);
+			}
+			env->ExceptionClear();
+			if (!iframebuffercallback_fields.onFrameBuffer) {
+				LOGE("Can't find IFrameBufferCallback#onFrameBuffer");
+				result = UVC_ERROR_INVALID_PARAM;
+			}
+		}
+		if (!result && callback_obj) {
+			const int num = __atomic_load_n(&mCallbackBufferNum, __ATOMIC_RELAXED);
+			for (int i = 0; i < num; i++) {
+				mFreeCallbackBuffers.put(&mCallbackBuffers[i]);
+			}
+			mFrameBufferCallbackObj = callback_obj;
+			mPixelFormat = pixel_format;
+			callbackPixelFormatChanged();
+		} else {
+			release_callback_buffers(env);
+			if (callback_obj) {
+				env->DeleteGlobalRef(callback_obj);
+			}
+		}
+	}
+	pthread_mutex_unlock(&buffer_mutex);
+	pthread_mutex_unlock(&callback_mutex);
+	pthread_mutex_unlock(&capture_mutex);
+	RETURN(result, int);
+}
+
+/**
+ * release the ByteBuffers and IFrameBufferCallback, call with callback_mutex and buffer_mutex
+ */
+void UVCPreview::release_callback_buffers(JNIEnv *env) {
+	if (mFrameBufferCallbackObj) {
+		env->DeleteGlobalRef(mFrameBufferCallbackObj);
+		mFrameBufferCallbackObj = NULL;
+	}
+	iframebuffercallback_fields.onFrameBuffer = NULL;
+	// forget the buffers Java has returned
+	for ( ; mFreeCallbackBuffers.take() ; ) {
+	}
+	const int num = __atomic_load_n(&mCallbackBufferNum, __ATOMIC_RELAXED);
+	for (int i = 0; i < num; i++) {
+		if (mCallbackBuffers[i].buffer) {
+			env->DeleteGlobalRef(mCallbackBuffers[i].buffer);
+		}
+	}
+	memset(mCallbackBuffers, 0, sizeof(mCallbackBuffers));
+	__atomic_store_n(&mCallbackBufferNum, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * return the buffer passed to IFrameBufferCallback#onFrameBuffer,
+ * this can be called from any thread including the callback itself.
+ * an index of the buffers registered before the last setFrameBufferCallback must not be returned
+ * @return UVC_ERROR_INVALID_PARAM if the index is not registered or the buffer is already returned
+ */
+int UVCPreview::releaseFrameBuffer(int index) {
+	int result = UVC_ERROR_INVALID_PARAM;
+	// callback_mutex can not be used because the callback itself may return the buffer
+	pthread_mutex_lock(&buffer_mutex);
+	if (LIKELY((index >= 0) && (index < __atomic_load_n(&mCallbackBufferNum, __ATOMIC_RELAXED)))) {
+		callback_buffer_t *buf = &mCallbackBuffers[index];
+		uint32_t busy = 1;
+		// ignore the buffer already returned, the free list must not have the same buffer twice
+		if (LIKELY(__atomic_compare_exchange_n(&buf->busy, &busy, 0,
+			false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))) {
+			mFreeCallbackBuffers.put(buf);
+			result = 0;
+		}
+	}
+	pthread_mutex_unlock(&buffer_mutex);
+	return result;
+}
+
+/**
+ * number of frames dropped because Java held all buffers
+ */
+uint64_t UVCPreview::getFrameBufferDrops() {
+	return __atomic_load_n(&mCallbackBufferDrops, __ATOMIC_RELAXED);
+}
+
 void UVCPreview::callbackPixelFormatChanged() {
 	mFrameCallbackFunc = NULL;
 	const size_t sz = requestWidth * requestHeight;
@@ -339,6 +504,9 @@ int UVCPreview::startPreview() {
 
 	int result = EXIT_FAILURE;
 	if (!isRunning()) {
+		previewFrames.open();
+		captureQueu.open();
+		callbackQueue.open();
 		mIsRunning = true;
 		pthread_mutex_lock(&preview_mutex);
 		{
@@ -350,11 +518,7 @@ int UVCPreview::startPreview() {
 		if (UNLIKELY(result != EXIT_SUCCESS)) {
 			LOGW("UVCCamera::window does not exist/already running/could not create thread etc.");
 			mIsRunning = false;
-			pthread_mutex_lock(&preview_mutex);
-			{
-				pthread_cond_signal(&preview_sync);
-			}
-			pthread_mutex_unlock(&preview_mutex);
+			previewFrames.wakeup();
 		}
 	}
 	RETURN(result, int);
@@ -365,23 +529,36 @@ int UVCPreview::stopPreview() {
 	bool b = isRunning();
 	if (LIKELY(b)) {
 		mIsRunning = false;
-        pthread_cond_signal(&preview_sync);
+		// release the threads blocked by FRAME_DROP_NONE too
+		previewFrames.close();
+		captureQueu.close();
+		callbackQueue.close();
+		// the preview thread creates the capture/callback threads while opening the stream,
+		// join it first so that mHasCapturing/mHasCallback are final when they are read
+		if (preview_thread && pthread_join(preview_thread, NULL) != EXIT_SUCCESS) {
+			LOGW("UVCPreview::terminate preview thread: pthread_join failed");
+		}
         // jiangdg:fix stopview crash
         // because of capture_thread may null when called do_preview()
 		if (mHasCapturing) {
-            pthread_cond_signal(&capture_sync);
+			captureQueu.wakeup();
             if (capture_thread && pthread_join(capture_thread, NULL) != EXIT_SUCCESS) {
                 LOGW("UVCPreview::terminate capture thread: pthread_join failed");
             }
 		}
-		if (preview_thread && pthread_join(preview_thread, NULL) != EXIT_SUCCESS) {
-			LOGW("UVCPreview::terminate preview thread: pthread_join failed");
+		if (mHasCallback) {
+			callbackQueue.wakeup();
+			if (pthread_join(callback_thread, NULL) != EXIT_SUCCESS) {
+				LOGW("UVCPreview::terminate callback thread: pthread_join failed");
+			}
 		}
 		clearDisplay();
 	}
 	mHasCapturing = false;
+	mHasCallback = false;
 	clearPreviewFrame();
 	clearCaptureFrame();
+	clearCallbackFrame();
 	// check preview mutex available
 	if (pthread_mutex_lock(&preview_mutex) == 0) {
 		if (mPreviewWindow) {
@@ -403,9 +580,34 @@ int UVCPreview::stopPreview() {
 //**********************************************************************
 //
 //**********************************************************************
+/**
+ * provide frame buffers from frame pool to libuvc
+ * libuvc assembles received data directly into them (zero copy mode)
+ */
+uvc_frame_t *UVCPreview::uvc_preview_frame_alloc(size_t data_bytes, void *vptr_args) {
+	UVCPreview *preview = reinterpret_cast<UVCPreview *>(vptr_args);
+	return preview->get_frame(data_bytes);
+}
+
+/**
+ * take back the frames libuvc still holds when they no longer fit or the stream is closed
+ */
+void UVCPreview::uvc_preview_frame_release(uvc_frame_t *frame, void *vptr_args) {
+	UVCPreview *preview = reinterpret_cast<UVCPreview *>(vptr_args);
+	preview->recycle_frame(frame);
+}
+
+/**
+ * the frame is handed over from libuvc without copying,
+ * so we must add it to preview queue or recycle it here
+ */
 void UVCPreview::uvc_preview_frame_callback(uvc_frame_t *frame, void *vptr_args) {
 	UVCPreview *preview = reinterpret_cast<UVCPreview *>(vptr_args);
-	if UNLIKELY(!preview->isRunning() || !frame || !frame->frame_format || !frame->data || !frame->data_bytes) return;
+	if UNLIKELY(!frame) return;
+	if UNLIKELY(!preview->isRunning() || !frame->frame_format || !frame->data || !frame->data_bytes) {
+		preview->recycle_frame(frame);
+		return;
+	}
 	if (UNLIKELY(
 		((frame->frame_format != UVC_FRAME_FORMAT_MJPEG) && (frame->actual_bytes < preview->frameBytes))
 		|| (frame->width != preview->frameWidth) || (frame->height != preview->frameHeight) )) {
@@ -415,62 +617,49 @@ void UVCPreview::uvc_preview_frame_callback(uvc_frame_t *frame, void *vptr_args)
 			frame->frame_format, frame->actual_bytes, preview->frameBytes,
 			frame->width, frame->height, preview->frameWidth, preview->frameHeight);
 #endif
+		preview->recycle_frame(frame);
 		return;
 	}
-	if (LIKELY(preview->isRunning())) {
-		uvc_frame_t *copy = preview->get_frame(frame->data_bytes);
-		if (UNLIKELY(!copy)) {
-#if LOCAL_DEBUG
-			LOGE("uvc_callback:unable to allocate duplicate frame!");
-#endif
-			return;
-		}
-		uvc_error_t ret = uvc_duplicate_frame(frame, copy);
-		if (UNLIKELY(ret)) {
-			preview->recycle_frame(copy);
-			return;
-		}
-		preview->addPreviewFrame(copy);
-	}
+	preview->addPreviewFrame(frame);
 }
 
+/**
+ * pass the frame to the preview thread, called only from the frame callback.
+ * when the preview thread has as many frames as the depth not taken yet,
+ * a frame is dropped by the policy of QUEUE_STAGE_PREVIEW, this never blocks
+ */
 void UVCPreview::addPreviewFrame(uvc_frame_t *frame) {
 
-	pthread_mutex_lock(&preview_mutex);
-	if (isRunning() && (previewFrames.size() < MAX_FRAME)) {
+	if (LIKELY(isRunning())) {
 		previewFrames.put(frame);
-		frame = NULL;
-		pthread_cond_signal(&preview_sync);
-	}
-	pthread_mutex_unlock(&preview_mutex);
-	if (frame) {
+	} else {
 		recycle_frame(frame);
 	}
 }
 
+/**
+ * take the oldest frame for the preview, called only from the preview thread.
+ * blocks while there is no frame
+ * @return NULL if stopped
+ */
 uvc_frame_t *UVCPreview::waitPreviewFrame() {
-	uvc_frame_t *frame = NULL;
-	pthread_mutex_lock(&preview_mutex);
-	{
-		if (!previewFrames.size()) {
-			pthread_cond_wait(&preview_sync, &preview_mutex);
-		}
-		if (LIKELY(isRunning() && previewFrames.size() > 0)) {
-			frame = previewFrames.remove(0);
-		}
+	uvc_frame_t *frame = previewFrames.wait();
+	if (UNLIKELY(frame && !isRunning())) {
+		recycle_frame(frame);
+		frame = NULL;
+	}
+	if (LIKELY(frame)) {
+		frame->stage_ns[FRAME_STAGE_DEQUEUED] = stage_time_ns();
 	}
-	pthread_mutex_unlock(&preview_mutex);
 	return frame;
 }
 
+/**
+ * recycle the frames not taken yet,
+ * call from the preview thread or when the preview thread is not running
+ */
 void UVCPreview::clearPreviewFrame() {
-	pthread_mutex_lock(&preview_mutex);
-	{
-		for (int i = 0; i < previewFrames.size(); i++)
-			recycle_frame(previewFrames[i]);
-		previewFrames.clear();
-	}
-	pthread_mutex_unlock(&preview_mutex);
+	previewFrames.clear();
 }
 
 void *UVCPreview::preview_thread_func(void *vptr_args) {
@@ -507,17 +696,19 @@ int UVCPreview::prepare_preview(uvc_stream_ctrl_t *ctrl) {
 			frameWidth = frame_desc->wWidth;
 			frameHeight = frame_desc->wHeight;
 			LOGI("frameSize=(%d,%d)@%s", frameWidth, frameHeight, (!requestMode ? "YUYV" : "MJPEG"));
-			pthread_mutex_lock(&preview_mutex);
-			if (LIKELY(mPreviewWindow)) {
-				ANativeWindow_setBuffersGeometry(mPreviewWindow,
-					frameWidth, frameHeight, previewFormat);
-			}
-			pthread_mutex_unlock(&preview_mutex);
 		} else {
 			frameWidth = requestWidth;
 			frameHeight = requestHeight;
 		}
 		frameMode = requestMode;
+		pthread_mutex_lock(&preview_mutex);
+		{
+			previewScale = choose_preview_scale();
+			set_window_geometry((frameWidth + previewScale - 1) / previewScale,
+				(frameHeight + previewScale - 1) / previewScale);
+		}
+		pthread_mutex_unlock(&preview_mutex);
+		LOGI("previewScale=1/%d", previewScale);
 		frameBytes = frameWidth * frameHeight * (!requestMode ? 2 : 4);
 		previewBytes = frameWidth * frameHeight * PREVIEW_PIXEL_BYTES;
 	} else {
@@ -526,56 +717,319 @@ int UVCPreview::prepare_preview(uvc_stream_ctrl_t *ctrl) {
 	RETURN(result, int);
 }
 
+/**
+ * keep the statistics of the stream and close it,
+ * this must not be called with preview_mutex held because closing waits for the frame callback
+ */
+void UVCPreview::close_stream() {
+	ENTER();
+
+	uvc_stream_handle_t *strmh;
+	pthread_mutex_lock(&stream_mutex);
+	{
+		strmh = mStreamHandle;
+		mStreamHandle = NULL;
+	}
+	pthread_mutex_unlock(&stream_mutex);
+	if (LIKELY(strmh)) {
+		uvc_stream_stop(strmh);
+		pthread_mutex_lock(&stream_mutex);
+		{
+			uvc_stream_get_stats(strmh, &mLastStats);
+		}
+		pthread_mutex_unlock(&stream_mutex);
+		uvc_stream_close(strmh);
+	}
+
+	EXIT();
+}
+
+/**
+ * get the transport statistics of current stream or the last stream if not streaming
+ */
+int UVCPreview::getStreamStats(uvc_stream_stats_t *stats) {
+	ENTER();
+
+	uvc_error_t result = UVC_ERROR_INVALID_PARAM;
+	if (LIKELY(stats)) {
+		pthread_mutex_lock(&stream_mutex);
+		{
+			if (mStreamHandle) {
+				result = uvc_stream_get_stats(mStreamHandle, stats);
+			} else {
+				*stats = mLastStats;
+				result = UVC_SUCCESS;
+			}
+		}
+		pthread_mutex_unlock(&stream_mutex);
+	}
+
+	RETURN(result, int);
+}
+
+/**
+ * record the payloads of following streams into the file to replay them later,
+ * this takes effect from the next startPreview
+ * @param path NULL to stop recording
+ */
+int UVCPreview::setTraceFile(const char *path) {
+	ENTER();
+
+	int result = 0;
+	pthread_mutex_lock(&stream_mutex);
+	{
+		SAFE_FREE(mTracePath);
+		if (path) {
+			mTracePath = strdup(path);
+			if (UNLIKELY(!mTracePath)) {
+				result = UVC_ERROR_NO_MEM;
+			}
+		}
+	}
+	pthread_mutex_unlock(&stream_mutex);
+
+	RETURN(result, int);
+}
+
+/**
+ * set the color matrix and the quantization range to convert YUV frames into RGB,
+ * this takes effect immediately when streaming
+ * @param matrix UVC_COLOR_MATRIX_XXX
+ * @param range UVC_COLOR_RANGE_XXX
+ */
+int UVCPreview::setColor(int matrix, int range) {
+	ENTER();
+
+	if (UNLIKELY((matrix < 0) || (matrix >= UVC_COLOR_MATRIX_COUNT)
+		|| (range < 0) || (range >= UVC_COLOR_RANGE_COUNT))) {
+		RETURN(UVC_ERROR_INVALID_PARAM, int);
+	}
+	int result = 0;
+	pthread_mutex_lock(&stream_mutex);
+	{
+		requestColorMatrix = (enum uvc_color_matrix)matrix;
+		requestColorRange = (enum uvc_color_range)range;
+		if (mStreamHandle) {
+			result = uvc_stream_set_color(mStreamHandle, requestColorMatrix, requestColorRange);
+		}
+	}
+	pthread_mutex_unlock(&stream_mutex);
+
+	RETURN(result, int);
+}
+
+/**
+ * set the queue depth, the drop strategy and the deadline of a stage,
+ * this takes effect immediately
+ * @param stage QUEUE_STAGE_PREVIEW, QUEUE_STAGE_CAPTURE or QUEUE_STAGE_CALLBACK
+ * @param depth 1..FRAME_QUEUE_CAPACITY
+ * @param drop FRAME_DROP_NEWEST, FRAME_DROP_OLDEST or FRAME_DROP_NONE,
+ * 		FRAME_DROP_NONE is not allowed for QUEUE_STAGE_PREVIEW because it would block the frame callback of libuvc
+ * @param deadline_ms drop frames captured more than this before, 0: no deadline
+ */
+int UVCPreview::setQueuePolicy(int stage, int depth, int drop, int deadline_ms) {
+	ENTER();
+
+	int result;
+	switch (stage) {
+	case QUEUE_STAGE_PREVIEW:
+		if (UNLIKELY(drop == FRAME_DROP_NONE)) {
+			result = UVC_ERROR_INVALID_PARAM;
+			break;
+		}
+		result = previewFrames.setPolicy(depth, drop, deadline_ms);
+		break;
+	case QUEUE_STAGE_CAPTURE:
+		result = captureQueu.setPolicy(depth, drop, deadline_ms);
+		break;
+	case QUEUE_STAGE_CALLBACK:
+		result = callbackQueue.setPolicy(depth, drop, deadline_ms);
+		break;
+	default:
+		result = UVC_ERROR_INVALID_PARAM;
+		break;
+	}
+
+	RETURN(result, int);
+}
+
+/**
+ * set the number of threads to decode MJPEG frames,
+ * this takes effect from the next startPreview
+ * @param num_threads 1: decode on the preview thread, 0: number of cpu cores, max MAX_DECODE_THREADS
+ */
+int UVCPreview::setDecodeThreads(int num_threads) {
+	ENTER();
+
+	if (UNLIKELY(num_threads < 0)) {
+		RETURN(UVC_ERROR_INVALID_PARAM, int);
+	}
+	requestDecodeThreads = num_threads;
+
+	RETURN(0, int);
+}
+
+/**
+ * decode MJPEG frames for the preview in a smaller size when the Surface is smaller than the frames,
+ * the frames for the frame callback and the capture Surface are always decoded in full size.
+ * this takes effect from the next startPreview
+ */
+int UVCPreview::setPreviewScaling(bool enable) {
+	ENTER();
+
+	requestPreviewScaling = enable;
+
+	RETURN(0, int);
+}
+
+/**
+ * choose the largest IDCT scaling whose frames are still as large as the Surface,
+ * call with preview_mutex locked
+ * @return denominator of the scaling, 1, 2, 4 or 8
+ */
+int UVCPreview::choose_preview_scale() {
+	int scale = 1;
+	if (requestPreviewScaling && frameMode && (windowWidth > 0) && (windowHeight > 0)) {
+		for (scale = 8; scale > 1; scale >>= 1) {
+			if ((frameWidth / scale >= windowWidth) && (frameHeight / scale >= windowHeight)) {
+				break;
+			}
+		}
+	}
+	return scale;
+}
+
+/**
+ * set the buffer geometry of the preview Surface if the size of frames changed,
+ * call with preview_mutex locked
+ */
+void UVCPreview::set_window_geometry(int width, int height) {
+	if (LIKELY(mPreviewWindow)
+		&& UNLIKELY((bufferWidth != width) || (bufferHeight != height))) {
+
+		ANativeWindow_setBuffersGeometry(mPreviewWindow, width, height, previewFormat);
+		bufferWidth = width;
+		bufferHeight = height;
+	}
+}
+
+/**
+ * whether libjpeg can convert the frame into RGB itself,
+ * it always uses the BT.601 full range (JFIF) matrix
+ */
+static inline bool is_jfif_color(const uvc_frame_t *frame) {
+	return (frame->color_matrix == UVC_COLOR_MATRIX_BT601)
+		&& (frame->color_range == UVC_COLOR_RANGE_FULL);
+}
+
+/**
+ * create a MJPEG decoder for a decoding thread
+ * RGBX frames are decoded with the merged upsampler, YUYV frames are not affected
+ * @return NULL if failed, uvc_mjpeg2xxx are used instead then
+ */
+static uvc_mjpeg_decoder_t *create_mjpeg_decoder() {
+	uvc_mjpeg_decoder_t *decoder = uvc_mjpeg_decoder_create();
+	if (LIKELY(decoder)) {
+		uvc_mjpeg_decoder_set_fancy_upsampling(decoder, 0);
+	} else {
+		LOGE("failed to create mjpeg decoder");
+	}
+	return decoder;
+}
+
 void UVCPreview::do_preview(uvc_stream_ctrl_t *ctrl) {
 	ENTER();
 
 	uvc_frame_t *frame = NULL;
 	uvc_frame_t *frame_mjpeg = NULL;
-	uvc_error_t result = uvc_start_streaming_bandwidth(
-		mDeviceHandle, ctrl, uvc_preview_frame_callback, (void *)this, requestBandwidth, 0);
+	uvc_stream_handle_t *strmh = NULL;
+	uvc_error_t result = uvc_stream_open_ctrl(mDeviceHandle, &strmh, ctrl);
+	if (LIKELY(!result)) {
+		pthread_mutex_lock(&stream_mutex);
+		{
+			mStreamHandle = strmh;
+			if (UNLIKELY(mTracePath)) {
+				uvc_stream_set_trace(strmh, mTracePath);
+			}
+			uvc_stream_set_color(strmh, requestColorMatrix, requestColorRange);
+		}
+		pthread_mutex_unlock(&stream_mutex);
+		// assemble frames directly into the frames of our frame pool
+		result = uvc_stream_set_zero_copy(strmh, uvc_preview_frame_alloc, uvc_preview_frame_release, (void *)this);
+		if (LIKELY(!result)) {
+			// give a transfer back to the host controller before processing the completed one
+			uvc_stream_set_resubmit_first(strmh, 1);
+			result = uvc_stream_start_bandwidth(strmh,
+				uvc_preview_frame_callback, (void *)this, requestBandwidth, 0);
+		}
+		if (LIKELY(!result)) {
+			int alt_setting;
+			size_t bytes_per_interval;
+			uint32_t bytes_per_sec;
+			uvc_stream_get_bandwidth(strmh, &alt_setting, &bytes_per_interval, &bytes_per_sec);
+			LOGI("altsetting=%d,bytes_per_interval=%d,bandwidth=%u bytes/sec",
+				alt_setting, (int)bytes_per_interval, bytes_per_sec);
+		}
+		if (UNLIKELY(result)) {
+			close_stream();
+		}
+	}
     // jiangdg:fix stopview crash
     // use mHasCapturing flag confirm capture_thread was be created
     mHasCapturing = false;
+	mHasCallback = false;
 	if (LIKELY(!result)) {
 		clearPreviewFrame();
 		if (pthread_create(&capture_thread, NULL, capture_thread_func, (void *)this) == 0) {
 		    mHasCapturing = true;
 		}
+		if (pthread_create(&callback_thread, NULL, callback_thread_func, (void *)this) == 0) {
+			mHasCallback = true;
+		}
 
 #if LOCAL_DEBUG
 		LOGI("Streaming...");
 #endif
 		if (frameMode) {
 			// MJPEG mode
+			start_decode_threads();
+			// デコードスレッドが無い時はプレビュースレッドでデコードする
+			uvc_mjpeg_decoder_t *decoder = !decodeThreads ? create_mjpeg_decoder() : NULL;
 			for ( ; LIKELY(isRunning()) ; ) {
 				frame_mjpeg = waitPreviewFrame();
 				if (LIKELY(frame_mjpeg)) {
-					frame = get_frame(frame_mjpeg->width * frame_mjpeg->height * 2);
-					result = uvc_mjpeg2yuyv(frame_mjpeg, frame);   // MJPEG => yuyv
-					recycle_frame(frame_mjpeg);
-					if (LIKELY(!result)) {
-						frame = draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4);
-						addCaptureFrame(frame);
+					if (decodeThreads) {
+						dispatch_decode(frame_mjpeg);
+					} else if (LIKELY(decoder) && !needCaptureFrame() && is_jfif_color(frame_mjpeg)) {
+						// 誰もYUYVを使わない時はSurfaceのバッファへ直接デコードする
+						decode_to_surface(decoder, frame_mjpeg);
 					} else {
-						recycle_frame(frame);
+						frame = decode_mjpeg(decoder, frame_mjpeg);
+						if (LIKELY(frame)) {
+							draw_decoded(frame);
+						}
 					}
 				}
 			}
+			stop_decode_threads();
+			uvc_mjpeg_decoder_destroy(decoder);
 		} else {
 			// yuvyv mode
 			for ( ; LIKELY(isRunning()) ; ) {
 				frame = waitPreviewFrame();
 				if (LIKELY(frame)) {
-					frame = draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4);
 					addCaptureFrame(frame);
+					draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4);
+					recycle_frame(frame);
 				}
 			}
 		}
-		pthread_cond_signal(&capture_sync);
+		captureQueu.wakeup();
+		callbackQueue.wakeup();
 #if LOCAL_DEBUG
 		LOGI("preview_thread_func:wait for all callbacks complete");
 #endif
-		uvc_stop_streaming(mDeviceHandle);
+		close_stream();
 #if LOCAL_DEBUG
 		LOGI("Streaming finished");
 #endif
@@ -586,6 +1040,223 @@ void UVCPreview::do_preview(uvc_stream_ctrl_t *ctrl) {
 	EXIT();
 }
 
+/**
+ * decode a MJPEG frame into YUYV, or directly into RGBX when nobody needs YUYV frames
+ * and the frame has the JFIF colors.
+ * RGBX frames are only for the preview and are decoded in 1/previewScale size.
+ * the MJPEG frame is recycled
+ * @return decoded frame, NULL if failed
+ */
+uvc_frame_t *UVCPreview::decode_mjpeg(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *frame_mjpeg) {
+	// libjpeg only knows JFIF colors, others are converted from YUYV
+	const bool to_rgbx = !needCaptureFrame() && is_jfif_color(frame_mjpeg);
+	const int scale = to_rgbx && decoder ? previewScale : 1;
+	uvc_frame_t *frame = get_frame(((frame_mjpeg->width + scale - 1) / scale)
+		* ((frame_mjpeg->height + scale - 1) / scale) * (to_rgbx ? PREVIEW_PIXEL_BYTES : 2));
+	if (LIKELY(frame)) {
+		uvc_error_t result;
+		if (LIKELY(decoder)) {
+			uvc_mjpeg_decoder_set_scale(decoder, scale);
+			result = uvc_mjpeg_decode(decoder, frame_mjpeg, frame,
+				to_rgbx ? UVC_FRAME_FORMAT_RGBX : UVC_FRAME_FORMAT_YUYV);
+		} else {
+			result = to_rgbx ? uvc_mjpeg2rgbx_merged(frame_mjpeg, frame)
+				: uvc_mjpeg2yuyv(frame_mjpeg, frame);   // MJPEG => yuyv
+		}
+		if (UNLIKELY(result)) {
+			recycle_frame(frame);
+			frame = NULL;
+		} else {
+			memcpy(frame->stage_ns, frame_mjpeg->stage_ns, sizeof(frame->stage_ns));
+			frame->stage_ns[FRAME_STAGE_DECODED] = stage_time_ns();
+		}
+	}
+	recycle_frame(frame_mjpeg);
+	return frame;
+}
+
+/**
+ * decode a MJPEG frame in 1/previewScale size directly into the preview Surface.
+ * the MJPEG frame is recycled
+ */
+void UVCPreview::decode_to_surface(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *frame_mjpeg) {
+	const int scale = previewScale;
+	uvc_mjpeg_decoder_set_scale(decoder, scale);
+	pthread_mutex_lock(&preview_mutex);
+	{
+		if (LIKELY(mPreviewWindow)
+			&& UNLIKELY(convert_to_surface(frame_mjpeg,
+				(frame_mjpeg->width + scale - 1) / scale, (frame_mjpeg->height + scale - 1) / scale,
+				decoder, NULL))) {
+
+			LOGE("failed decoding");
+		}
+	}
+	pthread_mutex_unlock(&preview_mutex);
+	recycle_frame(frame_mjpeg);
+}
+
+/**
+ * display the decoded frame, YUYV frame is shared with the capture and callback threads
+ * before displaying so that they work on it at the same time.
+ * the frame is recycled
+ */
+void UVCPreview::draw_decoded(uvc_frame_t *frame) {
+	if (frame->frame_format == UVC_FRAME_FORMAT_RGBX) {
+		// 誰もYUYVを使わないのでそのまま表示する
+		draw_preview_one(frame, &mPreviewWindow, NULL, PREVIEW_PIXEL_BYTES);
+	} else {
+		addCaptureFrame(frame);
+		draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4);
+	}
+	recycle_frame(frame);
+}
+
+/**
+ * start the threads to decode MJPEG frames in parallel if more than one is requested,
+ * decodeThreads is left 0 otherwise
+ */
+void UVCPreview::start_decode_threads() {
+	ENTER();
+
+	int num_threads = requestDecodeThreads;
+	if (!num_threads) {
+		num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (num_threads > MAX_DECODE_THREADS) {
+		num_threads = MAX_DECODE_THREADS;
+	}
+	decodeThreads = 0;
+	if (num_threads > 1) {
+		pthread_mutex_lock(&decode_mutex);
+		{
+			mIsDecoding = true;
+			decodeInFlight = 0;
+			// the queue is empty here, so this is the ticket of the first frame dispatched
+			decodeNext = decodeFrames.nextTicket();
+		}
+		pthread_mutex_unlock(&decode_mutex);
+		decodeFrames.open();
+		for (int i = 0; i < num_threads; i++) {
+			if (pthread_create(&decode_threads[decodeThreads], NULL, decode_thread_func, (void *)this) == 0) {
+				decodeThreads++;
+			} else {
+				LOGW("UVCPreview::could not create decode thread");
+			}
+		}
+		LOGI("decode threads=%d", decodeThreads);
+	}
+
+	EXIT();
+}
+
+/**
+ * stop the decoding threads after they have displayed the frames already dispatched
+ */
+void UVCPreview::stop_decode_threads() {
+	ENTER();
+
+	if (decodeThreads) {
+		pthread_mutex_lock(&decode_mutex);
+		{
+			mIsDecoding = false;
+			pthread_cond_broadcast(&decode_sync);
+		}
+		pthread_mutex_unlock(&decode_mutex);
+		// the decoding threads take the frames left and exit
+		decodeFrames.close();
+		for (int i = 0; i < decodeThreads; i++) {
+			if (pthread_join(decode_threads[i], NULL) != EXIT_SUCCESS) {
+				LOGW("UVCPreview::terminate decode thread: pthread_join failed");
+			}
+		}
+		decodeThreads = 0;
+	}
+
+	EXIT();
+}
+
+/**
+ * pass a MJPEG frame to the decoding threads,
+ * blocks while every decoding thread has a frame not displayed yet
+ */
+void UVCPreview::dispatch_decode(uvc_frame_t *frame_mjpeg) {
+	pthread_mutex_lock(&decode_mutex);
+	{
+		// 遅延をデコードスレッド当たり1フレームまでに抑える
+		for ( ; decodeInFlight >= decodeThreads ; ) {
+			pthread_cond_wait(&decode_sync, &decode_mutex);
+		}
+		decodeInFlight++;
+	}
+	pthread_mutex_unlock(&decode_mutex);
+	// decodeFrames wakes a decoding thread, it never drops because of decodeInFlight
+	if (UNLIKELY(!decodeFrames.put(frame_mjpeg))) {
+		pthread_mutex_lock(&decode_mutex);
+		{
+			decodeInFlight--;
+			pthread_cond_broadcast(&decode_sync);
+		}
+		pthread_mutex_unlock(&decode_mutex);
+	}
+}
+
+void *UVCPreview::decode_thread_func(void *vptr_args) {
+	ENTER();
+	UVCPreview *preview = reinterpret_cast<UVCPreview *>(vptr_args);
+	if (LIKELY(preview)) {
+		preview->do_decode();
+	}
+	PRE_EXIT();
+	pthread_exit(NULL);
+}
+
+/**
+ * the actual function for decoding thread.
+ * frames are taken with a ticket in the order of dispatch(= order of sequence)
+ * and displayed in the order of the tickets
+ */
+void UVCPreview::do_decode() {
+	ENTER();
+
+	uvc_mjpeg_decoder_t *decoder = create_mjpeg_decoder();
+	for ( ; ; ) {
+		uint32_t ticket = 0;
+		// 停止後も受け取り済みのフレームは処理する
+		uvc_frame_t *frame_mjpeg = decodeFrames.wait(CAPTURE_WAIT_MS, &ticket);
+		if (!frame_mjpeg) {
+			if (__atomic_load_n(&mIsDecoding, __ATOMIC_ACQUIRE)) {
+				continue;
+			}
+			break;
+		}
+
+		uvc_frame_t *frame = decode_mjpeg(decoder, frame_mjpeg);
+
+		pthread_mutex_lock(&decode_mutex);
+		{
+			// 前のフレームの表示を待つ
+			for ( ; ticket != decodeNext ; ) {
+				pthread_cond_wait(&decode_sync, &decode_mutex);
+			}
+		}
+		pthread_mutex_unlock(&decode_mutex);
+		if (LIKELY(frame)) {
+			draw_decoded(frame);
+		}
+		pthread_mutex_lock(&decode_mutex);
+		{
+			decodeNext++;
+			decodeInFlight--;
+			pthread_cond_broadcast(&decode_sync);
+		}
+		pthread_mutex_unlock(&decode_mutex);
+	}
+	uvc_mjpeg_decoder_destroy(decoder);
+
+	EXIT();
+}
+
 static void copyFrame(const uint8_t *src, uint8_t *dest, const int width, int height, const int stride_src, const int stride_dest) {
 	const int h8 = height % 8;
 	for (int i = 0; i < h8; i++) {
@@ -613,6 +1284,24 @@ static void copyFrame(const uint8_t *src, uint8_t *dest, const int width, int he
 }
 
 
+// transfer specific frame data to the locked buffer of the Surface
+static void copyToBuffer(uvc_frame_t *frame, ANativeWindow_Buffer *buffer) {
+	// source = frame data
+	const uint8_t *src = (uint8_t *)frame->data;
+	const int src_w = frame->width * PREVIEW_PIXEL_BYTES;
+	const int src_step = frame->width * PREVIEW_PIXEL_BYTES;
+	// destination = Surface(ANativeWindow)
+	uint8_t *dest = (uint8_t *)buffer->bits;
+	const int dest_w = buffer->width * PREVIEW_PIXEL_BYTES;
+	const int dest_step = buffer->stride * PREVIEW_PIXEL_BYTES;
+	// use lower transfer bytes
+	const int w = src_w < dest_w ? src_w : dest_w;
+	// use lower height
+	const int h = frame->height < buffer->height ? frame->height : buffer->height;
+	// transfer from frame data to the Surface
+	copyFrame(src, dest, w, h, src_step, dest_step);
+}
+
 // transfer specific frame data to the Surface(ANativeWindow)
 int copyToSurface(uvc_frame_t *frame, ANativeWindow **window) {
 	// ENTER();
@@ -620,20 +1309,7 @@ int copyToSurface(uvc_frame_t *frame, ANativeWindow **window) {
 	if (LIKELY(*window)) {
 		ANativeWindow_Buffer buffer;
 		if (LIKELY(ANativeWindow_lock(*window, &buffer, NULL) == 0)) {
-			// source = frame data
-			const uint8_t *src = (uint8_t *)frame->data;
-			const int src_w = frame->width * PREVIEW_PIXEL_BYTES;
-			const int src_step = frame->width * PREVIEW_PIXEL_BYTES;
-			// destination = Surface(ANativeWindow)
-			uint8_t *dest = (uint8_t *)buffer.bits;
-			const int dest_w = buffer.width * PREVIEW_PIXEL_BYTES;
-			const int dest_step = buffer.stride * PREVIEW_PIXEL_BYTES;
-			// use lower transfer bytes
-			const int w = src_w < dest_w ? src_w : dest_w;
-			// use lower height
-			const int h = frame->height < buffer.height ? frame->height : buffer.height;
-			// transfer from frame data to the Surface
-			copyFrame(src, dest, w, h, src_step, dest_step);
+			copyToBuffer(frame, &buffer);
 			ANativeWindow_unlockAndPost(*window);
 		} else {
 			result = -1;
@@ -644,37 +1320,69 @@ int copyToSurface(uvc_frame_t *frame, ANativeWindow **window) {
 	return result; //RETURN(result, int);
 }
 
+/**
+ * convert a frame straight into the locked buffer of the preview Surface without an intermediate frame,
+ * MJPEG frames are decoded into RGBX with the decoder when it is not NULL.
+ * call with preview_mutex locked
+ * @param width width of the converted frame
+ * @param height height of the converted frame
+ * @return 0 if succeeded
+ */
+int UVCPreview::convert_to_surface(uvc_frame_t *frame, int width, int height,
+	uvc_mjpeg_decoder_t *decoder, convFunc_t convert_func) {
+
+	int result = -1;
+	if (LIKELY(mPreviewWindow)) {
+		set_window_geometry(width, height);
+		ANativeWindow_Buffer buffer;
+		if (LIKELY(ANativeWindow_lock(mPreviewWindow, &buffer, NULL) == 0)) {
+			uvc_frame_t surface, *out;
+			if (LIKELY((buffer.width == width) && (buffer.height == height))) {
+				// Surfaceのバッファをライブラリが所有しないフレームとして変換先にする
+				memset(&surface, 0, sizeof(surface));
+				surface.data = buffer.bits;
+				surface.step = buffer.stride * PREVIEW_PIXEL_BYTES;
+				surface.data_bytes = surface.step * buffer.height;
+				out = &surface;
+			} else {
+				// バッファのサイズが違う時は一旦変換してからコピーする
+				out = get_frame(width * height * PREVIEW_PIXEL_BYTES);
+			}
+			if (LIKELY(out)) {
+				result = decoder ? uvc_mjpeg_decode(decoder, frame, out, UVC_FRAME_FORMAT_RGBX)
+					: convert_func(frame, out);
+				if (out != &surface) {
+					if (LIKELY(!result)) {
+						copyToBuffer(out, &buffer);
+					}
+					recycle_frame(out);
+				}
+			}
+			ANativeWindow_unlockAndPost(mPreviewWindow);
+		}
+	}
+	return result;
+}
+
 // changed to return original frame instead of returning converted frame even if convert_func is not null.
 uvc_frame_t *UVCPreview::draw_preview_one(uvc_frame_t *frame, ANativeWindow **window, convFunc_t convert_func, int pixcelBytes) {
 	// ENTER();
 
-	int b = 0;
 	pthread_mutex_lock(&preview_mutex);
 	{
-		b = *window != NULL;
-	}
-	pthread_mutex_unlock(&preview_mutex);
-	if (LIKELY(b)) {
-		uvc_frame_t *converted;
-		if (convert_func) {
-			converted = get_frame(frame->width * frame->height * pixcelBytes);
-			if LIKELY(converted) {
-				b = convert_func(frame, converted);
-				if (!b) {
-					pthread_mutex_lock(&preview_mutex);
-					copyToSurface(converted, window);
-					pthread_mutex_unlock(&preview_mutex);
-				} else {
+		if (LIKELY(*window)) {
+			if (convert_func) {
+				if (UNLIKELY(convert_to_surface(frame, frame->width, frame->height, NULL, convert_func))) {
 					LOGE("failed converting");
 				}
-				recycle_frame(converted);
+			} else {
+				// 縮小デコードしたフレームとフルサイズのフレームが切り替わる時
+				set_window_geometry(frame->width, frame->height);
+				copyToSurface(frame, window);
 			}
-		} else {
-			pthread_mutex_lock(&preview_mutex);
-			copyToSurface(frame, window);
-			pthread_mutex_unlock(&preview_mutex);
 		}
 	}
+	pthread_mutex_unlock(&preview_mutex);
 	return frame; //RETURN(frame, uvc_frame_t *);
 }
 
@@ -683,6 +1391,19 @@ uvc_frame_t *UVCPreview::draw_preview_one(uvc_frame_t *frame, ANativeWindow **wi
 //======================================================================
 inline const bool UVCPreview::isCapturing() const { return mIsCapturing; }
 
+/**
+ * whether the capture thread consumes YUYV frames (frame callback or capture surface)
+ */
+bool UVCPreview::needCaptureFrame() {
+	bool result;
+	pthread_mutex_lock(&capture_mutex);
+	{
+		result = mFrameCallbackObj || mFrameBufferCallbackObj || mCaptureWindow;
+	}
+	pthread_mutex_unlock(&capture_mutex);
+	return result;
+}
+
 int UVCPreview::setCaptureDisplay(ANativeWindow *capture_window) {
 	ENTER();
 	pthread_mutex_lock(&capture_mutex);
@@ -690,7 +1411,7 @@ int UVCPreview::setCaptureDisplay(ANativeWindow *capture_window) {
 		if (isRunning() && isCapturing()) {
 			mIsCapturing = false;
 			if (mCaptureWindow) {
-				pthread_cond_signal(&capture_sync);
+				captureQueu.wakeup();
 				pthread_cond_wait(&capture_sync, &capture_mutex);	// wait finishing capturing
 			}
 		}
@@ -719,56 +1440,41 @@ int UVCPreview::setCaptureDisplay(ANativeWindow *capture_window) {
 	RETURN(0, int);
 }
 
+/**
+ * share the YUYV frame with the capture thread and the callback thread without copying,
+ * each of them gets its own reference to the frame and recycles it when done.
+ * the caller keeps its reference and has to recycle the frame too
+ */
 void UVCPreview::addCaptureFrame(uvc_frame_t *frame) {
-	pthread_mutex_lock(&capture_mutex);
 	if (LIKELY(isRunning())) {
-		// keep only latest one
-		if (captureQueu) {
-			recycle_frame(captureQueu);
+		// the frame is not shared yet
+		frame->stage_ns[FRAME_STAGE_QUEUED] = stage_time_ns();
+		bool to_capture, to_callback;
+		pthread_mutex_lock(&capture_mutex);
+		{
+			to_capture = mCaptureWindow != NULL;
+			to_callback = mFrameCallbackObj || mFrameBufferCallbackObj;
+		}
+		pthread_mutex_unlock(&capture_mutex);
+		if (to_capture) {
+			captureQueu.put(FramePool::shared().retainFrame(frame));
+		}
+		if (to_callback) {
+			callbackQueue.put(FramePool::shared().retainFrame(frame));
 		}
-		captureQueu = frame;
-		pthread_cond_broadcast(&capture_sync);
-	} else {
-		// Add this can solve native leak
-		recycle_frame(frame);
 	}
-	pthread_mutex_unlock(&capture_mutex);
 }
 
 /**
  * get frame data for capturing, if not exist, block and wait
  */
 uvc_frame_t *UVCPreview::waitCaptureFrame() {
-	uvc_frame_t *frame = NULL;
-	pthread_mutex_lock(&capture_mutex);
-	{
-		if (!captureQueu) {
-			 //  这里有阻塞的情况，替换成 pthread_cond_timedwait 方法，设置相对的超时时间为 1s
-             //pthread_cond_wait(&capture_sync, &capture_mutex);
-            /*struct timespec tv;
-            clock_gettime(CLOCK_MONOTONIC, &tv);
-            tv.tv_sec += 1;
-            pthread_cond_timedwait(&capture_sync, &capture_mutex,&tv);*/
-                ts.tv_sec = 0;
-                ts.tv_nsec = 0;
-
-            #if _POSIX_TIMERS > 0
-                      clock_gettime(CLOCK_REALTIME, &ts);
-            #else
-                      gettimeofday(&tv, NULL);
-                      ts.tv_sec = tv.tv_sec;
-                      ts.tv_nsec = tv.tv_usec * 1000;
-            #endif
-                      ts.tv_sec += 1;
-                      ts.tv_nsec += 0;
-            pthread_cond_timedwait(&capture_sync, &capture_mutex,&ts);
-		}
-		if (LIKELY(isRunning() && captureQueu)) {
-			frame = captureQueu;
-			captureQueu = NULL;
-		}
+	// wake up every second to check the capture state even if no frame comes
+	uvc_frame_t *frame = captureQueu.wait(CAPTURE_WAIT_MS);
+	if (UNLIKELY(frame && !isRunning())) {
+		recycle_frame(frame);
+		frame = NULL;
 	}
-	pthread_mutex_unlock(&capture_mutex);
 	return frame;
 }
 
@@ -776,13 +1482,14 @@ uvc_frame_t *UVCPreview::waitCaptureFrame() {
  * clear drame data for capturing
  */
 void UVCPreview::clearCaptureFrame() {
-	pthread_mutex_lock(&capture_mutex);
-	{
-		if (captureQueu)
-			recycle_frame(captureQueu);
-		captureQueu = NULL;
-	}
-	pthread_mutex_unlock(&capture_mutex);
+	captureQueu.clear();
+}
+
+/**
+ * clear frame data for callback
+ */
+void UVCPreview::clearCallbackFrame() {
+	callbackQueue.clear();
 }
 
 //======================================================================
@@ -818,7 +1525,6 @@ void UVCPreview::do_capture(JNIEnv *env) {
 	ENTER();
 
 	clearCaptureFrame();
-	callbackPixelFormatChanged();
 	for (; isRunning() ;) {
 		mIsCapturing = true;
 		if (mCaptureWindow) {
@@ -826,7 +1532,11 @@ void UVCPreview::do_capture(JNIEnv *env) {
 		} else {
 			do_capture_idle_loop(env);
 		}
+		// the capture thread no longer waits with capture_mutex,
+		// take it so that the waiter in setFrameCallback/setCaptureDisplay is already waiting
+		pthread_mutex_lock(&capture_mutex);
 		pthread_cond_broadcast(&capture_sync);
+		pthread_mutex_unlock(&capture_mutex);
 	}	// end of for (; isRunning() ;)
 	EXIT();
 }
@@ -834,8 +1544,9 @@ void UVCPreview::do_capture(JNIEnv *env) {
 void UVCPreview::do_capture_idle_loop(JNIEnv *env) {
 	ENTER();
 	
+	// frames are passed only while the capture Surface exists, this only waits for it
 	for (; isRunning() && isCapturing() ;) {
-		do_capture_callback(env, waitCaptureFrame());
+		recycle_frame(waitCaptureFrame());
 	}
 	
 	EXIT();
@@ -868,22 +1579,80 @@ void UVCPreview::do_capture_surface(JNIEnv *env) {
 					}
 				}
 			}
-			do_capture_callback(env, frame);
+			recycle_frame(frame);
 		}
 	}
 	if (converted) {
 		recycle_frame(converted);
 	}
+	pthread_mutex_lock(&capture_mutex);
 	if (mCaptureWindow) {
 		ANativeWindow_release(mCaptureWindow);
 		mCaptureWindow = NULL;
 	}
+	pthread_mutex_unlock(&capture_mutex);
+
+	EXIT();
+}
+
+/*
+ * thread function
+ * @param vptr_args pointer to UVCPreview instance
+ */
+// static
+void *UVCPreview::callback_thread_func(void *vptr_args) {
+	ENTER();
+	UVCPreview *preview = reinterpret_cast<UVCPreview *>(vptr_args);
+	if (LIKELY(preview)) {
+		JavaVM *vm = getVM();
+		JNIEnv *env;
+		// attach to JavaVM
+		vm->AttachCurrentThread(&env, NULL);
+		preview->do_callback(env);	// never return until finish previewing
+		// detach from JavaVM
+		vm->DetachCurrentThread();
+		MARK("DetachCurrentThread");
+	}
+	PRE_EXIT();
+	pthread_exit(NULL);
+}
+
+/**
+ * the actual function for frame callback,
+ * a slow IFrameCallback drops frames here without delaying the preview and the capture Surface
+ */
+void UVCPreview::do_callback(JNIEnv *env) {
+	ENTER();
+
+	clearCallbackFrame();
+	mHasLastCallbackSequence = false;
+	pthread_mutex_lock(&callback_mutex);
+	{
+		callbackPixelFormatChanged();
+	}
+	pthread_mutex_unlock(&callback_mutex);
+	for (; isRunning() ;) {
+		// wake up every second to check the state even if no frame comes
+		uvc_frame_t *frame = callbackQueue.wait(CAPTURE_WAIT_MS);
+		if (LIKELY(frame)) {
+			pthread_mutex_lock(&callback_mutex);
+			{
+				if (mFrameBufferCallbackObj) {
+					do_frame_buffer_callback(env, frame);
+				} else {
+					do_capture_callback(env, frame);
+				}
+			}
+			pthread_mutex_unlock(&callback_mutex);
+		}
+	}
+	clearCallbackFrame();
 
 	EXIT();
 }
 
 /**
-* call IFrameCallback#onFrame if needs
+* call IFrameCallback#onFrame if needs, the frame is recycled
  */
 void UVCPreview::do_capture_callback(JNIEnv *env, uvc_frame_t *frame) {
 	ENTER();
@@ -891,6 +1660,10 @@ void UVCPreview::do_capture_callback(JNIEnv *env, uvc_frame_t *frame) {
 	if (LIKELY(frame)) {
 		uvc_frame_t *callback_frame = frame;
 		if (mFrameCallbackObj) {
+			if (mFrameCallbackWithMeta) {
+				// before converting, the converters do not copy the metadata
+				fill_frame_meta(frame);
+			}
 			if (mFrameCallbackFunc) {
 				callback_frame = get_frame(callbackPixelBytes);
 				if (LIKELY(callback_frame)) {
@@ -905,10 +1678,30 @@ void UVCPreview::do_capture_callback(JNIEnv *env, uvc_frame_t *frame) {
 					callback_frame = frame;
 					goto SKIP;
 				}
+			} else if (UNLIKELY(frame->actual_bytes < callbackPixelBytes)) {
+				// PIXEL_FORMAT_RAW: do not pass the stale pixels after the end of a truncated frame
+				goto SKIP;
+			} else if (__atomic_load_n(&frame->ref_count, __ATOMIC_ACQUIRE) > 1) {
+				// PIXEL_FORMAT_RAW: the preview/capture thread still reads the shared frame,
+				// pass a copy so that Java can not modify the pixels under them
+				callback_frame = get_frame(callbackPixelBytes);
+				if (LIKELY(callback_frame)) {
+					memcpy(callback_frame->data, frame->data, callbackPixelBytes);
+					recycle_frame(frame);
+				} else {
+					LOGW("failed to allocate for callback frame");
+					callback_frame = frame;
+					goto SKIP;
+				}
 			}
 			jobject buf = env->NewDirectByteBuffer(callback_frame->data, callbackPixelBytes);
 			if (iframecallback_fields.onFrame) {
-				env->CallVoidMethod(mFrameCallbackObj, iframecallback_fields.onFrame, buf);
+				if (mFrameCallbackWithMeta) {
+					mFrameMeta.stage_ns[FRAME_STAGE_DELIVERED] = stage_time_ns();
+					env->CallVoidMethod(mFrameCallbackObj, iframecallback_fields.onFrame, buf, mFrameMetaBuf);
+				} else {
+					env->CallVoidMethod(mFrameCallbackObj, iframecallback_fields.onFrame, buf);
+				}
 			}
 			env->ExceptionClear();
 			env->DeleteLocalRef(buf);
@@ -918,3 +1711,80 @@ void UVCPreview::do_capture_callback(JNIEnv *env, uvc_frame_t *frame) {
 	}
 	EXIT();
 }
+
+/**
+ * update mFrameMeta for the frame passed to IFrameMetaCallback, called only from the callback thread
+ */
+void UVCPreview::fill_frame_meta(const uvc_frame_t *frame) {
+	frame_meta_t *meta = &mFrameMeta;
+	meta->width = frame->width;
+	meta->height = frame->height;
+	meta->pixel_format = mPixelFormat;
+	meta->bytes = callbackPixelBytes;
+	meta->sequence = frame->sequence;
+	// frames lost anywhere before this, including the frames libuvc could not receive
+	const uint32_t gap = frame->sequence - mLastCallbackSequence;
+	meta->skipped = mHasLastCallbackSequence && (gap > 1) && (gap < 0x80000000U) ? gap - 1 : 0;
+	mLastCallbackSequence = frame->sequence;
+	mHasLastCallbackSequence = true;
+	meta->capture_ns = (int64_t)frame->capture_time.tv_sec * 1000000000LL
+		+ (int64_t)frame->capture_time.tv_usec * 1000LL;
+	memcpy(meta->stage_ns, frame->stage_ns, sizeof(meta->stage_ns));
+	meta->preview_dropped = previewFrames.dropped();
+	meta->callback_dropped = callbackQueue.dropped();
+}
+
+/**
+ * fill a ByteBuffer registered by Java with the frame and pass its index to IFrameBufferCallback,
+ * the frame is dropped when Java holds all buffers. the frame is recycled
+ */
+void UVCPreview::do_frame_buffer_callback(JNIEnv *env, uvc_frame_t *frame) {
+	ENTER();
+
+	callback_buffer_t *buf = NULL;
+	for (buf = mFreeCallbackBuffers.take(); buf; buf = mFreeCallbackBuffers.take()) {
+		uint32_t busy = 0;
+		if (LIKELY(__atomic_compare_exchange_n(&buf->busy, &busy, 1,
+			false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))) {
+			break;
+		}
+	}
+	if (UNLIKELY(!buf)) {
+		__atomic_fetch_add(&mCallbackBufferDrops, 1, __ATOMIC_RELAXED);
+		recycle_frame(frame);
+		EXIT();
+	}
+	const int width = frame->width;
+	const int height = frame->height;
+	const uint32_t sequence = frame->sequence;
+	const int64_t timestamp_ns = (int64_t)frame->capture_time.tv_sec * 1000000000LL
+		+ (int64_t)frame->capture_time.tv_usec * 1000LL;
+	int result = UVC_ERROR_NO_MEM;
+	if (mFrameCallbackFunc) {
+		// 登録されたバッファへ直接変換する
+		uvc_frame_t out;
+		memset(&out, 0, sizeof(out));
+		out.data = buf->data;
+		out.data_bytes = buf->capacity;
+		out.step = width * (mPixelFormat == PIXEL_FORMAT_RGBX ? 4 : 2);	// YUV420SP sets the step itself
+		result = mFrameCallbackFunc(frame, &out);
+	} else if (UNLIKELY(frame->actual_bytes < callbackPixelBytes)) {
+		// do not pass the stale pixels after the end of a truncated frame
+		result = UVC_ERROR_OTHER;
+	} else if (LIKELY(buf->capacity >= callbackPixelBytes)) {
+		memcpy(buf->data, frame->data, callbackPixelBytes);
+		result = 0;
+	}
+	recycle_frame(frame);
+	if (LIKELY(!result)) {
+		env->CallVoidMethod(mFrameBufferCallbackObj, iframebuffercallback_fields.onFrameBuffer,
+			buf->index, (jint)callbackPixelBytes, width, height, (jlong)sequence, (jlong)timestamp_ns);
+		env->ExceptionClear();
+	} else {
+		LOGW("failed to fill callback buffer:%d", result);
+		__atomic_store_n(&buf->busy, 0, __ATOMIC_RELEASE);
+		mFreeCallbackBuffers.put(buf);
+	}
+
+	EXIT();
+}
@@ -29,6 +29,8 @@
 #include <pthread.h>
 #include <android/native_window.h>
 #include "objectarray.h"
+#include "FrameQueue.h"
+#include "FramePool.h"
 
 #pragma interface
 
@@ -38,9 +40,18 @@
 #define DEFAULT_PREVIEW_FPS_MAX 30
 #define DEFAULT_PREVIEW_MODE 0
 #define DEFAULT_BANDWIDTH 1.0f
+#define DEFAULT_DECODE_THREADS 1
+#define MAX_DECODE_THREADS 4
+#define MAX_FRAME 4		// default depth of the preview queue
+#define FRAME_POOL_SZ (MAX_FRAME + 2 + 2 * MAX_DECODE_THREADS)	// each decoding thread holds a MJPEG and a decoded frame
 
 typedef uvc_error_t (*convFunc_t)(uvc_frame_t *in, uvc_frame_t *out);
 
+// stages of the preview to set the queue policy
+#define QUEUE_STAGE_PREVIEW 0	// frame callback => preview thread
+#define QUEUE_STAGE_CAPTURE 1	// preview/decoding thread => capture Surface
+#define QUEUE_STAGE_CALLBACK 2	// preview/decoding thread => IFrameCallback
+
 #define PIXEL_FORMAT_RAW 0		// same as PIXEL_FORMAT_YUV
 #define PIXEL_FORMAT_YUV 1
 #define PIXEL_FORMAT_RGB565 2
@@ -48,14 +59,55 @@ typedef uvc_error_t (*convFunc_t)(uvc_frame_t *in, uvc_frame_t *out);
 #define PIXEL_FORMAT_YUV20SP 4
 #define PIXEL_FORMAT_NV21 5		// YVU420SemiPlanar
 
+// stages of the preview recorded in uvc_frame::stage_ns after the stages of libuvc
+#define FRAME_STAGE_DEQUEUED UVC_FRAME_STAGE_APP		// taken by the preview thread
+#define FRAME_STAGE_DECODED (UVC_FRAME_STAGE_APP + 1)	// MJPEG frame decoded
+#define FRAME_STAGE_QUEUED (UVC_FRAME_STAGE_APP + 2)	// passed to the callback thread
+#define FRAME_STAGE_DELIVERED (UVC_FRAME_STAGE_APP + 3)	// just before calling IFrameMetaCallback
+
+#define MAX_CALLBACK_BUFFERS 16	// direct ByteBuffers Java can register for IFrameBufferCallback
+
 // for callback to Java object
 typedef struct {
 	jmethodID onFrame;
 } Fields_iframecallback;
 
+typedef struct {
+	jmethodID onFrameBuffer;
+} Fields_iframebuffercallback;
+
+// metadata passed with IFrameMetaCallback#onFrame, UVCCamera.FrameMeta in Java reads this layout
+typedef struct frame_meta {
+	int32_t width;
+	int32_t height;
+	int32_t pixel_format;		// PIXEL_FORMAT_* of the pixels passed
+	int32_t bytes;				// bytes of the pixels passed
+	uint32_t sequence;			// frame number of the stream
+	uint32_t skipped;			// frames missing since the previous callback frame
+	int64_t capture_ns;			// capture time by the camera in CLOCK_MONOTONIC
+	int64_t stage_ns[UVC_FRAME_STAGE_COUNT];	// uvc_frame_stage and FRAME_STAGE_*
+	uint64_t preview_dropped;	// frames dropped by QUEUE_STAGE_PREVIEW since the camera opened
+	uint64_t callback_dropped;	// frames dropped by QUEUE_STAGE_CALLBACK since the camera opened
+} frame_meta_t;
+
+// direct ByteBuffer registered by Java
+typedef struct callback_buffer {
+	int index;
+	jobject buffer;		// global reference to keep the ByteBuffer alive
+	uint8_t *data;
+	size_t capacity;
+	uint32_t busy;		// 1 while Java holds the buffer
+} callback_buffer_t;
+
 class UVCPreview {
 private:
 	uvc_device_handle_t *mDeviceHandle;
+	uvc_stream_handle_t *mStreamHandle;
+	pthread_mutex_t stream_mutex;		// guards mStreamHandle and mLastStats for getStreamStats
+	uvc_stream_stats_t mLastStats;		// statistics of the last stream
+	char *mTracePath;					// payload trace file of next stream, guarded by stream_mutex
+	enum uvc_color_matrix requestColorMatrix;	// color matrix and range of the YUV frames, guarded by stream_mutex
+	enum uvc_color_range requestColorRange;
 	ANativeWindow *mPreviewWindow;
 	volatile bool mIsRunning;
 	int requestWidth, requestHeight, requestMode;
@@ -65,11 +117,25 @@ private:
 	int frameMode;
 	size_t frameBytes;
 	pthread_t preview_thread;
-	pthread_mutex_t preview_mutex;
-	pthread_cond_t preview_sync;
-	ObjectArray<uvc_frame_t *> previewFrames;
+	pthread_mutex_t preview_mutex;		// guards mPreviewWindow and its buffer geometry
+	FrameQueue previewFrames;			// frame callback => preview thread
 	int previewFormat;
 	size_t previewBytes;
+// scaled MJPEG decoding for the preview
+	bool requestPreviewScaling;			// decode at 1/2, 1/4 or 1/8 when the Surface is smaller than the frames
+	int windowWidth, windowHeight;		// size of the Surface itself, taken with its buffer geometry reverted
+	int bufferWidth, bufferHeight;		// buffer geometry of mPreviewWindow, guarded by preview_mutex
+	int previewScale;					// 1/previewScale scaling of the current stream
+// MJPEG decoding threads
+	int requestDecodeThreads;			// number of decoding threads of next stream
+	int decodeThreads;					// number of running decoding threads, 0: decode on the preview thread
+	pthread_t decode_threads[MAX_DECODE_THREADS];
+	pthread_mutex_t decode_mutex;
+	pthread_cond_t decode_sync;
+	FrameQueue decodeFrames;			// MJPEG frames waiting for a decoding thread, taken with their tickets
+	volatile bool mIsDecoding;
+	int decodeInFlight;					// frames dispatched and not displayed yet, at most decodeThreads
+	uint32_t decodeNext;				// ticket of the frame to display next
 //
 	volatile bool mIsCapturing;
 	volatile bool mHasCapturing;
@@ -79,21 +145,41 @@ private:
 	pthread_cond_t capture_sync;
 	// 声明时间的 attr
     //pthread_condattr_t capture_clock_attr;
-	uvc_frame_t *captureQueu;			// keep latest frame
+	FrameQueue captureQueu;				// preview/decoding thread => capture thread
+// frame callback to Java, runs in parallel with the preview and the capture Surface
+	volatile bool mHasCallback;
+	pthread_t callback_thread;
+	pthread_mutex_t callback_mutex;		// held while calling IFrameCallback, guards mFrameCallbackObj and the pixel format
+	FrameQueue callbackQueue;			// preview/decoding thread => callback thread
 	jobject mFrameCallbackObj;
 	convFunc_t mFrameCallbackFunc;
 	Fields_iframecallback iframecallback_fields;
 	int mPixelFormat;
 	size_t callbackPixelBytes;
+// metadata for IFrameMetaCallback, a direct ByteBuffer on mFrameMeta is reused for every frame
+	bool mFrameCallbackWithMeta;
+	frame_meta_t mFrameMeta;
+	jobject mFrameMetaBuf;
+	uint32_t mLastCallbackSequence;
+	bool mHasLastCallbackSequence;
+// frames delivered into the ByteBuffers registered by Java instead of IFrameCallback
+	jobject mFrameBufferCallbackObj;
+	Fields_iframebuffercallback iframebuffercallback_fields;
+	pthread_mutex_t buffer_mutex;		// serializes registering the buffers against releaseFrameBuffer
+	callback_buffer_t mCallbackBuffers[MAX_CALLBACK_BUFFERS];
+	int mCallbackBufferNum;				// accessed with __atomic
+	FreeList<callback_buffer_t *, MAX_CALLBACK_BUFFERS> mFreeCallbackBuffers;	// buffers returned by Java
+	uint64_t mCallbackBufferDrops;		// frames dropped because Java held all buffers
 // improve performance by reducing memory allocation
-	pthread_mutex_t pool_mutex;
-	ObjectArray<uvc_frame_t *> mFramePool;
 	uvc_frame_t *get_frame(size_t data_bytes);
 	void recycle_frame(uvc_frame_t *frame);
 	void init_pool(size_t data_bytes);
 	void clear_pool();
 //
 	void clearDisplay();
+	void close_stream();
+	static uvc_frame_t *uvc_preview_frame_alloc(size_t data_bytes, void *vptr_args);
+	static void uvc_preview_frame_release(uvc_frame_t *frame, void *vptr_args);
 	static void uvc_preview_frame_callback(uvc_frame_t *frame, void *vptr_args);
 	void addPreviewFrame(uvc_frame_t *frame);
 	uvc_frame_t *waitPreviewFrame();
@@ -101,7 +187,20 @@ private:
 	static void *preview_thread_func(void *vptr_args);
 	int prepare_preview(uvc_stream_ctrl_t *ctrl);
 	void do_preview(uvc_stream_ctrl_t *ctrl);
+	void set_window_geometry(int width, int height);
+	int choose_preview_scale();
+	int convert_to_surface(uvc_frame_t *frame, int width, int height,
+		uvc_mjpeg_decoder_t *decoder, convFunc_t convert_func);
 	uvc_frame_t *draw_preview_one(uvc_frame_t *frame, ANativeWindow **window, convFunc_t func, int pixelBytes);
+	bool needCaptureFrame();
+	uvc_frame_t *decode_mjpeg(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *frame_mjpeg);
+	void decode_to_surface(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *frame_mjpeg);
+	void draw_decoded(uvc_frame_t *frame);
+	void start_decode_threads();
+	void stop_decode_threads();
+	void dispatch_decode(uvc_frame_t *frame_mjpeg);
+	static void *decode_thread_func(void *vptr_args);
+	void do_decode();
 //
 	void addCaptureFrame(uvc_frame_t *frame);
 	uvc_frame_t *waitCaptureFrame();
@@ -110,7 +209,13 @@ private:
 	void do_capture(JNIEnv *env);
 	void do_capture_surface(JNIEnv *env);
 	void do_capture_idle_loop(JNIEnv *env);
+	void clearCallbackFrame();
+	static void *callback_thread_func(void *vptr_args);
+	void do_callback(JNIEnv *env);
 	void do_capture_callback(JNIEnv *env, uvc_frame_t *frame);
+	void fill_frame_meta(const uvc_frame_t *frame);
+	void do_frame_buffer_callback(JNIEnv *env, uvc_frame_t *frame);
+	void release_callback_buffers(JNIEnv *env);
 	void callbackPixelFormatChanged();
 public:
 	UVCPreview(uvc_device_handle_t *devh);
@@ -119,11 +224,20 @@ public:
 	inline const bool isRunning() const;
 	int setPreviewSize(int width, int height, int min_fps, int max_fps, int mode, float bandwidth = 1.0f);
 	int setPreviewDisplay(ANativeWindow *preview_window);
-	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format);
+	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, bool with_meta = false);
+	int setFrameBufferCallback(JNIEnv *env, jobject callback_obj, jobjectArray buffers, int pixel_format);
+	int releaseFrameBuffer(int index);
+	uint64_t getFrameBufferDrops();
 	int startPreview();
 	int stopPreview();
 	inline const bool isCapturing() const;
 	int setCaptureDisplay(ANativeWindow *capture_window);
+	int getStreamStats(uvc_stream_stats_t *stats);
+	int setTraceFile(const char *path);
+	int setDecodeThreads(int num_threads);
+	int setPreviewScaling(bool enable);
+	int setColor(int matrix, int range);
+	int setQueuePolicy(int stage, int depth, int drop, int deadline_ms);
 };
 
 #endif /* UVCPREVIEW_H_ */
@@ -25,7 +25,9 @@
 #ifndef LIBUVCCAMERA_H_
 #define LIBUVCCAMERA_H_
 
+#ifdef __ANDROID__
 #include <jni.h>
+#endif
 #include "libusb.h"
 #include "libuvc.h"
 #include "utilbase.h"
@@ -0,0 +1,184 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: objectqueue.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef OBJECTQUEUE_H_
+#define OBJECTQUEUE_H_
+
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "utilbase.h"
+
+/**
+ * lock free queue to pass pointers between threads and futex based wait/wake for it.
+ * neither takes a mutex, a thread only sleeps in the kernel (futex)
+ * when it waits on an empty queue, so a producer never blocks
+ * and never has to wake up a thread holding a lock.
+ * the capacity must be a power of 2.
+ */
+
+/**
+ * wait/wake for the queues, the consumer sleeps only when the sequence
+ * did not change since it found the queue empty
+ */
+class FutexSync {
+private:
+	uint32_t m_seq;
+	uint32_t m_waiters;
+public:
+	FutexSync() : m_seq(0), m_waiters(0) {}
+	/**
+	 * call before checking the queue the last time,
+	 * pass the returned value to wait and call finish after that
+	 */
+	inline uint32_t prepare() {
+		__atomic_fetch_add(&m_waiters, 1, __ATOMIC_SEQ_CST);
+		return __atomic_load_n(&m_seq, __ATOMIC_SEQ_CST);
+	}
+	inline void finish() {
+		__atomic_fetch_sub(&m_waiters, 1, __ATOMIC_RELAXED);
+	}
+	/**
+	 * sleep until wake is called after prepare
+	 * @param timeout_ms negative value waits infinitely
+	 */
+	void wait(const uint32_t seq, const int timeout_ms) {
+		struct timespec ts, *timeout = NULL;
+		if (timeout_ms >= 0) {
+			ts.tv_sec = timeout_ms / 1000;
+			ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+			timeout = &ts;
+		}
+		syscall(__NR_futex, &m_seq, FUTEX_WAIT_PRIVATE, seq, timeout, NULL, 0);
+	}
+	/**
+	 * wake the waiting threads, the system call is skipped if nobody waits
+	 */
+	inline void wake() {
+		__atomic_fetch_add(&m_seq, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&m_waiters, __ATOMIC_SEQ_CST)) {
+			syscall(__NR_futex, &m_seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+		}
+	}
+};
+
+/**
+ * bounded multi producer/multi consumer queue without blocking, used as a free list.
+ * each slot has a turn counter like the frame ring of libuvc,
+ * so a slot is never reused before the thread that claimed it has finished with it
+ */
+template <class T, int CAPACITY>
+class FreeList {
+private:
+	typedef char capacity_must_be_power_of_2[(CAPACITY & (CAPACITY - 1)) ? -1 : 1];
+	struct slot {
+		uint32_t turn;
+		T object;
+	};
+	slot m_slots[CAPACITY];
+	// m_head and m_tail are kept on separate cache lines with padding,
+	// aligned attribute would make an over-aligned type that new before C++17 does not honor
+	char m_pad0[64];
+	uint32_t m_head;	// next position to take
+	char m_pad1[64 - sizeof(uint32_t)];
+	uint32_t m_tail;	// next position to put
+	// force inhibiting copy/assignment
+	FreeList(const FreeList &src);
+	void operator =(const FreeList &src);
+public:
+	FreeList() : m_head(0), m_tail(0) {
+		for (int i = 0; i < CAPACITY; i++) {
+			m_slots[i].turn = i;
+			m_slots[i].object = NULL;
+		}
+	}
+
+	inline int capacity() const { return CAPACITY; }
+	/**
+	 * number of objects, this is only an estimate while other threads put or take
+	 */
+	inline int size() const {
+		const int32_t n = (int32_t)(__atomic_load_n(&m_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_head, __ATOMIC_ACQUIRE));
+		return n < 0 ? 0 : (n > CAPACITY ? CAPACITY : n);
+	}
+	/**
+	 * @return false if the list is full, the object is not added then
+	 */
+	bool put(T object) {
+		uint32_t pos = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+		for ( ; ; ) {
+			slot *s = &m_slots[pos & (CAPACITY - 1)];
+			const int32_t dif = (int32_t)(__atomic_load_n(&s->turn, __ATOMIC_ACQUIRE) - pos);
+			if (!dif) {
+				if (__atomic_compare_exchange_n(&m_tail, &pos, pos + 1,
+					false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+					s->object = object;
+					__atomic_store_n(&s->turn, pos + 1, __ATOMIC_RELEASE);
+					return true;
+				}
+				// pos was updated with current m_tail
+			} else if (dif < 0) {
+				return false;	// full
+			} else {
+				pos = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+			}
+		}
+	}
+	/**
+	 * position of the object that take gets next
+	 */
+	inline uint32_t head() const { return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE); }
+	/**
+	 * @param position if not NULL, receives the position of the object taken,
+	 * 		positions count up by one in the order of put
+	 * @return NULL if the list is empty
+	 */
+	T take(uint32_t *position = NULL) {
+		uint32_t pos = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+		for ( ; ; ) {
+			slot *s = &m_slots[pos & (CAPACITY - 1)];
+			const int32_t dif = (int32_t)(__atomic_load_n(&s->turn, __ATOMIC_ACQUIRE) - (pos + 1));
+			if (!dif) {
+				if (__atomic_compare_exchange_n(&m_head, &pos, pos + 1,
+					false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+					T object = s->object;
+					__atomic_store_n(&s->turn, pos + CAPACITY, __ATOMIC_RELEASE);
+					if (position) {
+						*position = pos;
+					}
+					return object;
+				}
+			} else if (dif < 0) {
+				return NULL;	// empty
+			} else {
+				pos = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+			}
+		}
+	}
+};
+
+#endif /* OBJECTQUEUE_H_ */
@@ -38,6 +38,7 @@
 
 #include "libUVCCamera.h"
 #include "UVCCamera.h"
+#include "FramePool.h"
 
 /**
  * set the value into the long field
@@ -276,6 +277,59 @@ static jint nativeSetFrameCallback(JNIEnv *env, jobject thiz,
 	RETURN(result, jint);
 }
 
+// フレームと一緒にメタデータ(各段階のタイムスタンプ等)をIFrameMetaCallbackへ渡す
+static jint nativeSetFrameMetaCallback(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jobject jIFrameMetaCallback, jint pixel_format) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		jobject frame_callback_obj = env->NewGlobalRef(jIFrameMetaCallback);
+		result = camera->setFrameCallback(env, frame_callback_obj, pixel_format, true);
+	}
+	RETURN(result, jint);
+}
+
+// 登録したダイレクトバッファへフレームを書き込んでIFrameBufferCallbackへ渡す
+static jint nativeSetFrameBufferCallback(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jobject jIFrameBufferCallback, jobjectArray buffers, jint pixel_format) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		jobject callback_obj = jIFrameBufferCallback ? env->NewGlobalRef(jIFrameBufferCallback) : NULL;
+		result = camera->setFrameBufferCallback(env, callback_obj, buffers, pixel_format);
+	}
+	RETURN(result, jint);
+}
+
+// IFrameBufferCallbackへ渡したバッファを返却する(どのスレッドからでも呼び出し可)
+static jint nativeReleaseFrameBuffer(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint index) {
+
+	jint result = JNI_ERR;
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->releaseFrameBuffer(index);
+	}
+	return result;
+}
+
+// バッファが全て使用中だったために破棄したフレーム数を取得する
+static jlong nativeGetFrameBufferDrops(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera) {
+
+	jlong result = 0;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = (jlong)camera->getFrameBufferDrops();
+	}
+	RETURN(result, jlong);
+}
+
 static jint nativeSetCaptureDisplay(JNIEnv *env, jobject thiz,
 	ID_TYPE id_camera, jobject jSurface) {
 
@@ -289,6 +343,138 @@ static jint nativeSetCaptureDisplay(JNIEnv *env, jobject thiz,
 	RETURN(result, jint);
 }
 
+// 転送統計を取得する
+// packets, bytes, packet_errors, frames_eof, frames_fid, frames_error, truncations, frames_overwritten, fps * 1000
+static jlongArray nativeGetStreamStats(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera) {
+
+	jlongArray result = NULL;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		uvc_stream_stats_t stats;
+		if (!camera->getStreamStats(&stats)) {
+			const jlong values[] = {
+				(jlong)stats.packets, (jlong)stats.bytes, stats.packet_errors,
+				stats.frames_eof, stats.frames_fid, stats.frames_error,
+				stats.truncations, stats.frames_overwritten, (jlong)(stats.fps * 1000.0f),
+			};
+			const jsize n = sizeof(values) / sizeof(values[0]);
+			result = env->NewLongArray(n);
+			if (LIKELY(result)) {
+				env->SetLongArrayRegion(result, 0, n, values);
+			}
+		}
+	}
+	RETURN(result, jlongArray);
+}
+
+// 転送データをファイルへ記録する(次のプレビュー開始から有効)
+static jint nativeSetTraceFile(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jstring trace_path) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		const char *c_path = trace_path ? env->GetStringUTFChars(trace_path, JNI_FALSE) : NULL;
+		result = camera->setTraceFile(c_path);
+		if (c_path) {
+			env->ReleaseStringUTFChars(trace_path, c_path);
+		}
+	}
+	RETURN(result, jint);
+}
+
+// MJPEGをデコードするスレッド数を設定する(次のプレビュー開始から有効)
+static jint nativeSetDecodeThreads(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint num_threads) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->setDecodeThreads(num_threads);
+	}
+	RETURN(result, jint);
+}
+
+// プレビュー用のMJPEGフレームをSurfaceのサイズに合わせて縮小デコードするかどうかを設定する(次のプレビュー開始から有効)
+static jint nativeSetPreviewScaling(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jboolean enable) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->setPreviewScaling(enable);
+	}
+	RETURN(result, jint);
+}
+
+// YUVフレームをRGBへ変換する時の色変換行列と量子化範囲を設定する(すぐに有効)
+static jint nativeSetColor(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint matrix, jint range) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->setColor(matrix, range);
+	}
+	RETURN(result, jint);
+}
+
+// フレームバッファプールの統計を取得する(全カメラ共通)
+// hits, misses, releases, cached_frames, cached_bytes
+static jlongArray nativeGetFramePoolStats(JNIEnv *env, jclass clazz) {
+
+	jlongArray result = NULL;
+	ENTER();
+	frame_pool_stats_t stats;
+	FramePool::shared().getStats(&stats);
+	const jlong values[] = {
+		(jlong)stats.hits, (jlong)stats.misses, (jlong)stats.releases,
+		stats.cached_frames, (jlong)stats.cached_bytes,
+	};
+	const jsize n = sizeof(values) / sizeof(values[0]);
+	result = env->NewLongArray(n);
+	if (LIKELY(result)) {
+		env->SetLongArrayRegion(result, 0, n, values);
+	}
+	RETURN(result, jlongArray);
+}
+
+// フレームバッファプールに保持している未使用のバッファを解放する(全カメラ共通)
+static jlong nativeTrimFramePool(JNIEnv *env, jclass clazz) {
+
+	ENTER();
+	const jlong result = (jlong)FramePool::shared().trim();
+	RETURN(result, jlong);
+}
+
+// プレビューの各段のキューの深さ、溢れた時の動作、フレームの期限を設定する(すぐに有効)
+static jint nativeSetQueuePolicy(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint stage, jint depth, jint drop, jint deadline_ms) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->setQueuePolicy(stage, depth, drop, deadline_ms);
+	}
+	RETURN(result, jint);
+}
+
+// 非圧縮フレームの色変換を分割して並列処理するスレッド数を設定する(全カメラ共通)
+static jint nativeSetConvertThreads(JNIEnv *env, jclass clazz,
+	jint num_threads) {
+
+	ENTER();
+	const jint result = uvc_set_convert_threads(num_threads);
+	RETURN(result, jint);
+}
+
 //======================================================================
 // カメラコントロールでサポートしている機能を取得する
 static jlong nativeGetCtrlSupports(JNIEnv *env, jobject thiz,
@@ -2041,8 +2227,21 @@ static JNINativeMethod methods[] = {
 	{ "nativeStopPreview",				"(J)I", (void *) nativeStopPreview },
 	{ "nativeSetPreviewDisplay",		"(JLandroid/view/Surface;)I", (void *) nativeSetPreviewDisplay },
 	{ "nativeSetFrameCallback",			"(JLcom/jiangdg/uvc/IFrameCallback;I)I", (void *) nativeSetFrameCallback },
+	{ "nativeSetFrameMetaCallback",		"(JLcom/jiangdg/uvc/IFrameMetaCallback;I)I", (void *) nativeSetFrameMetaCallback },
+	{ "nativeSetFrameBufferCallback",	"(JLcom/jiangdg/uvc/IFrameBufferCallback;[Ljava/nio/ByteBuffer;I)I", (void *) nativeSetFrameBufferCallback },
+	{ "nativeReleaseFrameBuffer",		"(JI)I", (void *) nativeReleaseFrameBuffer },
+	{ "nativeGetFrameBufferDrops",		"(J)J", (void *) nativeGetFrameBufferDrops },
 
 	{ "nativeSetCaptureDisplay",		"(JLandroid/view/Surface;)I", (void *) nativeSetCaptureDisplay },
+	{ "nativeGetStreamStats",			"(J)[J", (void *) nativeGetStreamStats },
+	{ "nativeSetTraceFile",				"(JLjava/lang/String;)I", (void *) nativeSetTraceFile },
+	{ "nativeSetDecodeThreads",			"(JI)I", (void *) nativeSetDecodeThreads },
+	{ "nativeSetPreviewScaling",		"(JZ)I", (void *) nativeSetPreviewScaling },
+	{ "nativeSetColor",				"(JII)I", (void *) nativeSetColor },
+	{ "nativeSetQueuePolicy",			"(JIIII)I", (void *) nativeSetQueuePolicy },
+	{ "nativeSetConvertThreads",		"(I)I", (void *) nativeSetConvertThreads },
+	{ "nativeGetFramePoolStats",		"()[J", (void *) nativeGetFramePoolStats },
+	{ "nativeTrimFramePool",			"()J", (void *) nativeTrimFramePool },
 
 	{ "nativeGetCtrlSupports",			"(J)J", (void *) nativeGetCtrlSupports },
 	{ "nativeGetProcSupports",			"(J)J", (void *) nativeGetProcSupports },
@@ -62,13 +62,28 @@ LOCAL_SHARED_LIBRARIES += jpeg-turbo1500
 LOCAL_SHARED_LIBRARIES += usb100
 
 LOCAL_SRC_FILES := \
+	src/clock.c \
 	src/ctrl.c \
 	src/device.c \
 	src/diag.c \
 	src/frame.c \
 	src/frame-mjpeg.c \
+	src/frame-simd.c \
+	src/frame-slice.c \
 	src/init.c \
-	src/stream.c
+	src/stream.c \
+	src/trace.c
+
+# SIMD color conversion kernels, selected at runtime in frame-simd.c
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+# only this file is built with NEON, the cpu is checked before using it
+LOCAL_SRC_FILES += src/frame-neon.c.neon
+LOCAL_CFLAGS += -DLIBUVC_HAS_NEON
+else ifeq ($(TARGET_ARCH_ABI),arm64-v8a)
+LOCAL_SRC_FILES += src/frame-neon.c
+else ifneq ($(filter x86 x86_64,$(TARGET_ARCH_ABI)),)
+LOCAL_SRC_FILES += src/frame-sse2.c
+endif
 
 LOCAL_MODULE := libuvc_static
 include $(BUILD_STATIC_LIBRARY)
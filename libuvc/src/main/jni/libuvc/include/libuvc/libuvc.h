@@ -105,6 +105,16 @@ enum uvc_frame_format {
 	UVC_FRAME_FORMAT_MJPEG,
 	UVC_FRAME_FORMAT_GRAY8,
 	UVC_FRAME_FORMAT_BY8,
+	/** YUV 4:2:0, Y plane followed by interleaved UV plane */
+	UVC_FRAME_FORMAT_NV12,		// XXX added
+	/** YUV 4:2:0, Y plane followed by U plane and V plane */
+	UVC_FRAME_FORMAT_I420,		// XXX added
+	/** H.264 elementary stream (frame based), each frame is an access unit */
+	UVC_FRAME_FORMAT_H264,		// XXX added
+	/** H.265 elementary stream (frame based), each frame is an access unit */
+	UVC_FRAME_FORMAT_H265,		// XXX added
+	/** YUV 4:2:0, Y plane followed by interleaved VU plane */
+	UVC_FRAME_FORMAT_NV21,		// XXX added
 	/** Number of formats understood */
 	UVC_FRAME_FORMAT_COUNT,
 };
@@ -449,6 +459,45 @@ typedef struct uvc_device_descriptor {
 	const char *product;
 } uvc_device_descriptor_t;
 
+/** XXX YCbCr => RGB matrix of the YUV frames
+ * @ingroup frame
+ */
+enum uvc_color_matrix {
+	/** ITU-R BT.601, SD cameras and JFIF (default) */
+	UVC_COLOR_MATRIX_BT601 = 0,
+	/** ITU-R BT.709, HD cameras */
+	UVC_COLOR_MATRIX_BT709,
+	/** ITU-R BT.2020 */
+	UVC_COLOR_MATRIX_BT2020,
+	UVC_COLOR_MATRIX_COUNT
+};
+
+/** XXX Quantization range of the YUV frames
+ * @ingroup frame
+ */
+enum uvc_color_range {
+	/** Y and CbCr in 0-255 (default) */
+	UVC_COLOR_RANGE_FULL = 0,
+	/** Y in 16-235 and CbCr in 16-240 */
+	UVC_COLOR_RANGE_LIMITED,
+	UVC_COLOR_RANGE_COUNT
+};
+
+/** XXX Stages of a frame, uvc_frame::stage_ns keeps the host time when the frame passed each of them
+ * @ingroup frame
+ */
+enum uvc_frame_stage {
+	/** The first payload of the frame arrived */
+	UVC_FRAME_STAGE_RECEIVED = 0,
+	/** The last payload of the frame arrived */
+	UVC_FRAME_STAGE_COMPLETED,
+	/** The frame was handed to the frame callback or uvc_stream_get_frame */
+	UVC_FRAME_STAGE_HANDED,
+	/** The first stage the application can use, the library does not set the following stages */
+	UVC_FRAME_STAGE_APP,
+	UVC_FRAME_STAGE_COUNT = 8
+};
+
 /** An image frame received from the UVC device
  * @ingroup streaming
  */
@@ -457,6 +506,10 @@ typedef struct uvc_frame {
 	void *data;
 	/** Size of image data buffer */
 	size_t data_bytes;
+	/** XXX Allocated size of the data buffer when the library owns it, 0 if unknown.
+	 * uvc_ensure_frame_size only reallocates when this is smaller than the required size,
+	 * so data_bytes can be smaller than this */
+	size_t alloc_bytes;
 	/** XXX Size of actual received data to confirm whether the received bytes is same
 	 * as expected on user function when some microframes dropped */
 	size_t actual_bytes;
@@ -470,7 +523,9 @@ typedef struct uvc_frame {
 	size_t step;
 	/** Frame number (may skip, but is strictly monotonically increasing) */
 	uint32_t sequence;
-	/** Estimate of system time when the device started capturing the image */
+	/** Estimate of system time when the device started capturing the image
+	 * XXX in CLOCK_MONOTONIC, this is recovered from PTS/SCR of the payload headers
+	 * if the device sends them, otherwise the time when the first payload arrived */
 	struct timeval capture_time;
 	/** Handle on the device that produced the image.
 	 * @warning You must not call any uvc_* functions during a callback. */
@@ -482,6 +537,16 @@ typedef struct uvc_frame {
 	 * Set this field to zero if you are supplying the buffer.
 	 */
 	uint8_t library_owns_data;
+	/** XXX YCbCr => RGB matrix used to convert YUV frames, set by uvc_stream_set_color */
+	enum uvc_color_matrix color_matrix;
+	/** XXX Quantization range of YUV frames, set by uvc_stream_set_color */
+	enum uvc_color_range color_range;
+	/** XXX Host time in CLOCK_MONOTONIC nanoseconds when the frame passed each stage
+	 * of uvc_frame_stage, 0 if the frame did not pass the stage */
+	int64_t stage_ns[UVC_FRAME_STAGE_COUNT];
+	/** XXX Number of consumers sharing the frame, 1 when allocated.
+	 * The library does not use this, the frame owner releases the frame when it reaches 0 */
+	uint32_t ref_count;
 } uvc_frame_t;
 
 /** A callback function to handle incoming assembled UVC frames
@@ -489,6 +554,81 @@ typedef struct uvc_frame {
  */
 typedef void(uvc_frame_callback_t)(struct uvc_frame *frame, void *user_ptr);
 
+/** XXX What to do when the frame ring between the USB event thread
+ * and the callback thread is full
+ * @ingroup streaming
+ */
+enum uvc_frame_drop_policy {
+	/** Overwrite the oldest frame that the callback has not taken yet */
+	UVC_FRAME_DROP_OLDEST = 0,
+	/** Discard the frame just received */
+	UVC_FRAME_DROP_NEWEST = 1,
+};
+
+/** XXX A callback function to provide frame buffers for zero copy streaming
+ * @ingroup streaming
+ * The returned frame should be allocated with uvc_allocate_frame because
+ * the library may reallocate its data buffer when it is smaller than data_bytes.
+ */
+typedef uvc_frame_t *(uvc_frame_alloc_t)(size_t data_bytes, void *user_ptr);
+
+/** XXX A callback function to take back frame buffers provided by uvc_frame_alloc_t
+ * @ingroup streaming
+ * The library calls this for the frames it still holds when they no longer fit
+ * the stream or the stream is closed.
+ */
+typedef void (uvc_frame_release_t)(uvc_frame_t *frame, void *user_ptr);
+
+/** XXX Transport statistics of a stream, counted since the stream started
+ * @ingroup streaming
+ */
+typedef struct uvc_stream_stats {
+	/** Payload packets received (isochronous packets or bulk transfers) */
+	uint64_t packets;
+	/** Bytes received including payload headers */
+	uint64_t bytes;
+	/** Isochronous packets with error status, error bit or broken header */
+	uint32_t packet_errors;
+	/** Frames completed by EOF bit */
+	uint32_t frames_eof;
+	/** Frames completed by toggle of FID bit without EOF */
+	uint32_t frames_fid;
+	/** Frames dropped because of error in the payloads */
+	uint32_t frames_error;
+	/** Payloads truncated because the frame exceeded the buffer */
+	uint32_t truncations;
+	/** Frames dropped because the frame ring was full */
+	uint32_t frames_overwritten;
+	/** Frames passed to the frame ring per second, updated every second */
+	float fps;
+} uvc_stream_stats_t;
+
+/** XXX Memory held by a stream for transfers and frame buffers
+ * @ingroup streaming
+ */
+typedef struct uvc_stream_footprint {
+	/** Number of transfers including the spare transfer */
+	uint32_t transfers;
+	/** Bytes of the transfer buffers */
+	size_t transfer_bytes;
+	/** Number of frame buffers in the frame ring and being assembled */
+	uint32_t frames;
+	/** Bytes of the frame buffers */
+	size_t frame_bytes;
+	/** All bytes above and the bookkeeping of the stream */
+	size_t total_bytes;
+} uvc_stream_footprint_t;
+
+/** XXX Flags for uvc_replay_trace
+ * @ingroup streaming
+ */
+enum uvc_replay_flags {
+	/** Feed transfers at the recorded timing, frames may be dropped
+	 * as on the device. Otherwise transfers are fed as fast as the callback
+	 * consumes frames and no frame is dropped. */
+	UVC_REPLAY_REALTIME = 0x01,
+};
+
 /** Streaming mode, includes all information needed to select stream
  * @ingroup streaming
  */
@@ -524,6 +664,8 @@ typedef struct uvc_stream_ctrl {
 uvc_error_t uvc_init(uvc_context_t **ctx, struct libusb_context *usb_ctx);
 uvc_error_t uvc_init2(uvc_context_t **ctx, struct libusb_context *usb_ctx, const char *usbfs);
 void uvc_exit(uvc_context_t *ctx);
+uvc_error_t uvc_init_shared(uvc_context_t **ctx, const char *usbfs);	// XXX added
+void uvc_exit_shared(uvc_context_t *ctx);	// XXX added
 
 uvc_error_t uvc_get_device_list(uvc_context_t *ctx, uvc_device_t ***list);
 void uvc_free_device_list(uvc_device_t **list, uint8_t unref_devices);
@@ -603,6 +745,28 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 		uvc_frame_callback_t *cb, void *user_ptr, float bandwidth, uint8_t flags);	// XXX added saki
 uvc_error_t uvc_stream_start_iso(uvc_stream_handle_t *strmh,
 		uvc_frame_callback_t *cb, void *user_ptr);
+uvc_error_t uvc_stream_set_zero_copy(uvc_stream_handle_t *strmh,
+		uvc_frame_alloc_t *alloc_cb, uvc_frame_release_t *release_cb, void *alloc_ptr);	// XXX added
+uvc_error_t uvc_stream_set_frame_ring(uvc_stream_handle_t *strmh,
+		int num_slots, enum uvc_frame_drop_policy policy);	// XXX added
+uint32_t uvc_stream_get_overwritten_frames(uvc_stream_handle_t *strmh);	// XXX added
+uvc_error_t uvc_stream_get_stats(uvc_stream_handle_t *strmh,
+		uvc_stream_stats_t *stats);	// XXX added
+uvc_error_t uvc_stream_get_footprint(uvc_stream_handle_t *strmh,
+		uvc_stream_footprint_t *footprint);	// XXX added
+uvc_error_t uvc_stream_set_trace(uvc_stream_handle_t *strmh, const char *path);	// XXX added
+uvc_error_t uvc_replay_trace(const char *path, uvc_frame_callback_t *cb, void *user_ptr,
+		int flags, uvc_stream_stats_t *stats);	// XXX added
+uvc_error_t uvc_stream_set_transfer_config(uvc_stream_handle_t *strmh,
+		int num_transfers, int packets_per_transfer);	// XXX added
+uvc_error_t uvc_stream_get_transfer_config(uvc_stream_handle_t *strmh,
+		int *num_transfers, int *packets_per_transfer);	// XXX added
+uvc_error_t uvc_stream_get_bandwidth(uvc_stream_handle_t *strmh,
+		int *alt_setting, size_t *bytes_per_interval, uint32_t *bytes_per_sec);	// XXX added
+uvc_error_t uvc_stream_set_resubmit_first(uvc_stream_handle_t *strmh,
+		uint8_t enable);	// XXX added
+uvc_error_t uvc_stream_set_color(uvc_stream_handle_t *strmh,
+		enum uvc_color_matrix matrix, enum uvc_color_range range);	// XXX added
 uvc_error_t uvc_stream_get_frame(uvc_stream_handle_t *strmh,
 		uvc_frame_t **frame, int32_t timeout_us);
 uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh);
@@ -801,6 +965,18 @@ uvc_error_t uvc_mjpeg2bgr(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 uvc_error_t uvc_mjpeg2rgb565(uvc_frame_t *in, uvc_frame_t *out);	// XXX
 uvc_error_t uvc_mjpeg2rgbx(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_mjpeg2rgbx_merged(uvc_frame_t *in, uvc_frame_t *out);	// XXX added
+uvc_error_t uvc_mjpeg2yuv420SP(uvc_frame_t *in, uvc_frame_t *out);	// XXX added
+uvc_error_t uvc_mjpeg2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out);	// XXX added
+uvc_error_t uvc_mjpeg2i420(uvc_frame_t *in, uvc_frame_t *out);		// XXX added
+
+typedef struct uvc_mjpeg_decoder uvc_mjpeg_decoder_t;	// XXX added
+uvc_mjpeg_decoder_t *uvc_mjpeg_decoder_create(void);	// XXX added
+void uvc_mjpeg_decoder_destroy(uvc_mjpeg_decoder_t *decoder);	// XXX added
+void uvc_mjpeg_decoder_set_fancy_upsampling(uvc_mjpeg_decoder_t *decoder, int enable);	// XXX added
+uvc_error_t uvc_mjpeg_decoder_set_scale(uvc_mjpeg_decoder_t *decoder, int scale_denom);	// XXX added
+uvc_error_t uvc_mjpeg_decode(uvc_mjpeg_decoder_t *decoder,
+		uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format frame_format);	// XXX added
 #endif
 
 uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out);		// XXX
@@ -812,6 +988,7 @@ uvc_error_t uvc_yuyv2rgbx(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 uvc_error_t uvc_uyvy2rgbx(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 uvc_error_t uvc_rgb2rgbx(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 uvc_error_t uvc_any2rgbx(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_set_convert_threads(int num_threads);	// XXX added
 
 uvc_error_t uvc_yuyv2yuv420P(uvc_frame_t *in, uvc_frame_t *out);	// XXX
 uvc_error_t uvc_yuyv2yuv420SP(uvc_frame_t *in, uvc_frame_t *out);	// XXX
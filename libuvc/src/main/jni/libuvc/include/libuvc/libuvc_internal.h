@@ -217,6 +217,7 @@ typedef struct uvc_control_interface {
   struct uvc_processing_unit *processing_unit_descs;
   struct uvc_extension_unit *extension_unit_descs;
   uint16_t bcdUVC;
+  uint32_t dwClockFrequency;	// XXX device clock frequency in Hz (deprecated on UVC1.5)
   uint8_t bEndpointAddress;
   /** Interface number */
   uint8_t bInterfaceNumber;
@@ -240,17 +241,146 @@ typedef struct uvc_device_info {
 } uvc_device_info_t;
 
 /*
-  set a high number of transfer buffers. This uses a lot of ram, but
-  avoids problems with scheduling delays on slow boards causing missed
-  transfers. A better approach may be to make the transfer thread FIFO
-  scheduled (if we have root).
-  We could/should change this to allow reduce it to, say, 5 by default
-  and then allow the user to change the number of buffers as required.
+  XXX the number of transfer buffers and the packets per transfer are decided
+  from the frame size, the frame interval and the bandwidth of the endpoint
+  unless they are set with uvc_stream_set_transfer_config.
+  Queued transfers cover about LIBUVC_XFER_QUEUE_US to avoid problems with
+  scheduling delays on slow boards causing missed transfers, and each
+  transfer covers at most LIBUVC_XFER_MAX_US to reduce wakeups.
  */
-#define LIBUVC_NUM_TRANSFER_BUFS 10
-
+#define LIBUVC_MIN_TRANSFER_BUFS 2
+#define LIBUVC_MAX_TRANSFER_BUFS 32
+#define LIBUVC_MAX_ISO_PACKETS 128
+#define LIBUVC_XFER_MIN_US 1000
+#define LIBUVC_XFER_MAX_US 8000
+#define LIBUVC_XFER_QUEUE_US 64000
+#define LIBUVC_MAX_XFER_MEMORY	( 8 * 1024 * 1024 )
+
+/* XXX upper limit of a frame buffer, frame buffers are allocated for dwMaxVideoFrameSize
+ * and grow up to this only when the camera sends larger frames */
 #define LIBUVC_XFER_BUF_SIZE	( 16 * 1024 * 1024 )
 
+/* XXX number of slots of the frame ring between the USB event thread and
+ * the callback thread, this should be power of 2 */
+#define LIBUVC_NUM_FRAME_SLOTS 4
+#define LIBUVC_MAX_FRAME_SLOTS 32
+
+/* XXX number of device/host clock samples for clock recovery and
+ * the interval of them, samples cover about 3 seconds */
+#define LIBUVC_CLOCK_SAMPLES 32
+#define LIBUVC_CLOCK_INTERVAL_NS 100000000LL
+
+/** @internal
+ * XXX a pair of device clock (SCR) and host CLOCK_MONOTONIC time */
+typedef struct uvc_clock_sample {
+  int64_t dev;
+  int64_t host_ns;
+} uvc_clock_sample_t;
+
+/** @internal
+ * XXX recovers host time of device clock values (PTS) from SCR samples.
+ * The line host_ns = host0 + (dev - dev0) * ns_per_tick is fitted to the samples
+ * with least squares, so the drift of the device clock is compensated.
+ * Only the USB event thread accesses this.
+ */
+typedef struct uvc_clock {
+  /** nominal frequency of the device clock, zero if unknown */
+  uint32_t dev_hz;
+  uint8_t has_stc;
+  uint32_t last_stc;
+  /** unwrapped device clock of last_stc */
+  int64_t dev;
+  /** sample with the smallest transport delay in current interval */
+  uvc_clock_sample_t cand;
+  uint8_t has_cand;
+  int64_t interval_ns;
+  uvc_clock_sample_t samples[LIBUVC_CLOCK_SAMPLES];
+  int head, count;
+  /** fitted line */
+  uint8_t valid;
+  int64_t dev0, host0;
+  double ns_per_tick;
+} uvc_clock_t;
+
+/** @internal
+ * XXX stream info at the top of the payload trace file */
+typedef struct uvc_trace_info {
+  uint32_t frame_format;	// enum uvc_frame_format
+  uint16_t width, height;
+  uint32_t max_frame_bytes;
+  uint32_t max_payload_bytes;
+  uint32_t clock_frequency;
+  uint32_t packet_us;
+} uvc_trace_info_t;
+
+typedef struct uvc_trace uvc_trace_t;
+
+/** @internal
+ * XXX coefficients of the YUV => RGB conversion for a color matrix and range,
+ * built once for every combination.
+ * y' = ((y - y_offset) * y_gain) >> 14, r = y' + (cr * (v - 128)) >> 14,
+ * g = y' + (cg_u * (u - 128) + cg_v * (v - 128)) >> 14 and b = y' + (cb * (u - 128)) >> 14 */
+typedef struct uvc_color_table {
+  /** constants of the SIMD kernels, cr and cb may exceed 16 bits and are split into two halves */
+  int16_t y_offset;
+  int16_t y_gain;
+  int16_t cr_v[2];
+  int16_t cg_u;
+  int16_t cg_v;
+  int16_t cb_u[2];
+  /** lookup tables of the scalar loops, g_u and g_v are not shifted yet */
+  int16_t y[256];
+  int16_t r_v[256];
+  int32_t g_u[256];
+  int32_t g_v[256];
+  int16_t b_u[256];
+} uvc_color_table_t;
+
+/** @internal
+ * XXX row kernel of the color conversion.
+ * Converts at most @a pixels pixels (multiple of 8) and returns how many
+ * it converted, the scalar loop of the caller converts the rest. */
+typedef int (*uvc_convert_row_t)(const uint8_t *src, uint8_t *dst, int pixels,
+	const uvc_color_table_t *color);
+/** @internal
+ * XXX two rows kernel of YUYV => YUV420SP, same contract as uvc_convert_row_t */
+typedef int (*uvc_convert_row420sp_t)(const uint8_t *src, int src_step,
+	uint8_t *y, int y_step, uint8_t *uv, int pixels);
+
+/** @internal
+ * XXX color conversion kernels selected for the cpu at runtime,
+ * NULL entries use the scalar loops of frame.c */
+typedef struct uvc_convert_kernels {
+  const char *name;
+  uvc_convert_row_t yuyv2rgbx;
+  uvc_convert_row_t yuyv2rgb;
+  uvc_convert_row_t yuyv2bgr;
+  uvc_convert_row_t yuyv2rgb565;
+  uvc_convert_row_t uyvy2rgbx;
+  uvc_convert_row_t uyvy2rgb;
+  uvc_convert_row_t uyvy2bgr;
+  uvc_convert_row_t uyvy2rgb565;
+  uvc_convert_row420sp_t yuyv2yuv420sp;
+  uvc_convert_row420sp_t yuyv2iyuv420sp;
+} uvc_convert_kernels_t;
+
+/** @internal
+ * XXX slot of the frame ring.
+ * The ring is a bounded lock free queue, the USB event thread is the producer
+ * and the callback thread is the consumer, the producer can also take
+ * the oldest slot to drop it. turn is only accessed with __atomic builtins.
+ */
+typedef struct uvc_frame_slot {
+  uint32_t turn;
+  /** assembled frame while the slot is filled, otherwise a free frame buffer or NULL */
+  uvc_frame_t *frame;
+  size_t bytes;
+  uint8_t bfh_err;
+  uint32_t seq, pts, last_scr;
+  int64_t capture_ns;
+  int64_t received_ns, completed_ns;
+} uvc_frame_slot_t;
+
 struct uvc_stream_handle {
   struct uvc_device_handle *devh;
   struct uvc_stream_handle *prev, *next;
@@ -261,26 +391,76 @@ struct uvc_stream_handle {
   /** Current control block */
   struct uvc_stream_ctrl cur_ctrl;
 
-  /* listeners may only access hold*, and only when holding a 
-   * lock on cb_mutex (probably signaled with cb_cond) */
+  /* listeners may only access hold*, they are filled from the frame ring
+   * by the consumer thread (probably signaled with cb_cond) */
   uint8_t bfh_err, hold_bfh_err;	// XXX added to keep UVC_STREAM_ERR
   uint8_t fid;
   uint32_t seq, hold_seq;
   uint32_t pts, hold_pts;
   uint32_t last_scr, hold_last_scr;
   size_t got_bytes, hold_bytes;
+  /* XXX capture time of frames in CLOCK_MONOTONIC */
+  uvc_clock_t clock;
+  int64_t xfer_host_ns, pkt_host_ns, frame_host_ns;
+  int64_t capture_ns, hold_capture_ns;
+  int64_t hold_received_ns, hold_completed_ns;	// XXX host time of the first and the last payload of hold_frame
   size_t size_buf;	// XXX add for boundary check
-  uint8_t *outbuf, *holdbuf;
+  /* XXX outbuf is the data of assemble_frame that the event thread is filling,
+   * completed frames are passed to the consumer through the frame ring
+   * and the consumer keeps the last one as hold_frame */
+  uint8_t *outbuf;
+  size_t outbuf_bytes;	// XXX capacity of outbuf
+  size_t assemble_bytes;
+  uvc_frame_t *assemble_frame, *hold_frame;
+  uvc_frame_slot_t *slots;
+  uint32_t num_slots;
+  uint32_t ring_head, ring_tail;
+  enum uvc_frame_drop_policy drop_policy;
+  uint32_t overwritten_frames;
+  /* XXX statistics, only the USB event thread updates them */
+  uvc_stream_stats_t stats;
+  uint32_t fps_frames;
+  int64_t fps_start_ns;
+  /* XXX zero copy mode: hold_frame is passed to the user callback without copying,
+   * frames from frame_alloc_cb go back through frame_release_cb */
+  uint8_t zero_copy;
+  uvc_frame_alloc_t *frame_alloc_cb;
+  uvc_frame_release_t *frame_release_cb;
+  void *frame_alloc_ptr;
   pthread_mutex_t cb_mutex;
   pthread_cond_t cb_cond;
   pthread_t cb_thread;
-  uint32_t last_polled_seq;
   uvc_frame_callback_t *user_cb;
   void *user_ptr;
-  struct libusb_transfer *transfers[LIBUVC_NUM_TRANSFER_BUFS];
-  uint8_t *transfer_bufs[LIBUVC_NUM_TRANSFER_BUFS];
+  /* XXX transfers are allocated when the stream starts */
+  int num_transfers;
+  struct libusb_transfer **transfers;
+  uint8_t **transfer_bufs;
+  int packets_per_transfer;
+  /* XXX resubmit first mode: the spare transfer is submitted in place of
+   * a completed transfer before the completed one is processed.
+   * The spare transfer is the last one of transfers at start and only the USB
+   * event thread changes spare_transfer, spare_users is non-zero while it submits */
+  uint8_t resubmit_first;
+  struct libusb_transfer *spare_transfer;
+  uint32_t spare_users;
+  /* XXX color matrix and range set to the frames */
+  enum uvc_color_matrix color_matrix;
+  enum uvc_color_range color_range;
+  uint32_t packet_us;	// XXX service interval of isochronous endpoint, zero on bulk transfer
+  int alt_setting;	// XXX selected altsetting of the streaming interface
+  size_t bytes_per_interval;	// XXX bytes per service interval of the selected endpoint
+  /* XXX requested values, zero means auto */
+  int req_num_transfers, req_packets_per_transfer;
   struct uvc_frame frame;
   enum uvc_frame_format frame_format;
+  uint16_t frame_width, frame_height;	// XXX of the current frame descriptor
+  /* XXX payload trace, the file is opened while the stream is running
+   * and closed after all transfers were reaped.
+   * trace_users is non-zero while the event thread writes into trace */
+  char *trace_path;
+  uvc_trace_t *trace;
+  uint32_t trace_users;
 };
 
 /** Handle on an open UVC device
@@ -319,6 +499,8 @@ struct uvc_context {
   uvc_device_handle_t *open_devices;
   pthread_t handler_thread;
   uint8_t kill_handler_thread;
+  /** XXX guards open_devices and the handler thread, the context may be shared by cameras */
+  pthread_mutex_t open_devices_mutex;
 };
 
 uvc_error_t uvc_query_stream_ctrl(
@@ -328,6 +510,26 @@ uvc_error_t uvc_query_stream_ctrl(
     enum uvc_req_code req);
 
 void uvc_start_handler_thread(uvc_context_t *ctx);
+// XXX clock recovery (clock.c)
+int64_t uvc_clock_host_ns(void);
+void uvc_clock_init(uvc_clock_t *clock, uint32_t dev_hz);
+void uvc_clock_add_sample(uvc_clock_t *clock, uint32_t stc, int64_t host_ns);
+int uvc_clock_to_host(const uvc_clock_t *clock, uint32_t dev_time, int64_t *host_ns);
+// XXX payload trace (trace.c)
+uvc_trace_t *uvc_trace_open_write(const char *path, const uvc_trace_info_t *info,
+		size_t max_transfer_bytes, int num_packets);
+int uvc_trace_write_transfer(uvc_trace_t *trace, const struct libusb_transfer *transfer, int64_t host_ns);
+uvc_trace_t *uvc_trace_open_read(const char *path, uvc_trace_info_t *info);
+int uvc_trace_read_transfer(uvc_trace_t *trace, struct libusb_transfer **transfer, int64_t *host_ns);
+void uvc_trace_close(uvc_trace_t *trace);
+const uvc_convert_kernels_t *uvc_get_convert_kernels(void);
+const uvc_color_table_t *uvc_get_color_table(enum uvc_color_matrix matrix, enum uvc_color_range range);
+void uvc_init_convert_kernels_sse2(uvc_convert_kernels_t *kernels, int avx2);
+void uvc_init_convert_kernels_neon(uvc_convert_kernels_t *kernels);
+// XXX slice-parallel conversion (frame-slice.c)
+typedef uvc_error_t (*uvc_convert_func_t)(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_convert_sliced(uvc_convert_func_t convert, uvc_frame_t *in, uvc_frame_t *out,
+	const size_t out_pixel_bytes, const enum uvc_frame_format frame_format);
 uvc_error_t uvc_claim_if(uvc_device_handle_t *devh, int idx);
 uvc_error_t uvc_release_if(uvc_device_handle_t *devh, int idx);
 
@@ -0,0 +1,182 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/** @internal
+ * @file
+ * @brief Recovery of the device clock from the SCR of payload headers
+ *
+ * The device stamps each payload with SCR (the device clock when the payload
+ * was sent) and each frame with PTS (the device clock when capture of the frame
+ * began). SCR samples are paired with the host time that the payload arrived,
+ * the line between them is fitted and PTS is converted to the host time with it.
+ * The arrival time only delays, so the sample with the smallest delay is taken
+ * within every LIBUVC_CLOCK_INTERVAL_NS.
+ */
+
+#define LOG_TAG "libuvc/clock"
+#ifndef LOG_NDEBUG
+	#define	LOG_NDEBUG
+#endif
+#undef USE_LOGALL
+
+#include <string.h>
+#include <time.h>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+/* allowed difference between fitted and nominal clock frequency */
+#define MAX_DRIFT_PPM 5000
+
+/** @internal
+ * @brief Current host time in CLOCK_MONOTONIC
+ */
+int64_t uvc_clock_host_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** @internal
+ * @brief Reset clock recovery
+ * @param dev_hz nominal frequency of the device clock, zero if unknown
+ */
+void uvc_clock_init(uvc_clock_t *clock, uint32_t dev_hz) {
+	memset(clock, 0, sizeof(*clock));
+	clock->dev_hz = dev_hz;
+}
+
+/** @internal
+ * @brief Fit the line to the samples with least squares
+ */
+static void _uvc_clock_fit(uvc_clock_t *clock) {
+	const uvc_clock_sample_t *ref = &clock->samples[(clock->head + LIBUVC_CLOCK_SAMPLES - 1) % LIBUVC_CLOCK_SAMPLES];
+	const double nominal = clock->dev_hz ? 1e9 / clock->dev_hz : 0.0;
+	double mean_x = 0.0, mean_y = 0.0, sxx = 0.0, sxy = 0.0, slope;
+	int i;
+
+	/* values relative to the newest sample to keep the precision of double */
+	for (i = 0; i < clock->count; i++) {
+		mean_x += (double)(clock->samples[i].dev - ref->dev);
+		mean_y += (double)(clock->samples[i].host_ns - ref->host_ns);
+	}
+	mean_x /= clock->count;
+	mean_y /= clock->count;
+	for (i = 0; i < clock->count; i++) {
+		const double x = (double)(clock->samples[i].dev - ref->dev) - mean_x;
+		const double y = (double)(clock->samples[i].host_ns - ref->host_ns) - mean_y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+	slope = sxx > 0.0 ? sxy / sxx : 0.0;
+
+	if (nominal > 0.0) {
+		const double drift = slope / nominal - 1.0;
+		if ((clock->count < 2) || (drift > MAX_DRIFT_PPM * 1e-6) || (drift < -MAX_DRIFT_PPM * 1e-6))
+			slope = nominal;
+	}
+	if (slope <= 0.0) {
+		clock->valid = 0;
+		return;
+	}
+
+	clock->dev0 = ref->dev + (int64_t)mean_x;
+	clock->host0 = ref->host_ns + (int64_t)(mean_y - (mean_x - (double)(int64_t)mean_x) * slope);
+	clock->ns_per_tick = slope;
+	clock->valid = 1;
+}
+
+/** @internal
+ * @brief Add a pair of SCR and the host time that the payload arrived
+ * This should be called for every payload that has SCR.
+ * @param stc source time clock field of SCR
+ * @param host_ns host time in CLOCK_MONOTONIC
+ */
+void uvc_clock_add_sample(uvc_clock_t *clock, uint32_t stc, int64_t host_ns) {
+	uvc_clock_sample_t s;
+
+	if (LIKELY(clock->has_stc)) {
+		const int32_t delta = (int32_t)(stc - clock->last_stc);
+		if (UNLIKELY(delta < 0)) {
+			/* the device clock went back, the device may have been reset */
+			uvc_clock_init(clock, clock->dev_hz);
+		} else {
+			clock->dev += delta;
+		}
+	}
+	clock->has_stc = 1;
+	clock->last_stc = stc;
+
+	s.dev = clock->dev;
+	s.host_ns = host_ns;
+	if (!clock->has_cand) {
+		clock->cand = s;
+		clock->has_cand = 1;
+	} else {
+		/* keep the sample with smaller delay of arrival */
+		const double npt = clock->valid ? clock->ns_per_tick
+			: (clock->dev_hz ? 1e9 / clock->dev_hz : 0.0);
+		if ((double)(s.host_ns - clock->cand.host_ns) < (double)(s.dev - clock->cand.dev) * npt)
+			clock->cand = s;
+	}
+
+	if (clock->count && (host_ns - clock->interval_ns < LIBUVC_CLOCK_INTERVAL_NS))
+		return;
+
+	clock->samples[clock->head] = clock->cand;
+	clock->head = (clock->head + 1) % LIBUVC_CLOCK_SAMPLES;
+	if (clock->count < LIBUVC_CLOCK_SAMPLES)
+		clock->count++;
+	clock->has_cand = 0;
+	clock->interval_ns = host_ns;
+	_uvc_clock_fit(clock);
+}
+
+/** @internal
+ * @brief Convert the device clock value (e.g. PTS) to the host time
+ * The value should be within 2^31 ticks from the last SCR.
+ * @param dev_time device clock value
+ * @param[out] host_ns host time in CLOCK_MONOTONIC
+ * @return non-zero on success, 0 if the clock is not recovered yet
+ */
+int uvc_clock_to_host(const uvc_clock_t *clock, uint32_t dev_time, int64_t *host_ns) {
+	int64_t dev;
+
+	if (UNLIKELY(!clock->valid || !clock->has_stc))
+		return 0;
+
+	dev = clock->dev + (int32_t)(dev_time - clock->last_stc);
+	*host_ns = clock->host0 + (int64_t)((double)(dev - clock->dev0) * clock->ns_per_tick);
+	return 1;
+}
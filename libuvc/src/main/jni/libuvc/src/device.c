@@ -115,14 +115,19 @@ void _uvc_status_callback(struct libusb_transfer *transfer);
  */
 int uvc_already_open(uvc_context_t *ctx, struct libusb_device *usb_dev) {
 	uvc_device_handle_t *devh;
+	int ret = 0;
 
+	pthread_mutex_lock(&ctx->open_devices_mutex);
 	DL_FOREACH(ctx->open_devices, devh)
 	{
-		if (usb_dev == devh->dev->usb_dev)
-			return 1;
+		if (usb_dev == devh->dev->usb_dev) {
+			ret = 1;
+			break;
+		}
 	}
+	pthread_mutex_unlock(&ctx->open_devices_mutex);
 
-	return 0;
+	return ret;
 }
 
 /** @brief Finds a camera identified by vendor, product and/or serial number
@@ -330,12 +335,14 @@ uvc_error_t uvc_open(uvc_device_t *dev, uvc_device_handle_t **devh) {
 		LOGE("internal_devh->info->ctrl_if.bEndpointAddress is null");
 	}
 
+	pthread_mutex_lock(&dev->ctx->open_devices_mutex);
 	if (dev->ctx->own_usb_ctx && dev->ctx->open_devices == NULL) {
 		/* Since this is our first device, we need to spawn the event handler thread */
 		uvc_start_handler_thread(dev->ctx);
 	}
 
 	DL_APPEND(dev->ctx->open_devices, internal_devh);
+	pthread_mutex_unlock(&dev->ctx->open_devices_mutex);
 	*devh = internal_devh;
 
 	UVC_EXIT(ret);
@@ -988,6 +995,9 @@ uvc_error_t uvc_parse_vc_header(uvc_device_t *dev, uvc_device_info_t *info,
 	 */
 
 	info->ctrl_if.bcdUVC = SW_TO_SHORT(&block[3]);
+	// XXX device clock frequency for clock recovery of PTS/SCR
+	if (block_size >= 11)
+		info->ctrl_if.dwClockFrequency = DW_TO_INT(&block[7]);
 
 	switch (info->ctrl_if.bcdUVC) {
 	case 0x0100:
@@ -1359,55 +1369,66 @@ uvc_error_t uvc_parse_vs_format_mjpeg(uvc_streaming_interface_t *stream_if,
 }
 
 /** @internal
- * @brief Parse a VideoStreaming uncompressed frame block.
+ * @brief Parse a VideoStreaming frame based frame block.
  * @ingroup device
  */
 uvc_error_t uvc_parse_vs_frame_frame(uvc_streaming_interface_t *stream_if,
-					    const unsigned char *block,
-					    size_t block_size) {
-  uvc_format_desc_t *format;
-  uvc_frame_desc_t *frame;
-
-  const unsigned char *p;
-  int i;
-
-  UVC_ENTER();
-
-  format = stream_if->format_descs->prev;
-  frame = calloc(1, sizeof(*frame));
-
-  frame->parent = format;
-
-  frame->bDescriptorSubtype = block[2];
-  frame->bFrameIndex = block[3];
-  frame->bmCapabilities = block[4];
-  frame->wWidth = block[5] + (block[6] << 8);
-  frame->wHeight = block[7] + (block[8] << 8);
-  frame->dwMinBitRate = DW_TO_INT(&block[9]);
-  frame->dwMaxBitRate = DW_TO_INT(&block[13]);
-  frame->dwDefaultFrameInterval = DW_TO_INT(&block[17]);
-  frame->bFrameIntervalType = block[21];
-  frame->dwBytesPerLine = DW_TO_INT(&block[22]);
-
-  if (block[21] == 0) {
-    frame->dwMinFrameInterval = DW_TO_INT(&block[26]);
-    frame->dwMaxFrameInterval = DW_TO_INT(&block[30]);
-    frame->dwFrameIntervalStep = DW_TO_INT(&block[34]);
-  } else {
-    frame->intervals = calloc(block[21] + 1, sizeof(frame->intervals[0]));
-    p = &block[26];
-
-    for (i = 0; i < block[21]; ++i) {
-      frame->intervals[i] = DW_TO_INT(p);
-      p += 4;
-    }
-    frame->intervals[block[21]] = 0;
-  }
-
-  DL_APPEND(format->frame_descs, frame);
-
-  UVC_EXIT(UVC_SUCCESS);
-  return UVC_SUCCESS;
+		const unsigned char *block, size_t block_size) {
+	uvc_format_desc_t *format;
+	uvc_frame_desc_t *frame;
+	uint8_t n;
+	uint32_t interval;
+
+	const unsigned char *p;
+	int i;
+
+	UVC_ENTER();
+
+	format = stream_if->format_descs->prev;
+	frame = calloc(1, sizeof(*frame));
+
+	frame->parent = format;
+
+	frame->bDescriptorSubtype = block[2];
+	frame->bFrameIndex = block[3];
+	frame->bmCapabilities = block[4];
+	frame->wWidth = block[5] + (block[6] << 8);
+	frame->wHeight = block[7] + (block[8] << 8);
+	frame->dwMinBitRate = DW_TO_INT(&block[9]);
+	frame->dwMaxBitRate = DW_TO_INT(&block[13]);
+	frame->dwDefaultFrameInterval = DW_TO_INT(&block[17]);
+	n = frame->bFrameIntervalType = block[21];
+	frame->dwBytesPerLine = DW_TO_INT(&block[22]);
+
+	if (!n) {
+		frame->dwMinFrameInterval = DW_TO_INT(&block[26]);
+		frame->dwMaxFrameInterval = DW_TO_INT(&block[30]);
+		frame->dwFrameIntervalStep = DW_TO_INT(&block[34]);
+	} else {
+		frame->intervals = calloc(n + 1, sizeof(frame->intervals[0]));
+		p = &block[26];
+
+		for (i = 0; i < n; ++i) {
+			interval = DW_TO_INT(p);
+			frame->intervals[i] = interval ? interval : 1;
+			p += 4;
+		}
+		frame->intervals[n] = 0;
+
+		frame->dwDefaultFrameInterval
+			= MIN(frame->intervals[n-1],
+				MAX(frame->intervals[0], frame->dwDefaultFrameInterval));
+	}
+
+	// XXX frame based format does not have dwMaxVideoFrameBufferSize,
+	// assume a compressed frame does not exceed the size of the decoded image
+	frame->dwMaxVideoFrameBufferSize
+		= (format->bBitsPerPixel ? format->bBitsPerPixel : 16) * frame->wWidth * frame->wHeight / 8;
+
+	DL_APPEND(format->frame_descs, frame);
+
+	UVC_EXIT(UVC_SUCCESS);
+	return UVC_SUCCESS;
 }
 
 /** @internal
@@ -1571,6 +1592,7 @@ void uvc_close(uvc_device_handle_t *devh) {
 	 * then we need to cancel the handler thread. When we call libusb_close,
 	 * it'll cause a return from the thread's libusb_handle_events call, after
 	 * which the handler thread will check the flag we set and then exit. */
+	pthread_mutex_lock(&ctx->open_devices_mutex);
 	if (ctx->own_usb_ctx && ctx->open_devices == devh && devh->next == NULL) {
 		ctx->kill_handler_thread = 1;
 		libusb_close(devh->usb_devh);
@@ -1580,6 +1602,7 @@ void uvc_close(uvc_device_handle_t *devh) {
 	}
 
 	DL_DELETE(ctx->open_devices, devh);
+	pthread_mutex_unlock(&ctx->open_devices_mutex);
 
 	uvc_unref_device(devh->dev);
 
@@ -1605,10 +1628,12 @@ size_t uvc_num_devices(uvc_context_t *ctx) {
 
 	UVC_ENTER();
 
+	pthread_mutex_lock(&ctx->open_devices_mutex);
 	DL_FOREACH(ctx->open_devices, devh)
 	{
 		count++;
 	}
+	pthread_mutex_unlock(&ctx->open_devices_mutex);
 
 	UVC_EXIT((int) count);
 	return count;
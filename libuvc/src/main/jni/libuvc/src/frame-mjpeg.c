@@ -129,20 +129,12 @@ static const unsigned char ac_chromi_val[] = {
 	0xf9, 0xfa
 };
 
-#define COPY_HUFF_TABLE(dinfo,tbl,name) do { \
-	if (dinfo->tbl == NULL) dinfo->tbl = jpeg_alloc_huff_table((j_common_ptr)dinfo); \
-		memcpy(dinfo->tbl->bits, name##_len, sizeof(name##_len)); \
-		memset(dinfo->tbl->huffval, 0, sizeof(dinfo->tbl->huffval)); \
-		memcpy(dinfo->tbl->huffval, name##_val, sizeof(name##_val)); \
+#define COPY_HUFF_TABLE(tbl,name) do { \
+		memcpy((tbl)->bits, name##_len, sizeof(name##_len)); \
+		memset((tbl)->huffval, 0, sizeof((tbl)->huffval)); \
+		memcpy((tbl)->huffval, name##_val, sizeof(name##_val)); \
 	} while(0)
 
-static inline void insert_huff_tables(j_decompress_ptr dinfo) {
-	COPY_HUFF_TABLE(dinfo, dc_huff_tbl_ptrs[0], dc_lumi);
-	COPY_HUFF_TABLE(dinfo, dc_huff_tbl_ptrs[1], dc_chromi);
-	COPY_HUFF_TABLE(dinfo, ac_huff_tbl_ptrs[0], ac_lumi);
-	COPY_HUFF_TABLE(dinfo, ac_huff_tbl_ptrs[1], ac_chromi);
-}
-
 // XXX added to improve the performance of decoding
 // maximun reading lines for each call of jpeg_read_scanlines
 // when defined this macro, it's value should be common factor
@@ -158,395 +150,776 @@ static inline void insert_huff_tables(j_decompress_ptr dinfo) {
 #define MAX_READLINE 1
 #endif
 
-/** @brief Convert an MJPEG frame to RGB
- * @ingroup frame
- *
- * @param in MJPEG frame
- * @param out RGB frame
+/**
+ * XXX reusable MJPEG decoder
+ * The decompressor, the standard Huffman tables and the row buffers are kept
+ * across frames, so that only the header parsing is left as the per-frame setup.
+ * Not thread safe, use one decoder for each thread.
  */
-uvc_error_t uvc_mjpeg2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+struct uvc_mjpeg_decoder {
 	struct jpeg_decompress_struct dinfo;
 	struct error_mgr jerr;
-	size_t lines_read;
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
-
-	int num_scanlines, i;
-	lines_read = 0;
-	unsigned char *buffer[MAX_READLINE];
-
-	out->actual_bytes = 0;	// XXX
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
-		return UVC_ERROR_INVALID_PARAM;
-
-	if (uvc_ensure_frame_size(out, in->width * in->height * 3) < 0)
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGB;
-	out->step = in->width * 3;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
+	/** standard tables for the frames without DHT segment, built only once */
+	JHUFF_TBL *std_dc_tbls[2];
+	JHUFF_TBL *std_ac_tbls[2];
+	/** tables that DHT segments are read into, keeps the standard tables intact */
+	JHUFF_TBL *dht_dc_tbls[2];
+	JHUFF_TBL *dht_ac_tbls[2];
+	boolean fancy_upsampling;
+	/** 1/scale_denom scaling in the IDCT, 1, 2, 4 or 8 */
+	int scale_denom;
+	/** YCbCr scanlines or raw planes of an iMCU row */
+	uint8_t *buf;
+	size_t buf_bytes;
+	JSAMPROW rows[4 * DCTSIZE];
+	/** YUYV frame to go through when jpeg_read_raw_data can not be used */
+	uvc_frame_t *tmp;
+};
 
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
+static inline unsigned char sat(int i) {
+	return (unsigned char) (i >= 255 ? 255 : (i < 0 ? 0 : i));
+}
 
-	if (setjmp(jerr.jmp)) {
-		goto fail;
+#define YCbCr_YUYV_2(YCbCr, yuyv) \
+	{ \
+		*(yuyv++) = *(YCbCr+0); \
+		*(yuyv++) = (*(YCbCr+1) + *(YCbCr+4)) >> 1; \
+		*(yuyv++) = *(YCbCr+3); \
+		*(yuyv++) = (*(YCbCr+2) + *(YCbCr+5)) >> 1; \
 	}
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);
-	jpeg_read_header(&dinfo, TRUE);
-
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
+/** @internal
+ * @brief writes rows of the raw planes to the output frame
+ * @param planes Y, Cb and Cr rows of an iMCU row, the chroma is 1/2 width
+ * @param y first output row
+ * @param rows number of luma rows to write
+ * @param v_samp vertical sampling factor of luma, 1 for 4:2:2 and 2 for 4:2:0
+ */
+typedef void (*_uvc_raw_writer_t)(uvc_frame_t *out, JSAMPIMAGE planes,
+	const int y, const int rows, const int v_samp);
+
+static void _uvc_raw2yuyv(uvc_frame_t *out, JSAMPIMAGE planes,
+	const int y, const int rows, const int v_samp) {
+
+	const int width = out->width;
+	int i, x;
+	for (i = 0; i < rows; i++) {
+		const uint8_t *py = planes[0][i];
+		const uint8_t *pu = planes[1][i / v_samp];
+		const uint8_t *pv = planes[2][i / v_samp];
+		uint8_t *yuyv = (uint8_t *)out->data + (y + i) * out->step;
+		for (x = 0; x < width; x += 2) {
+			*(yuyv++) = py[x];
+			*(yuyv++) = *(pu++);
+			*(yuyv++) = py[x + 1];
+			*(yuyv++) = *(pv++);
+		}
 	}
+}
 
-	dinfo.out_color_space = JCS_RGB;
-	dinfo.dct_method = JDCT_IFAST;
-
-	jpeg_start_decompress(&dinfo);
-
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
-				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
-			lines_read += num_scanlines;
+/** @internal
+ * @brief writes the rows to a YUV 4:2:0 frame, planar or semi planar.
+ * 4:2:0 chroma rows are copied and each two 4:2:2 chroma rows are averaged.
+ * @param u, v top left of the chroma planes
+ * @param pixel_step distance between chroma samples in a row, 1:planar, 2:semi planar
+ * @param row_step distance between chroma rows
+ */
+static inline void _uvc_raw2yuv420(uvc_frame_t *out, JSAMPIMAGE planes,
+	const int y, const int rows, const int v_samp,
+	uint8_t *u, uint8_t *v, const int pixel_step, const int row_step) {
+
+	const int width = out->width;
+	const int cw = width >> 1;
+	uint8_t *py = (uint8_t *)out->data + y * width;
+	int i, x;
+	uint32_t j;
+
+	for (i = 0; i < rows; i++) {
+		memcpy(py, planes[0][i], width);
+		py += width;
+	}
+	uint32_t crows = (uint32_t)(rows + 1) >> 1;
+	if (crows > (out->height >> 1) - (uint32_t)(y >> 1))
+		crows = (out->height >> 1) - (uint32_t)(y >> 1);
+	u += (y >> 1) * row_step;
+	v += (y >> 1) * row_step;
+	for (j = 0; j < crows; j++) {
+		if (v_samp == 2) {
+			const uint8_t *pu = planes[1][j];
+			const uint8_t *pv = planes[2][j];
+			for (x = 0; x < cw; x++) {
+				u[x * pixel_step] = pu[x];
+				v[x * pixel_step] = pv[x];
+			}
+		} else {
+			const uint32_t j1 = (j << 1) + 1 < (uint32_t)rows ? (j << 1) + 1 : (j << 1);
+			const uint8_t *pu0 = planes[1][j << 1], *pu1 = planes[1][j1];
+			const uint8_t *pv0 = planes[2][j << 1], *pv1 = planes[2][j1];
+			for (x = 0; x < cw; x++) {
+				u[x * pixel_step] = (pu0[x] + pu1[x] + 1) >> 1;
+				v[x * pixel_step] = (pv0[x] + pv1[x] + 1) >> 1;
+			}
 		}
-		out->actual_bytes = in->width * in->height * 3;	// XXX
+		u += row_step;
+		v += row_step;
 	}
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;	// XXX
-
-fail:
-	jpeg_destroy_decompress(&dinfo);
-	return UVC_ERROR_OTHER+1;
 }
 
-/** @brief Convert an MJPEG frame to BGR
- * @ingroup frame
- *
- * @param in MJPEG frame
- * @param out BGR frame
- */
-uvc_error_t uvc_mjpeg2bgr(uvc_frame_t *in, uvc_frame_t *out) {
-	struct jpeg_decompress_struct dinfo;
-	struct error_mgr jerr;
-	size_t lines_read;
+static void _uvc_raw2i420(uvc_frame_t *out, JSAMPIMAGE planes,
+	const int y, const int rows, const int v_samp) {
 
-	int num_scanlines, i;
-	lines_read = 0;
-	unsigned char *buffer[MAX_READLINE];
+	uint8_t *u = (uint8_t *)out->data + out->width * out->height;
+	uint8_t *v = u + (out->width >> 1) * (out->height >> 1);
+	_uvc_raw2yuv420(out, planes, y, rows, v_samp, u, v, 1, out->width >> 1);
+}
 
-	out->actual_bytes = 0;	// XXX
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
-		return UVC_ERROR_INVALID_PARAM;
+static void _uvc_raw2nv12(uvc_frame_t *out, JSAMPIMAGE planes,
+	const int y, const int rows, const int v_samp) {
 
-	if (uvc_ensure_frame_size(out, in->width * in->height * 3) < 0)
-		return UVC_ERROR_NO_MEM;
+	uint8_t *u = (uint8_t *)out->data + out->width * out->height;
+	_uvc_raw2yuv420(out, planes, y, rows, v_samp, u, u + 1, 2, out->width);
+}
 
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_BGR;
-	out->step = in->width * 3;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
+static void _uvc_raw2nv21(uvc_frame_t *out, JSAMPIMAGE planes,
+	const int y, const int rows, const int v_samp) {
 
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
+	uint8_t *v = (uint8_t *)out->data + out->width * out->height;
+	_uvc_raw2yuv420(out, planes, y, rows, v_samp, v + 1, v, 2, out->width);
+}
 
-	if (setjmp(jerr.jmp)) {
-		goto fail;
+/** @internal
+ * @brief YUYV => YUV 4:2:0 for the frames _uvc_mjpeg_read_raw can not handle,
+ * the chroma of each two rows is averaged
+ */
+static void _uvc_yuyv2yuv420(uvc_frame_t *in, uvc_frame_t *out) {
+	const int width = out->width;
+	const int height = out->height;
+	uint8_t *u = (uint8_t *)out->data + width * height;
+	uint8_t *v;
+	int pixel_step, row_step;
+	int h, x;
+
+	switch (out->frame_format) {
+	case UVC_FRAME_FORMAT_I420:
+		v = u + (width >> 1) * (height >> 1);
+		pixel_step = 1;
+		row_step = width >> 1;
+		break;
+	case UVC_FRAME_FORMAT_NV21:
+		v = u++;
+		pixel_step = 2;
+		row_step = width;
+		break;
+	default:	// NV12
+		v = u + 1;
+		pixel_step = 2;
+		row_step = width;
+		break;
 	}
+	for (h = 0; h < height; h++) {
+		const uint8_t *yuyv = (const uint8_t *)in->data + h * in->step;
+		uint8_t *py = (uint8_t *)out->data + h * width;
+		for (x = 0; x < width; x++)
+			py[x] = yuyv[x << 1];
+		if ((h & 1) && (h < ((height >> 1) << 1))) {
+			const uint8_t *prev = yuyv - in->step;
+			for (x = 0; x < (width >> 1); x++) {
+				u[x * pixel_step] = (prev[(x << 2) + 1] + yuyv[(x << 2) + 1] + 1) >> 1;
+				v[x * pixel_step] = (prev[(x << 2) + 3] + yuyv[(x << 2) + 3] + 1) >> 1;
+			}
+			u += row_step;
+			v += row_step;
+		}
+	}
+}
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);
-	jpeg_read_header(&dinfo, TRUE);
 
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
+/** @internal
+ * @brief initialize the decompressor and build the standard Huffman tables
+ */
+static uvc_error_t _uvc_mjpeg_decoder_init(uvc_mjpeg_decoder_t *decoder) {
+	j_common_ptr cinfo = (j_common_ptr) &decoder->dinfo;
+	int i;
+
+	memset(decoder, 0, sizeof(*decoder));
+	decoder->dinfo.err = jpeg_std_error(&decoder->jerr.super);
+	decoder->jerr.super.error_exit = _error_exit;
+	decoder->fancy_upsampling = TRUE;
+	decoder->scale_denom = 1;
+
+	if (setjmp(decoder->jerr.jmp)) {
+		jpeg_destroy_decompress(&decoder->dinfo);
+		return UVC_ERROR_NO_MEM;
 	}
 
-	dinfo.out_color_space = JCS_EXT_BGR;
-	dinfo.dct_method = JDCT_IFAST;
-
-	jpeg_start_decompress(&dinfo);
+	jpeg_create_decompress(&decoder->dinfo);
+	// these tables are allocated from JPOOL_PERMANENT and live as long as the decompressor
+	for (i = 0; i < 2; i++) {
+		decoder->std_dc_tbls[i] = jpeg_alloc_huff_table(cinfo);
+		decoder->std_ac_tbls[i] = jpeg_alloc_huff_table(cinfo);
+		decoder->dht_dc_tbls[i] = jpeg_alloc_huff_table(cinfo);
+		decoder->dht_ac_tbls[i] = jpeg_alloc_huff_table(cinfo);
+	}
+	COPY_HUFF_TABLE(decoder->std_dc_tbls[0], dc_lumi);
+	COPY_HUFF_TABLE(decoder->std_dc_tbls[1], dc_chromi);
+	COPY_HUFF_TABLE(decoder->std_ac_tbls[0], ac_lumi);
+	COPY_HUFF_TABLE(decoder->std_ac_tbls[1], ac_chromi);
+	// a DHT segment may define only some of the tables
+	for (i = 0; i < 2; i++) {
+		*decoder->dht_dc_tbls[i] = *decoder->std_dc_tbls[i];
+		*decoder->dht_ac_tbls[i] = *decoder->std_ac_tbls[i];
+	}
 
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
+	return UVC_SUCCESS;
+}
 
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
-				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
-			lines_read += num_scanlines;
-		}
-		out->actual_bytes = in->width * in->height * 3;	// XXX
+static void _uvc_mjpeg_decoder_release(uvc_mjpeg_decoder_t *decoder) {
+	jpeg_destroy_decompress(&decoder->dinfo);
+	if (decoder->buf) {
+		free(decoder->buf);
+		decoder->buf = NULL;
+	}
+	decoder->buf_bytes = 0;
+	if (decoder->tmp) {
+		uvc_free_frame(decoder->tmp);
+		decoder->tmp = NULL;
 	}
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;	// XXX
-
-fail:
-	jpeg_destroy_decompress(&dinfo);
-	return UVC_ERROR_OTHER+1;
 }
 
-/** @brief Convert an MJPEG frame to RGB565
- * @ingroup frame
- *
- * @param in MJPEG frame
- * @param out RGB frame
+/** @internal
+ * @brief grow the row buffer if needs, the contents are not preserved
  */
-uvc_error_t uvc_mjpeg2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
-	struct jpeg_decompress_struct dinfo;
-	struct error_mgr jerr;
-	size_t lines_read;
-
-	int num_scanlines, i;
-	lines_read = 0;
-	unsigned char *buffer[MAX_READLINE];
-
-	out->actual_bytes = 0;	// XXX
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
-		return UVC_ERROR_INVALID_PARAM;
-
-	if (uvc_ensure_frame_size(out, in->width * in->height * 2) < 0)
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGB565;
-	out->step = in->width * 2;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
-
-	if (setjmp(jerr.jmp)) {
-		goto fail;
+static int _uvc_mjpeg_decoder_ensure_buf(uvc_mjpeg_decoder_t *decoder, const size_t bytes) {
+	if (UNLIKELY(decoder->buf_bytes < bytes)) {
+		free(decoder->buf);
+		decoder->buf = malloc(bytes);
+		decoder->buf_bytes = decoder->buf ? bytes : 0;
 	}
+	return LIKELY(decoder->buf) ? 0 : -1;
+}
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);
-	jpeg_read_header(&dinfo, TRUE);
+/** @internal
+ * @brief whether the frame has its own Huffman tables.
+ * Walks the marker segments until SOS, that is a few hundred bytes at most.
+ */
+static int _uvc_mjpeg_has_dht(const uint8_t *data, const size_t bytes) {
+	size_t i = 2;	// skip SOI
+
+	for (; i + 4 <= bytes; ) {
+		if (UNLIKELY(data[i] != 0xff))
+			break;	// broken, libjpeg will complain
+		const uint8_t marker = data[i + 1];
+		if (marker == 0xff) {	// fill byte
+			i++;
+		} else if (marker == 0xc4) {	// DHT
+			return 1;
+		} else if ((marker == 0xda) || (marker == 0xd9)) {	// SOS/EOI
+			break;
+		} else if ((marker == 0x01) || ((marker >= 0xd0) && (marker <= 0xd7))) {
+			i += 2;	// markers without length
+		} else {
+			i += 2 + ((data[i + 2] << 8) | data[i + 3]);
+		}
+	}
+	return 0;
+}
 
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
+/** @internal
+ * @brief set the source and read the header, call this after setjmp.
+ * The Huffman tables of the decompressor persist across frames,
+ * so the pointers are switched to the standard or the DHT ones for each frame.
+ */
+static void _uvc_mjpeg_read_header(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in) {
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	JHUFF_TBL **dc_tbls, **ac_tbls;
+	int i;
+
+	if (_uvc_mjpeg_has_dht(in->data, in->actual_bytes)) {
+		dc_tbls = decoder->dht_dc_tbls;
+		ac_tbls = decoder->dht_ac_tbls;
+	} else {
+		/* This frame is missing the Huffman tables: use the standard ones */
+		dc_tbls = decoder->std_dc_tbls;
+		ac_tbls = decoder->std_ac_tbls;
+	}
+	for (i = 0; i < 2; i++) {
+		dinfo->dc_huff_tbl_ptrs[i] = dc_tbls[i];
+		dinfo->ac_huff_tbl_ptrs[i] = ac_tbls[i];
 	}
+	jpeg_mem_src(dinfo, in->data, in->actual_bytes/*in->data_bytes*/);	// XXX
+	jpeg_read_header(dinfo, TRUE);
+}
 
-	dinfo.out_color_space = JCS_RGB565;
-	dinfo.dct_method = JDCT_IFAST;
+/** @internal
+ * @brief whether jpeg_read_raw_data path can decode the frame,
+ * only 4:2:2 and 4:2:0 YCbCr frames are handled.
+ * With the scaled IDCT, libjpeg-turbo scales up the chroma in the IDCT
+ * and the planes are not subsampled any more, so they are not handled either.
+ */
+static inline int _uvc_mjpeg_raw_supported(j_decompress_ptr dinfo) {
+	return (dinfo->scale_denom == 1)
+		&& (dinfo->num_components == 3)
+		&& (dinfo->jpeg_color_space == JCS_YCbCr)
+		&& (dinfo->comp_info[0].h_samp_factor == 2)
+		&& (dinfo->comp_info[0].v_samp_factor <= 2)
+		&& (dinfo->comp_info[1].h_samp_factor == 1)
+		&& (dinfo->comp_info[1].v_samp_factor == 1)
+		&& (dinfo->comp_info[2].h_samp_factor == 1)
+		&& (dinfo->comp_info[2].v_samp_factor == 1);
+}
 
-	jpeg_start_decompress(&dinfo);
+/** @internal
+ * @brief decode with jpeg_read_scanlines directly into the output frame
+ * @return number of rows read
+ */
+static int _uvc_mjpeg_read_scanlines(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *out, const J_COLOR_SPACE color_space) {
 
+	j_decompress_ptr dinfo = &decoder->dinfo;
 	// local copy
 	uint8_t *data = out->data;
 	const int out_step = out->step;
+	unsigned char *buffer[MAX_READLINE];
+	int lines_read = 0, i;
 
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			buffer[0] = data + (lines_read) * out_step;
+	dinfo->out_color_space = color_space;
+	jpeg_start_decompress(dinfo);
+
+	if (LIKELY((dinfo->output_height == out->height) && (dinfo->output_width == out->width))) {
+		for (; dinfo->output_scanline < dinfo->output_height ;) {
+			buffer[0] = data + lines_read * out_step;
 			for (i = 1; i < MAX_READLINE; i++)
 				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
-			lines_read += num_scanlines;
+			lines_read += jpeg_read_scanlines(dinfo, buffer, MAX_READLINE);
 		}
-		out->actual_bytes = in->width * in->height * 2;	// XXX
 	}
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;	// XXX
-
-fail:
-	jpeg_destroy_decompress(&dinfo);
-	return UVC_ERROR_OTHER+1;
+	return lines_read;
 }
 
-/** @brief Convert an MJPEG frame to RGBX
- * @ingroup frame
- *
- * @param in MJPEG frame
- * @param out RGBX frame
+/** @internal
+ * @brief decode to YCbCr 4:4:4 scanlines and pack them into YUYV
+ * @return number of rows read, -1 if the row buffer could not be allocated
  */
-uvc_error_t uvc_mjpeg2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
-	struct jpeg_decompress_struct dinfo;
-	struct error_mgr jerr;
-	size_t lines_read;
+static int _uvc_mjpeg_read_ycbcr2yuyv(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *out) {
+	j_decompress_ptr dinfo = &decoder->dinfo;
 	// local copy
 	uint8_t *data = out->data;
 	const int out_step = out->step;
+	register uint8_t *yuyv, *ycbcr;
+	int lines_read = 0, num_scanlines, i, j;
 
-	int num_scanlines, i;
-	lines_read = 0;
-	unsigned char *buffer[MAX_READLINE];
+	dinfo->out_color_space = JCS_YCbCr;
+	jpeg_start_decompress(dinfo);
 
-	out->actual_bytes = 0;	// XXX
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
-		return UVC_ERROR_INVALID_PARAM;
+	// these dinfo.xxx valiables are only valid after jpeg_start_decompress
+	const int row_stride = dinfo->output_width * dinfo->output_components;
+	if (UNLIKELY(_uvc_mjpeg_decoder_ensure_buf(decoder, row_stride * MAX_READLINE)))
+		return -1;
+	for (i = 0; i < MAX_READLINE; i++)
+		decoder->rows[i] = decoder->buf + i * row_stride;
+
+	if (LIKELY((dinfo->output_height == out->height) && (dinfo->output_width == out->width))) {
+		for (; dinfo->output_scanline < dinfo->output_height ;) {
+			// convert lines of mjpeg data to YCbCr
+			num_scanlines = jpeg_read_scanlines(dinfo, decoder->rows, MAX_READLINE);
+			// convert YCbCr to yuyv(YUV422)
+			for (j = 0; j < num_scanlines; j++) {
+				yuyv = data + (lines_read + j) * out_step;
+				ycbcr = decoder->rows[j];
+				for (i = 0; i + 24 <= row_stride; i += 24) {	// step by YCbCr x 8 pixels = 3 x 8 bytes
+					YCbCr_YUYV_2(ycbcr + i, yuyv);
+					YCbCr_YUYV_2(ycbcr + i + 6, yuyv);
+					YCbCr_YUYV_2(ycbcr + i + 12, yuyv);
+					YCbCr_YUYV_2(ycbcr + i + 18, yuyv);
+				}
+				// the width of a scaled frame is not always a multiple of 8
+				for (; i + 6 <= row_stride; i += 6) {
+					YCbCr_YUYV_2(ycbcr + i, yuyv);
+				}
+			}
+			lines_read += num_scanlines;
+		}
+	}
+	return lines_read;
+}
 
-	if (uvc_ensure_frame_size(out, in->width * in->height * 4) < 0)
-		return UVC_ERROR_NO_MEM;
+/** @internal
+ * @brief decode into planar Y/Cb/Cr with jpeg_read_raw_data and pass them to the writer.
+ * Neither upsampling nor color conversion are done by libjpeg-turbo.
+ * @return number of rows written, -1 if the row buffer could not be allocated
+ */
+static int _uvc_mjpeg_read_raw(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *out, _uvc_raw_writer_t writer) {
+
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	JSAMPARRAY planes[3];
+	int lines_read = 0;
+	int rows, num_lines, i;
+
+	dinfo->raw_data_out = TRUE;
+	jpeg_start_decompress(dinfo);
+
+	const int v_samp = dinfo->comp_info[0].v_samp_factor;
+	// rows of an iMCU row, 8 or 16 luma rows and 8 chroma rows
+	const size_t luma_width = dinfo->comp_info[0].width_in_blocks * DCTSIZE;
+	const size_t chroma_width = dinfo->comp_info[1].width_in_blocks * DCTSIZE;
+	if (UNLIKELY(_uvc_mjpeg_decoder_ensure_buf(decoder,
+		luma_width * v_samp * DCTSIZE + chroma_width * 2 * DCTSIZE)))
+		return -1;
+	planes[0] = decoder->rows;
+	planes[1] = decoder->rows + 2 * DCTSIZE;
+	planes[2] = decoder->rows + 3 * DCTSIZE;
+	for (i = 0; i < v_samp * DCTSIZE; i++)
+		planes[0][i] = decoder->buf + i * luma_width;
+	for (i = 0; i < DCTSIZE; i++) {
+		planes[1][i] = planes[0][0] + v_samp * DCTSIZE * luma_width + i * chroma_width;
+		planes[2][i] = planes[1][0] + DCTSIZE * chroma_width + i * chroma_width;
+	}
 
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGBX;	// XXX
-	out->step = in->width * 4;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
+	if (LIKELY((dinfo->output_height == out->height) && (dinfo->output_width == out->width))) {
+		for (; dinfo->output_scanline < dinfo->output_height ;) {
+			num_lines = jpeg_read_raw_data(dinfo, planes, v_samp * DCTSIZE);
+			if (UNLIKELY(!num_lines))
+				break;
+			// the last iMCU row is padded to the multiple of 8/16 rows
+			rows = dinfo->output_height - lines_read;
+			if (rows > num_lines)
+				rows = num_lines;
+			writer(out, planes, lines_read, rows, v_samp);
+			lines_read += rows;
+		}
+	}
+	return lines_read;
+}
 
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
+/** @internal
+ * @brief decode a MJPEG frame into the output frame whose fields are already set up
+ * @return UVC_ERROR_NOT_SUPPORTED when a YUV 4:2:0 output is requested
+ *         for the sampling factors that jpeg_read_raw_data path can not handle
+ */
+static uvc_error_t _uvc_mjpeg_decode(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *in, uvc_frame_t *out, const size_t frame_bytes) {
+
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	volatile int lines_read = 0;
 
-	if (setjmp(jerr.jmp)) {
+	if (setjmp(decoder->jerr.jmp)) {
 		goto fail;
 	}
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);	// XXX
-	jpeg_read_header(&dinfo, TRUE);
+	_uvc_mjpeg_read_header(decoder, in);
+
+	dinfo->dct_method = JDCT_IFAST;
+	dinfo->do_fancy_upsampling = decoder->fancy_upsampling;
+	// jpeg_read_header resets these to 1/1
+	dinfo->scale_num = 1;
+	dinfo->scale_denom = decoder->scale_denom;
+
+	switch (out->frame_format) {
+	case UVC_FRAME_FORMAT_RGB:
+		lines_read = _uvc_mjpeg_read_scanlines(decoder, out, JCS_RGB);
+		break;
+	case UVC_FRAME_FORMAT_BGR:
+		lines_read = _uvc_mjpeg_read_scanlines(decoder, out, JCS_EXT_BGR);
+		break;
+	case UVC_FRAME_FORMAT_RGB565:
+		lines_read = _uvc_mjpeg_read_scanlines(decoder, out, JCS_RGB565);
+		break;
+	case UVC_FRAME_FORMAT_RGBX:
+		lines_read = _uvc_mjpeg_read_scanlines(decoder, out, JCS_EXT_RGBA);
+		break;
+	case UVC_FRAME_FORMAT_YUYV:
+		// XXX 4:2:2/4:2:0 frames are decoded without upsampling the chroma to 4:4:4 and back
+		if (_uvc_mjpeg_raw_supported(dinfo)) {
+			lines_read = _uvc_mjpeg_read_raw(decoder, out, _uvc_raw2yuyv);
+		} else {
+			lines_read = _uvc_mjpeg_read_ycbcr2yuyv(decoder, out);
+		}
+		break;
+	default:	// YUV 4:2:0
+		if (!_uvc_mjpeg_raw_supported(dinfo)) {
+			jpeg_abort_decompress(dinfo);
+			return UVC_ERROR_NOT_SUPPORTED;
+		}
+		lines_read = _uvc_mjpeg_read_raw(decoder, out,
+			out->frame_format == UVC_FRAME_FORMAT_I420 ? _uvc_raw2i420
+				: (out->frame_format == UVC_FRAME_FORMAT_NV21 ? _uvc_raw2nv21 : _uvc_raw2nv12));
+		break;
+	}
 
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
+	if (UNLIKELY(lines_read != (int)out->height)) {
+		// keep the decompressor for the next frame
+		jpeg_abort_decompress(dinfo);
+		return lines_read < 0 ? UVC_ERROR_NO_MEM : UVC_ERROR_OTHER;	// XXX
 	}
+	out->actual_bytes = frame_bytes;	// XXX
+	jpeg_finish_decompress(dinfo);
+	return UVC_SUCCESS;
 
-	dinfo.out_color_space = JCS_EXT_RGBA;
-	dinfo.dct_method = JDCT_IFAST;
+fail:
+	jpeg_abort_decompress(dinfo);
+	// an error after all rows were read, e.g. a broken trailer, is ignored
+	return lines_read == (int)out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;
+}
 
-	jpeg_start_decompress(&dinfo);
+/** @brief XXX Create a MJPEG decoder that can be reused for the frames of a stream
+ * @ingroup frame
+ *
+ * The decoder keeps the decompressor, the standard Huffman tables
+ * and its row buffers until uvc_mjpeg_decoder_destroy.
+ * A decoder must not be used from more than one thread at the same time.
+ *
+ * @return decoder, NULL if failed
+ */
+uvc_mjpeg_decoder_t *uvc_mjpeg_decoder_create(void) {
+	uvc_mjpeg_decoder_t *decoder = malloc(sizeof(*decoder));
 
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
-				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
-			lines_read += num_scanlines;
-		}
-		out->actual_bytes = in->width * in->height * 4;	// XXX
+	if (LIKELY(decoder) && UNLIKELY(_uvc_mjpeg_decoder_init(decoder))) {
+		free(decoder);
+		decoder = NULL;
 	}
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;	// XXX
+	return decoder;
+}
 
-fail:
-	jpeg_destroy_decompress(&dinfo);
-	return UVC_ERROR_OTHER+1;
+/** @brief XXX Free a MJPEG decoder
+ * @ingroup frame
+ *
+ * @param decoder decoder created by uvc_mjpeg_decoder_create, can be NULL
+ */
+void uvc_mjpeg_decoder_destroy(uvc_mjpeg_decoder_t *decoder) {
+	if (decoder) {
+		_uvc_mjpeg_decoder_release(decoder);
+		free(decoder);
+	}
 }
 
-static inline unsigned char sat(int i) {
-	return (unsigned char) (i >= 255 ? 255 : (i < 0 ? 0 : i));
+/** @brief XXX Select the chroma upsampling of RGB outputs
+ * @ingroup frame
+ *
+ * @param decoder MJPEG decoder
+ * @param enable 0: merged upsampler (replicated chroma, faster),
+ *        other: fancy upsampling (interpolated chroma, default)
+ */
+void uvc_mjpeg_decoder_set_fancy_upsampling(uvc_mjpeg_decoder_t *decoder, int enable) {
+	decoder->fancy_upsampling = enable ? TRUE : FALSE;
 }
 
-#define YCbCr_YUYV_2(YCbCr, yuyv) \
-	{ \
-		*(yuyv++) = *(YCbCr+0); \
-		*(yuyv++) = (*(YCbCr+1) + *(YCbCr+4)) >> 1; \
-		*(yuyv++) = *(YCbCr+3); \
-		*(yuyv++) = (*(YCbCr+2) + *(YCbCr+5)) >> 1; \
+/** @brief XXX Decode frames at 1/2, 1/4 or 1/8 of their size in the IDCT
+ * @ingroup frame
+ *
+ * The scaled frames cost a fraction of the full decode.
+ * The output of uvc_mjpeg_decode is (width + scale_denom - 1) / scale_denom wide
+ * and (height + scale_denom - 1) / scale_denom high.
+ * YUV outputs whose scaled width would be odd are decoded at a smaller scale.
+ *
+ * @param decoder MJPEG decoder
+ * @param scale_denom 1(no scaling, default), 2, 4 or 8
+ */
+uvc_error_t uvc_mjpeg_decoder_set_scale(uvc_mjpeg_decoder_t *decoder, int scale_denom) {
+	switch (scale_denom) {
+	case 1:
+	case 2:
+	case 4:
+	case 8:
+		decoder->scale_denom = scale_denom;
+		return UVC_SUCCESS;
+	default:
+		return UVC_ERROR_INVALID_PARAM;
 	}
+}
 
-uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
+/** @brief XXX Decode an MJPEG frame with a reusable decoder
+ * @ingroup frame
+ *
+ * @param decoder MJPEG decoder
+ * @param in MJPEG frame
+ * @param out output frame, scaled down if uvc_mjpeg_decoder_set_scale is set.
+ *        RGB and YUYV rows are written with the step of the frame
+ *        if the frame does not own its data and the step is large enough
+ * @param frame_format one of UVC_FRAME_FORMAT_RGB, BGR, RGB565, RGBX, YUYV, NV12, NV21 and I420
+ */
+uvc_error_t uvc_mjpeg_decode(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format frame_format) {
+
+	size_t step;
 
 	out->actual_bytes = 0;	// XXX
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
+	if (UNLIKELY(!decoder || (in->frame_format != UVC_FRAME_FORMAT_MJPEG)))
 		return UVC_ERROR_INVALID_PARAM;
 
-	if (uvc_ensure_frame_size(out, in->width * in->height * 2) < 0)
+	const int scale_denom = decoder->scale_denom;
+	const uint32_t width = (in->width + scale_denom - 1) / (uint32_t)scale_denom;
+	const uint32_t height = (in->height + scale_denom - 1) / (uint32_t)scale_denom;
+	switch (frame_format) {
+	case UVC_FRAME_FORMAT_RGB:
+	case UVC_FRAME_FORMAT_BGR:
+		step = width * 3;
+		break;
+	case UVC_FRAME_FORMAT_RGB565:
+		step = width * 2;
+		break;
+	case UVC_FRAME_FORMAT_RGBX:
+		step = width * 4;
+		break;
+	case UVC_FRAME_FORMAT_YUYV:
+	case UVC_FRAME_FORMAT_NV12:
+	case UVC_FRAME_FORMAT_NV21:
+	case UVC_FRAME_FORMAT_I420:
+		if (UNLIKELY(width & 1) && (scale_denom > 1)) {
+			// the chroma of YUV outputs is shared by pixel pairs
+			decoder->scale_denom = scale_denom >> 1;
+			const uvc_error_t result = uvc_mjpeg_decode(decoder, in, out, frame_format);
+			decoder->scale_denom = scale_denom;
+			return result;
+		}
+		step = frame_format == UVC_FRAME_FORMAT_YUYV ? width * 2 : width;
+		break;
+	default:
+		return UVC_ERROR_NOT_SUPPORTED;
+	}
+	// packed rows are written with the step of a frame that the caller owns, e.g. a locked window buffer
+	if (out->library_owns_data || (step == width) || (out->step < step))
+		out->step = step;
+	const size_t frame_bytes = step == width
+		? (width * height * 3) / 2 : out->step * (height - 1) + step;
+	if (uvc_ensure_frame_size(out, frame_bytes) < 0)
 		return UVC_ERROR_NO_MEM;
 
-	size_t lines_read = 0;
-	int i, j;
-	int num_scanlines;
-	register uint8_t *yuyv, *ycbcr;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_YUYV;
-	out->step = in->width * 2;
+	out->width = width;
+	out->height = height;
+	out->frame_format = frame_format;
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
-
-	struct jpeg_decompress_struct dinfo;
-	struct error_mgr jerr;
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
-
-	if (setjmp(jerr.jmp)) {
-		goto fail;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
+
+	uvc_error_t result = _uvc_mjpeg_decode(decoder, in, out, frame_bytes);
+	if (result == UVC_ERROR_NOT_SUPPORTED) {
+		// 4:4:4 or gray scale frame, decode via YUYV
+		if (!decoder->tmp) {
+			decoder->tmp = uvc_allocate_frame(width * height * 2);
+		}
+		if (LIKELY(decoder->tmp)) {
+			result = uvc_mjpeg_decode(decoder, in, decoder->tmp, UVC_FRAME_FORMAT_YUYV);
+			if (LIKELY(!result)) {
+				_uvc_yuyv2yuv420(decoder->tmp, out);
+				out->actual_bytes = frame_bytes;
+			}
+		} else {
+			result = UVC_ERROR_NO_MEM;
+		}
 	}
+	return result;
+}
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);	// XXX
-	jpeg_read_header(&dinfo, TRUE);
-
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
+/** @internal
+ * @brief decode with a decoder on the stack for the callers without their own decoder
+ */
+static uvc_error_t _uvc_mjpeg_decode_once(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format frame_format, const boolean fancy_upsampling) {
+
+	uvc_mjpeg_decoder_t decoder;
+	uvc_error_t result = _uvc_mjpeg_decoder_init(&decoder);
+
+	if (LIKELY(!result)) {
+		decoder.fancy_upsampling = fancy_upsampling;
+		result = uvc_mjpeg_decode(&decoder, in, out, frame_format);
+		_uvc_mjpeg_decoder_release(&decoder);
+	} else {
+		out->actual_bytes = 0;	// XXX
 	}
+	return result;
+}
 
-	dinfo.out_color_space = JCS_YCbCr;
-	dinfo.dct_method = JDCT_IFAST;
+/** @brief Convert an MJPEG frame to RGB
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out RGB frame
+ */
+uvc_error_t uvc_mjpeg2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_decode_once(in, out, UVC_FRAME_FORMAT_RGB, TRUE);
+}
 
-	// start decompressor
-	jpeg_start_decompress(&dinfo);
+/** @brief Convert an MJPEG frame to BGR
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out BGR frame
+ */
+uvc_error_t uvc_mjpeg2bgr(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_decode_once(in, out, UVC_FRAME_FORMAT_BGR, TRUE);
+}
 
-	// these dinfo.xxx valiables are only valid after jpeg_start_decompress
-	const int row_stride = dinfo.output_width * dinfo.output_components;
+/** @brief Convert an MJPEG frame to RGB565
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out RGB frame
+ */
+uvc_error_t uvc_mjpeg2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_decode_once(in, out, UVC_FRAME_FORMAT_RGB565, TRUE);
+}
 
-	// allocate buffer
-	register JSAMPARRAY buffer = (*dinfo.mem->alloc_sarray)
-		((j_common_ptr) &dinfo, JPOOL_IMAGE, row_stride, MAX_READLINE);
+/** @brief Convert an MJPEG frame to RGBX
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out RGBX frame
+ */
+uvc_error_t uvc_mjpeg2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_decode_once(in, out, UVC_FRAME_FORMAT_RGBX, TRUE);
+}
 
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
+/** @brief XXX Convert an MJPEG frame to RGBX with the merged upsampler of libjpeg-turbo
+ * @ingroup frame
+ *
+ * The chroma of 4:2:2/4:2:0 frames is replicated instead of interpolated,
+ * which saves a full frame pass compared to uvc_mjpeg2rgbx.
+ *
+ * @param in MJPEG frame
+ * @param out RGBX frame
+ */
+uvc_error_t uvc_mjpeg2rgbx_merged(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_decode_once(in, out, UVC_FRAME_FORMAT_RGBX, FALSE);
+}
 
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			// convert lines of mjpeg data to YCbCr
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
-			// convert YCbCr to yuyv(YUV422)
-			for (j = 0; j < num_scanlines; j++) {
-				yuyv = data + (lines_read + j) * out_step;
-				ycbcr = buffer[j];
-				for (i = 0; i < row_stride; i += 24) {	// step by YCbCr x 8 pixels = 3 x 8 bytes
-					YCbCr_YUYV_2(ycbcr + i, yuyv);
-					YCbCr_YUYV_2(ycbcr + i + 6, yuyv);
-					YCbCr_YUYV_2(ycbcr + i + 12, yuyv);
-					YCbCr_YUYV_2(ycbcr + i + 18, yuyv);
-				}
-			}
-			lines_read += num_scanlines;
-		}
-		out->actual_bytes = in->width * in->height * 2;	// XXX
-	}
+uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_decode_once(in, out, UVC_FRAME_FORMAT_YUYV, TRUE);
+}
 
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;
+/** @brief XXX Convert an MJPEG frame to YUV420SP(NV12, Y plane followed by interleaved U/V)
+ * @ingroup frame
+ *
+ * Chroma order is same as uvc_yuyv2yuv420SP.
+ * 4:2:2/4:2:0 frames are decoded to planar YCbCr without upsampling.
+ *
+ * @param in MJPEG frame
+ * @param out NV12 frame
+ */
+uvc_error_t uvc_mjpeg2yuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_decode_once(in, out, UVC_FRAME_FORMAT_NV12, TRUE);
+}
 
-fail:
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER+1;
+/** @brief XXX Convert an MJPEG frame to YUV420SP with V/U order(NV21)
+ * @ingroup frame
+ *
+ * Chroma order is same as uvc_yuyv2iyuv420SP.
+ *
+ * @param in MJPEG frame
+ * @param out NV21 frame
+ */
+uvc_error_t uvc_mjpeg2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_decode_once(in, out, UVC_FRAME_FORMAT_NV21, TRUE);
 }
 
+/** @brief XXX Convert an MJPEG frame to planar YUV420(I420, Y plane followed by U plane and V plane)
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out I420 frame
+ */
+uvc_error_t uvc_mjpeg2i420(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_decode_once(in, out, UVC_FRAME_FORMAT_I420, TRUE);
+}
@@ -0,0 +1,199 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/** @internal
+ * @file
+ * @brief NEON kernels of the YUYV/UYVY color conversion
+ *
+ * Same integer arithmetic as the IYUYV2RGB_2 etc. macros of frame.c,
+ * the products are computed in 32 bits with vmull/vmlal and narrowed with
+ * an arithmetic shift by 14, y = ((y - offset) * gain) >> 14 with vqdmulh,
+ * and the saturation of sat() is done by vqmovun, so the result is bit exact
+ * with the lookup tables of the scalar code.
+ * This file is built with NEON enabled on armeabi-v7a (see Android.mk),
+ * which cpu is checked at runtime before these kernels are used.
+ */
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+/** @internal
+ * @brief (coef_u * u + coef_v * v) >> 14 of 8 chroma pairs */
+static inline int16x8_t _uvc_mul2_shift_neon(int16x8_t u, const int16_t coef_u,
+	int16x8_t v, const int16_t coef_v) {
+
+	return vcombine_s16(
+		vshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_low_s16(u), coef_u), vget_low_s16(v), coef_v), 14),
+		vshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_high_s16(u), coef_u), vget_high_s16(v), coef_v), 14));
+}
+
+/** @internal
+ * @brief sat(y + c) of the even and the odd pixels, interleaved back */
+static inline uint8x16_t _uvc_add_sat_neon(int16x8_t y_even, int16x8_t y_odd, int16x8_t c) {
+	const uint8x8x2_t z = vzip_u8(
+		vqmovun_s16(vaddq_s16(y_even, c)),
+		vqmovun_s16(vaddq_s16(y_odd, c)));
+	return vcombine_u8(z.val[0], z.val[1]);
+}
+
+/** @internal
+ * @brief r, g, b of 16 YUYV/UYVY pixels (32 bytes) */
+static inline void _uvc_yuv422_neon(const uint8_t *src, const int uyvy,
+	const uvc_color_table_t *color, const int16x8_t y_offset,
+	uint8x16_t *r, uint8x16_t *g, uint8x16_t *b) {
+
+	const uint8x8_t c128 = vdup_n_u8(128);
+	// YUYV: y0 u y1 v, UYVY: u y0 v y1
+	const uint8x8x4_t s = vld4_u8(src);
+	int16x8_t y0 = vreinterpretq_s16_u16(vmovl_u8(uyvy ? s.val[1] : s.val[0]));
+	int16x8_t y1 = vreinterpretq_s16_u16(vmovl_u8(uyvy ? s.val[3] : s.val[2]));
+	const int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(uyvy ? s.val[0] : s.val[1], c128));
+	const int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(uyvy ? s.val[2] : s.val[3], c128));
+
+	// ((y - offset) * gain) >> 14 as (2 * ((y - offset) << 1) * gain) >> 16
+	y0 = vqdmulhq_n_s16(vshlq_n_s16(vsubq_s16(y0, y_offset), 1), color->y_gain);
+	y1 = vqdmulhq_n_s16(vshlq_n_s16(vsubq_s16(y1, y_offset), 1), color->y_gain);
+	// cr and cb may not fit in 16 bits, they are applied as two halves
+	*r = _uvc_add_sat_neon(y0, y1, _uvc_mul2_shift_neon(v, color->cr_v[0], v, color->cr_v[1]));
+	*g = _uvc_add_sat_neon(y0, y1, _uvc_mul2_shift_neon(u, color->cg_u, v, color->cg_v));
+	*b = _uvc_add_sat_neon(y0, y1, _uvc_mul2_shift_neon(u, color->cb_u[0], u, color->cb_u[1]));
+}
+
+static inline void _uvc_store_rgbx_neon(uint8_t *dst, uint8x16_t r, uint8x16_t g, uint8x16_t b) {
+	uint8x16x4_t rgbx;
+	rgbx.val[0] = r;
+	rgbx.val[1] = g;
+	rgbx.val[2] = b;
+	rgbx.val[3] = vdupq_n_u8(0xff);
+	vst4q_u8(dst, rgbx);
+}
+
+static inline void _uvc_store_rgb_neon(uint8_t *dst, uint8x16_t r, uint8x16_t g, uint8x16_t b) {
+	uint8x16x3_t rgb;
+	rgb.val[0] = r;
+	rgb.val[1] = g;
+	rgb.val[2] = b;
+	vst3q_u8(dst, rgb);
+}
+
+static inline void _uvc_store_bgr_neon(uint8_t *dst, uint8x16_t r, uint8x16_t g, uint8x16_t b) {
+	_uvc_store_rgb_neon(dst, b, g, r);
+}
+
+static inline uint16x8_t _uvc_rgb565_neon(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+	// rrrrrggg gggbbbbb
+	uint16x8_t rgb565 = vshll_n_u8(r, 8);
+	rgb565 = vsriq_n_u16(rgb565, vshll_n_u8(g, 8), 5);
+	return vsriq_n_u16(rgb565, vshll_n_u8(b, 8), 11);
+}
+
+static inline void _uvc_store_rgb565_neon(uint8_t *dst, uint8x16_t r, uint8x16_t g, uint8x16_t b) {
+	vst1q_u16((uint16_t *)dst,
+		_uvc_rgb565_neon(vget_low_u8(r), vget_low_u8(g), vget_low_u8(b)));
+	vst1q_u16((uint16_t *)(dst + 16),
+		_uvc_rgb565_neon(vget_high_u8(r), vget_high_u8(g), vget_high_u8(b)));
+}
+
+#define DEFINE_KERNEL_NEON(name, uyvy, store, pixel_bytes) \
+static int name##_neon(const uint8_t *src, uint8_t *dst, int pixels, \
+	const uvc_color_table_t *color) { \
+	const int16x8_t y_offset = vdupq_n_s16(color->y_offset); \
+	uint8x16_t r, g, b; \
+	int i; \
+	for (i = 0; i + 16 <= pixels; i += 16) { \
+		_uvc_yuv422_neon(src, uyvy, color, y_offset, &r, &g, &b); \
+		store(dst, r, g, b); \
+		src += 32; \
+		dst += 16 * pixel_bytes; \
+	} \
+	return i; \
+}
+
+DEFINE_KERNEL_NEON(yuyv2rgbx, 0, _uvc_store_rgbx_neon, 4)
+DEFINE_KERNEL_NEON(yuyv2rgb, 0, _uvc_store_rgb_neon, 3)
+DEFINE_KERNEL_NEON(yuyv2bgr, 0, _uvc_store_bgr_neon, 3)
+DEFINE_KERNEL_NEON(yuyv2rgb565, 0, _uvc_store_rgb565_neon, 2)
+DEFINE_KERNEL_NEON(uyvy2rgbx, 1, _uvc_store_rgbx_neon, 4)
+DEFINE_KERNEL_NEON(uyvy2rgb, 1, _uvc_store_rgb_neon, 3)
+DEFINE_KERNEL_NEON(uyvy2bgr, 1, _uvc_store_bgr_neon, 3)
+DEFINE_KERNEL_NEON(uyvy2rgb565, 1, _uvc_store_rgb565_neon, 2)
+
+static inline int _uvc_yuyv2yuv420sp_neon(const uint8_t *src, int src_step,
+	uint8_t *y, int y_step, uint8_t *uv, int pixels, const int swap_uv) {
+
+	int i;
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		// val[0]: y of 16 pixels, val[1]: u v u v...
+		const uint8x16x2_t s0 = vld2q_u8(src);
+		const uint8x16x2_t s1 = vld2q_u8(src + src_step);
+		vst1q_u8(y, s0.val[0]);
+		vst1q_u8(y + y_step, s1.val[0]);
+		vst1q_u8(uv, swap_uv ? vrev16q_u8(s0.val[1]) : s0.val[1]);
+		src += 32;
+		y += 16;
+		uv += 16;
+	}
+	return i;
+}
+
+static int yuyv2yuv420sp_neon(const uint8_t *src, int src_step,
+	uint8_t *y, int y_step, uint8_t *uv, int pixels) {
+	return _uvc_yuyv2yuv420sp_neon(src, src_step, y, y_step, uv, pixels, 0);
+}
+
+static int yuyv2iyuv420sp_neon(const uint8_t *src, int src_step,
+	uint8_t *y, int y_step, uint8_t *uv, int pixels) {
+	return _uvc_yuyv2yuv420sp_neon(src, src_step, y, y_step, uv, pixels, 1);
+}
+
+/** @internal
+ * @brief Set the NEON kernels
+ */
+void uvc_init_convert_kernels_neon(uvc_convert_kernels_t *kernels) {
+	kernels->name = "neon";
+	kernels->yuyv2rgbx = yuyv2rgbx_neon;
+	kernels->yuyv2rgb = yuyv2rgb_neon;
+	kernels->yuyv2bgr = yuyv2bgr_neon;
+	kernels->yuyv2rgb565 = yuyv2rgb565_neon;
+	kernels->uyvy2rgbx = uyvy2rgbx_neon;
+	kernels->uyvy2rgb = uyvy2rgb_neon;
+	kernels->uyvy2bgr = uyvy2bgr_neon;
+	kernels->uyvy2rgb565 = uyvy2rgb565_neon;
+	kernels->yuyv2yuv420sp = yuyv2yuv420sp_neon;
+	kernels->yuyv2iyuv420sp = yuyv2iyuv420sp_neon;
+}
+
+#endif	// defined(__ARM_NEON) || defined(__ARM_NEON__)
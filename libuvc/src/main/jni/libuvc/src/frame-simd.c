@@ -0,0 +1,189 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/** @internal
+ * @file
+ * @brief Runtime selection of the SIMD color conversion kernels
+ *
+ * The kernels are picked once from the features of the cpu we are running
+ * on. Every kernel gives exactly the same result as the integer scalar
+ * loops of frame.c, which are used for the entries left NULL and for the
+ * pixels at the end of a row the kernel did not convert.
+ * The coefficients of each color matrix and range are built here once too,
+ * as constants for the kernels and as lookup tables for the scalar loops.
+ */
+
+#define LOG_TAG "libuvc/simd"
+#ifndef LOG_NDEBUG
+	#define	LOG_NDEBUG
+#endif
+#undef USE_LOGALL
+
+#include <stdio.h>
+#include <string.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+static uvc_convert_kernels_t kernels;
+static uvc_color_table_t color_tables[UVC_COLOR_MATRIX_COUNT][UVC_COLOR_RANGE_COUNT];
+
+/** @internal
+ * Q14 coefficients of each color matrix and range, cr, cg_u, cg_v, cb.
+ * The limited range ones are scaled by 255/224.
+ * BT.601 full range keeps the coefficients libuvc has always used.
+ */
+static const int32_t color_coefs[UVC_COLOR_MATRIX_COUNT][UVC_COLOR_RANGE_COUNT][4] = {
+	{	// BT.601, Kr = 0.299, Kb = 0.114
+		{ 22987, -5636, -11698, 29049 },
+		{ 26149, -6419, -13320, 33050 },
+	},
+	{	// BT.709, Kr = 0.2126, Kb = 0.0722
+		{ 25802, -3069, -7670, 30402 },
+		{ 29372, -3494, -8731, 34610 },
+	},
+	{	// BT.2020, Kr = 0.2627, Kb = 0.0593
+		{ 24160, -2696, -9361, 30825 },
+		{ 27503, -3069, -10657, 35091 },
+	},
+};
+
+static void _uvc_init_color_table(uvc_color_table_t *color, const int32_t *coefs, const int limited) {
+	const int32_t cr = coefs[0], cg_u = coefs[1], cg_v = coefs[2], cb = coefs[3];
+	int i;
+
+	color->y_offset = limited ? 16 : 0;
+	// 255/219 rounded up so that y=235 gives 255
+	color->y_gain = limited ? 19078 : 16384;
+	color->cr_v[0] = cr / 2;
+	color->cr_v[1] = cr - cr / 2;
+	color->cg_u = cg_u;
+	color->cg_v = cg_v;
+	color->cb_u[0] = cb / 2;
+	color->cb_u[1] = cb - cb / 2;
+	for (i = 0; i < 256; i++) {
+		color->y[i] = ((i - color->y_offset) * color->y_gain) >> 14;
+		color->r_v[i] = (cr * (i - 128)) >> 14;
+		color->g_u[i] = cg_u * (i - 128);
+		color->g_v[i] = cg_v * (i - 128);
+		color->b_u[i] = (cb * (i - 128)) >> 14;
+	}
+}
+
+#if defined(__SSE2__)
+/** @internal
+ * @brief whether the cpu and the OS support AVX2 */
+static int _uvc_cpu_has_avx2(void) {
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int xcr0, xcr0_hi;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	if ((ecx & (bit_OSXSAVE | bit_AVX)) != (bit_OSXSAVE | bit_AVX))
+		return 0;
+	// the OS has to save the YMM registers on context switch
+	__asm__ volatile ("xgetbv" : "=a" (xcr0), "=d" (xcr0_hi) : "c" (0));
+	if ((xcr0 & 0x06) != 0x06)
+		return 0;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & bit_AVX2) != 0;
+}
+#endif
+
+#if defined(__arm__) && defined(LIBUVC_HAS_NEON)
+/** @internal
+ * @brief whether the cpu supports NEON, same way as libjpeg-turbo does on armeabi-v7a */
+static int _uvc_cpu_has_neon(void) {
+	char line[1024];
+	int result = 0;
+
+	FILE *fp = fopen("/proc/cpuinfo", "r");
+	if (!fp)
+		return 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (!strncmp(line, "Features", 8) && strstr(line, " neon")) {
+			result = 1;
+			break;
+		}
+	}
+	fclose(fp);
+	return result;
+}
+#endif
+
+static void _uvc_init_convert_kernels(void) {
+	int m, r;
+
+	for (m = 0; m < UVC_COLOR_MATRIX_COUNT; m++) {
+		for (r = 0; r < UVC_COLOR_RANGE_COUNT; r++) {
+			_uvc_init_color_table(&color_tables[m][r], color_coefs[m][r], r == UVC_COLOR_RANGE_LIMITED);
+		}
+	}
+	kernels.name = "scalar";
+#if defined(__SSE2__)
+	uvc_init_convert_kernels_sse2(&kernels, _uvc_cpu_has_avx2());
+#elif defined(__aarch64__)
+	uvc_init_convert_kernels_neon(&kernels);
+#elif defined(__arm__) && defined(LIBUVC_HAS_NEON)
+	if (_uvc_cpu_has_neon())
+		uvc_init_convert_kernels_neon(&kernels);
+#endif
+	LOGI("color conversion kernels:%s", kernels.name);
+}
+
+/** @internal
+ * @brief Get the color conversion kernels for this cpu
+ */
+const uvc_convert_kernels_t *uvc_get_convert_kernels(void) {
+	pthread_once(&kernels_once, _uvc_init_convert_kernels);
+	return &kernels;
+}
+
+/** @internal
+ * @brief Get the coefficients of a color matrix and range,
+ * unknown values fall back to BT.601 full range
+ */
+const uvc_color_table_t *uvc_get_color_table(enum uvc_color_matrix matrix, enum uvc_color_range range) {
+	pthread_once(&kernels_once, _uvc_init_convert_kernels);
+	if (UNLIKELY((unsigned)matrix >= UVC_COLOR_MATRIX_COUNT))
+		matrix = UVC_COLOR_MATRIX_BT601;
+	if (UNLIKELY((unsigned)range >= UVC_COLOR_RANGE_COUNT))
+		range = UVC_COLOR_RANGE_FULL;
+	return &color_tables[matrix][range];
+}
@@ -0,0 +1,288 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/** @internal
+ * @file
+ * @brief Slice-parallel conversion of large uncompressed frames
+ *
+ * A frame is split into horizontal bands. The bands are converted on a
+ * persistent pool of threads, and the calling thread takes bands too.
+ * Each band is passed to the ordinary converter as a frame of its own
+ * that shares the step of the whole frame, so the stride handling of
+ * the converters applies unchanged.
+ */
+
+#define LOG_TAG "libuvc/slice"
+#ifndef LOG_NDEBUG
+	#define	LOG_NDEBUG
+#endif
+#undef USE_LOGALL
+
+#include <unistd.h>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#define MAX_CONVERT_THREADS 8
+// smaller frames are converted on the calling thread, the hand-off costs more than it saves
+#define MIN_SLICE_PIXELS (1280 * 720)
+#define MIN_SLICE_ROWS 16
+
+typedef struct _uvc_slice_pool {
+	/** only one frame is converted by the pool at a time, the others go without it */
+	pthread_mutex_t job_lock;
+	pthread_mutex_t mutex;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+	/** number of worker threads to use, set by uvc_set_convert_threads */
+	int request_workers;
+	int num_workers;
+	pthread_t workers[MAX_CONVERT_THREADS];
+	int running;
+	/** incremented for each frame, the workers wait for a change */
+	uint32_t generation;
+	// current frame, guarded by mutex
+	uvc_convert_func_t convert;
+	uvc_frame_t *in;
+	uvc_frame_t *out;
+	int band_rows;
+	int num_bands;
+	int next_band;
+	int done_bands;
+	uvc_error_t result;
+} _uvc_slice_pool_t;
+
+static _uvc_slice_pool_t pool = {
+	.job_lock = PTHREAD_MUTEX_INITIALIZER,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.start_cond = PTHREAD_COND_INITIALIZER,
+	.done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/** @internal
+ * @brief convert a band as a frame that shares data and step with the whole frame
+ */
+static uvc_error_t _uvc_convert_band(_uvc_slice_pool_t *p, const int band) {
+	const int y = band * p->band_rows;
+	int rows = p->in->height - y;
+	if (rows > p->band_rows)
+		rows = p->band_rows;
+	const size_t in_offset = p->in->step * y;
+	const size_t out_offset = p->out->step * y;
+	if (UNLIKELY((rows <= 0) || (in_offset >= p->in->data_bytes) || (out_offset >= p->out->data_bytes)))
+		return UVC_SUCCESS;
+
+	uvc_frame_t in = *p->in;
+	uvc_frame_t out = *p->out;
+	in.data = (uint8_t *)p->in->data + in_offset;
+	in.data_bytes = p->in->step * rows;
+	if (in.data_bytes > p->in->data_bytes - in_offset)
+		in.data_bytes = p->in->data_bytes - in_offset;
+	in.actual_bytes = in.data_bytes;
+	in.height = rows;
+	out.data = (uint8_t *)p->out->data + out_offset;
+	out.data_bytes = p->out->step * rows;
+	if (out.data_bytes > p->out->data_bytes - out_offset)
+		out.data_bytes = p->out->data_bytes - out_offset;
+	out.actual_bytes = out.data_bytes;
+	out.height = rows;
+	out.library_owns_data = 0;	// never reallocate the part of the frame
+
+	return p->convert(&in, &out);
+}
+
+/** @internal
+ * @brief take and convert bands until no band is left, call with mutex locked
+ */
+static void _uvc_slice_run(_uvc_slice_pool_t *p) {
+	for (; p->next_band < p->num_bands ;) {
+		const int band = p->next_band++;
+		pthread_mutex_unlock(&p->mutex);
+		const uvc_error_t result = _uvc_convert_band(p, band);
+		pthread_mutex_lock(&p->mutex);
+		if (UNLIKELY(result) && !p->result)
+			p->result = result;
+		if (++p->done_bands == p->num_bands)
+			pthread_cond_signal(&p->done_cond);
+	}
+}
+
+static void *_uvc_slice_worker(void *arg) {
+	_uvc_slice_pool_t *p = (_uvc_slice_pool_t *)arg;
+
+	pthread_mutex_lock(&p->mutex);
+	uint32_t generation = p->generation;
+	for (; p->running ;) {
+		if (p->generation == generation) {
+			pthread_cond_wait(&p->start_cond, &p->mutex);
+			continue;
+		}
+		generation = p->generation;
+		_uvc_slice_run(p);
+	}
+	pthread_mutex_unlock(&p->mutex);
+	return NULL;
+}
+
+/** @internal
+ * @brief start the workers if not yet, call with job_lock locked
+ */
+static void _uvc_slice_start_workers(_uvc_slice_pool_t *p) {
+	int i;
+
+	pthread_mutex_lock(&p->mutex);
+	p->running = 1;
+	pthread_mutex_unlock(&p->mutex);
+	for (i = p->num_workers; i < p->request_workers; i++) {
+		if (UNLIKELY(pthread_create(&p->workers[p->num_workers], NULL, _uvc_slice_worker, p))) {
+			LOGW("failed to create conversion thread");
+			break;
+		}
+		p->num_workers++;
+	}
+	LOGI("conversion threads=%d", p->num_workers + 1);
+}
+
+/** @internal
+ * @brief stop and join the workers, call with job_lock locked
+ */
+static void _uvc_slice_stop_workers(_uvc_slice_pool_t *p) {
+	int i;
+
+	pthread_mutex_lock(&p->mutex);
+	p->running = 0;
+	pthread_cond_broadcast(&p->start_cond);
+	pthread_mutex_unlock(&p->mutex);
+	for (i = 0; i < p->num_workers; i++) {
+		pthread_join(p->workers[i], NULL);
+	}
+	p->num_workers = 0;
+}
+
+/** @brief XXX Set the number of threads to convert a large uncompressed frame
+ * @ingroup frame
+ *
+ * uvc_any2rgb, uvc_any2bgr, uvc_any2rgb565 and uvc_any2rgbx split frames of 720p
+ * or larger into horizontal bands and convert them in parallel.
+ * The threads are created on the first conversion and kept until this is called again.
+ * When the threads are busy with another frame, the frame is converted on the calling thread.
+ *
+ * @param num_threads number of threads including the calling thread,
+ *        1: no parallel conversion(default), 0: number of cpu cores
+ */
+uvc_error_t uvc_set_convert_threads(int num_threads) {
+	if (UNLIKELY(num_threads < 0))
+		return UVC_ERROR_INVALID_PARAM;
+	if (!num_threads)
+		num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads > MAX_CONVERT_THREADS + 1)
+		num_threads = MAX_CONVERT_THREADS + 1;
+
+	pthread_mutex_lock(&pool.job_lock);
+	{
+		_uvc_slice_stop_workers(&pool);
+		// the calling thread converts bands too
+		pool.request_workers = num_threads > 1 ? num_threads - 1 : 0;
+	}
+	pthread_mutex_unlock(&pool.job_lock);
+
+	return UVC_SUCCESS;
+}
+
+/** @internal
+ * @brief XXX convert a frame with convert, in parallel if the frame is large enough
+ * @param out_pixel_bytes bytes per pixel of the output format
+ * @param frame_format output format
+ */
+uvc_error_t uvc_convert_sliced(uvc_convert_func_t convert, uvc_frame_t *in, uvc_frame_t *out,
+	const size_t out_pixel_bytes, const enum uvc_frame_format frame_format) {
+
+	if (LIKELY(!pool.request_workers)
+		|| (in->width * in->height < MIN_SLICE_PIXELS)
+		|| !in->step
+		|| pthread_mutex_trylock(&pool.job_lock)) {
+
+		return convert(in, out);
+	}
+
+	uvc_error_t result;
+	if (UNLIKELY(pool.num_workers < pool.request_workers) && !pool.running) {
+		_uvc_slice_start_workers(&pool);
+	}
+	// set up the whole output frame as the converters do
+	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * out_pixel_bytes) < 0)) {
+		result = UVC_ERROR_NO_MEM;
+		goto done;
+	}
+	if (out->library_owns_data)
+		out->step = in->width * out_pixel_bytes;
+	if (UNLIKELY(!pool.num_workers || !out->step)) {
+		result = convert(in, out);
+		goto done;
+	}
+	out->width = in->width;
+	out->height = in->height;
+	out->frame_format = frame_format;
+	out->sequence = in->sequence;
+	out->capture_time = in->capture_time;
+	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
+
+	const int num_threads = pool.num_workers + 1;
+	int band_rows = ((in->height + num_threads - 1) / num_threads + 1) & ~1;
+	if (band_rows < MIN_SLICE_ROWS)
+		band_rows = MIN_SLICE_ROWS;
+
+	pthread_mutex_lock(&pool.mutex);
+	{
+		pool.convert = convert;
+		pool.in = in;
+		pool.out = out;
+		pool.band_rows = band_rows;
+		pool.num_bands = (in->height + band_rows - 1) / band_rows;
+		pool.next_band = pool.done_bands = 0;
+		pool.result = UVC_SUCCESS;
+		pool.generation++;
+		pthread_cond_broadcast(&pool.start_cond);
+		_uvc_slice_run(&pool);
+		for (; pool.done_bands < pool.num_bands ;) {
+			pthread_cond_wait(&pool.done_cond, &pool.mutex);
+		}
+		result = pool.result;
+	}
+	pthread_mutex_unlock(&pool.mutex);
+done:
+	pthread_mutex_unlock(&pool.job_lock);
+	return result;
+}
@@ -0,0 +1,383 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/** @internal
+ * @file
+ * @brief SSE2/AVX2 kernels of the YUYV/UYVY color conversion
+ *
+ * Same integer arithmetic as the IYUYV2RGB_2 etc. macros of frame.c,
+ * r = (cr * (v - 128)) >> 14 etc. are computed in 32 bits with pmaddwd,
+ * y = ((y - offset) * gain) >> 14 with pmulhw, and the saturation of sat()
+ * is done by packuswb, so the result is bit exact with the lookup tables
+ * of the scalar code. The coefficients come from uvc_color_table_t and
+ * are loaded into registers once per row.
+ * The AVX2 kernels are compiled with the target attribute and only called
+ * when the cpu supports AVX2.
+ */
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+/** @internal
+ * @brief coefficients of a color table as SSE2 constants.
+ * The chroma ones are pairs for pmaddwd on (u - 128, v - 128) */
+typedef struct _uvc_coefs_sse2 {
+	__m128i y_offset;
+	__m128i y_gain;
+	__m128i cr[2];
+	__m128i cg;
+	__m128i cb[2];
+} _uvc_coefs_sse2_t;
+
+static inline void _uvc_load_coefs_sse2(const uvc_color_table_t *color, _uvc_coefs_sse2_t *k) {
+	k->y_offset = _mm_set1_epi16(color->y_offset);
+	k->y_gain = _mm_set1_epi16(color->y_gain);
+	k->cr[0] = _mm_set1_epi32((int) ((uint32_t) (uint16_t) color->cr_v[0] << 16));
+	k->cr[1] = _mm_set1_epi32((int) ((uint32_t) (uint16_t) color->cr_v[1] << 16));
+	k->cg = _mm_set1_epi32((int) (((uint32_t) (uint16_t) color->cg_v << 16) | (uint16_t) color->cg_u));
+	k->cb[0] = _mm_set1_epi32((uint16_t) color->cb_u[0]);
+	k->cb[1] = _mm_set1_epi32((uint16_t) color->cb_u[1]);
+}
+
+/** @internal
+ * @brief (c * (k0 + k1)) >> 14 of 8 pixels from two chroma pairs, as 16 bit values of each pixel pair */
+static inline __m128i _uvc_chroma_sse2(const __m128i c0, const __m128i c1, const __m128i k0, const __m128i k1) {
+	return _mm_packs_epi32(
+		_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(c0, k0), _mm_madd_epi16(c0, k1)), 14),
+		_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(c1, k0), _mm_madd_epi16(c1, k1)), 14));
+}
+
+/** @internal
+ * @brief r, g, b of 16 YUYV/UYVY pixels (32 bytes) */
+static inline void _uvc_yuv422_sse2(const uint8_t *src, const int uyvy,
+	const _uvc_coefs_sse2_t *k, __m128i *r, __m128i *g, __m128i *b) {
+
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i s0 = _mm_loadu_si128((const __m128i *)src);
+	const __m128i s1 = _mm_loadu_si128((const __m128i *)(src + 16));
+	__m128i y0, y1, c0, c1, t;
+
+	if (uyvy) {
+		y0 = _mm_srli_epi16(s0, 8);
+		y1 = _mm_srli_epi16(s1, 8);
+		c0 = _mm_and_si128(s0, mask);
+		c1 = _mm_and_si128(s1, mask);
+	} else {
+		y0 = _mm_and_si128(s0, mask);
+		y1 = _mm_and_si128(s1, mask);
+		c0 = _mm_srli_epi16(s0, 8);
+		c1 = _mm_srli_epi16(s1, 8);
+	}
+	// ((y - offset) * gain) >> 14, (y - offset) << 2 fits in 16 bits
+	y0 = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(y0, k->y_offset), 2), k->y_gain);
+	y1 = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(y1, k->y_offset), 2), k->y_gain);
+	// (u - 128, v - 128) of each pixel pair
+	c0 = _mm_sub_epi16(c0, c128);
+	c1 = _mm_sub_epi16(c1, c128);
+
+	t = _uvc_chroma_sse2(c0, c1, k->cr[0], k->cr[1]);
+	*r = _mm_packus_epi16(
+		_mm_add_epi16(y0, _mm_unpacklo_epi16(t, t)),
+		_mm_add_epi16(y1, _mm_unpackhi_epi16(t, t)));
+	t = _mm_packs_epi32(
+		_mm_srai_epi32(_mm_madd_epi16(c0, k->cg), 14),
+		_mm_srai_epi32(_mm_madd_epi16(c1, k->cg), 14));
+	*g = _mm_packus_epi16(
+		_mm_add_epi16(y0, _mm_unpacklo_epi16(t, t)),
+		_mm_add_epi16(y1, _mm_unpackhi_epi16(t, t)));
+	t = _uvc_chroma_sse2(c0, c1, k->cb[0], k->cb[1]);
+	*b = _mm_packus_epi16(
+		_mm_add_epi16(y0, _mm_unpacklo_epi16(t, t)),
+		_mm_add_epi16(y1, _mm_unpackhi_epi16(t, t)));
+}
+
+static inline void _uvc_store_rgbx_sse2(uint8_t *dst, __m128i r, __m128i g, __m128i b) {
+	const __m128i x = _mm_set1_epi8((char) 0xff);
+	const __m128i rg0 = _mm_unpacklo_epi8(r, g);
+	const __m128i rg1 = _mm_unpackhi_epi8(r, g);
+	const __m128i bx0 = _mm_unpacklo_epi8(b, x);
+	const __m128i bx1 = _mm_unpackhi_epi8(b, x);
+	_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(rg0, bx0));
+	_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(rg0, bx0));
+	_mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(rg1, bx1));
+	_mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(rg1, bx1));
+}
+
+/* SSE2 has no byte shuffle, write 3 bytes of the RGBX pixels */
+static inline void _uvc_store_rgb_sse2(uint8_t *dst, __m128i r, __m128i g, __m128i b) {
+	uint8_t tmp[64] __attribute__((aligned(16)));
+	int i;
+
+	_uvc_store_rgbx_sse2(tmp, r, g, b);
+	for (i = 0; i < 16; i++) {
+		dst[i * 3 + 0] = tmp[i * 4 + 0];
+		dst[i * 3 + 1] = tmp[i * 4 + 1];
+		dst[i * 3 + 2] = tmp[i * 4 + 2];
+	}
+}
+
+static inline void _uvc_store_bgr_sse2(uint8_t *dst, __m128i r, __m128i g, __m128i b) {
+	_uvc_store_rgb_sse2(dst, b, g, r);
+}
+
+static inline __m128i _uvc_rgb565_sse2(__m128i r, __m128i g, __m128i b) {
+	const __m128i mr = _mm_set1_epi16(0xf8);
+	const __m128i mg = _mm_set1_epi16(0xfc);
+	return _mm_or_si128(
+		_mm_or_si128(
+			_mm_slli_epi16(_mm_and_si128(r, mr), 8),
+			_mm_slli_epi16(_mm_and_si128(g, mg), 3)),
+		_mm_srli_epi16(b, 3));
+}
+
+static inline void _uvc_store_rgb565_sse2(uint8_t *dst, __m128i r, __m128i g, __m128i b) {
+	const __m128i zero = _mm_setzero_si128();
+	_mm_storeu_si128((__m128i *)dst, _uvc_rgb565_sse2(
+		_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(b, zero)));
+	_mm_storeu_si128((__m128i *)(dst + 16), _uvc_rgb565_sse2(
+		_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(b, zero)));
+}
+
+#define DEFINE_KERNEL_SSE2(name, uyvy, store, pixel_bytes) \
+static int name##_sse2(const uint8_t *src, uint8_t *dst, int pixels, \
+	const uvc_color_table_t *color) { \
+	_uvc_coefs_sse2_t k; \
+	__m128i r, g, b; \
+	int i; \
+	_uvc_load_coefs_sse2(color, &k); \
+	for (i = 0; i + 16 <= pixels; i += 16) { \
+		_uvc_yuv422_sse2(src, uyvy, &k, &r, &g, &b); \
+		store(dst, r, g, b); \
+		src += 32; \
+		dst += 16 * pixel_bytes; \
+	} \
+	return i; \
+}
+
+DEFINE_KERNEL_SSE2(yuyv2rgbx, 0, _uvc_store_rgbx_sse2, 4)
+DEFINE_KERNEL_SSE2(yuyv2rgb, 0, _uvc_store_rgb_sse2, 3)
+DEFINE_KERNEL_SSE2(yuyv2bgr, 0, _uvc_store_bgr_sse2, 3)
+DEFINE_KERNEL_SSE2(yuyv2rgb565, 0, _uvc_store_rgb565_sse2, 2)
+DEFINE_KERNEL_SSE2(uyvy2rgbx, 1, _uvc_store_rgbx_sse2, 4)
+DEFINE_KERNEL_SSE2(uyvy2rgb, 1, _uvc_store_rgb_sse2, 3)
+DEFINE_KERNEL_SSE2(uyvy2bgr, 1, _uvc_store_bgr_sse2, 3)
+DEFINE_KERNEL_SSE2(uyvy2rgb565, 1, _uvc_store_rgb565_sse2, 2)
+
+static inline int _uvc_yuyv2yuv420sp_sse2(const uint8_t *src, int src_step,
+	uint8_t *y, int y_step, uint8_t *uv, int pixels, const int swap_uv) {
+
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	int i;
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		const __m128i s0 = _mm_loadu_si128((const __m128i *)src);
+		const __m128i s1 = _mm_loadu_si128((const __m128i *)(src + 16));
+		const __m128i s2 = _mm_loadu_si128((const __m128i *)(src + src_step));
+		const __m128i s3 = _mm_loadu_si128((const __m128i *)(src + src_step + 16));
+		__m128i c = _mm_packus_epi16(_mm_srli_epi16(s0, 8), _mm_srli_epi16(s1, 8));
+		if (swap_uv)
+			c = _mm_or_si128(_mm_slli_epi16(c, 8), _mm_srli_epi16(c, 8));
+		_mm_storeu_si128((__m128i *)y,
+			_mm_packus_epi16(_mm_and_si128(s0, mask), _mm_and_si128(s1, mask)));
+		_mm_storeu_si128((__m128i *)(y + y_step),
+			_mm_packus_epi16(_mm_and_si128(s2, mask), _mm_and_si128(s3, mask)));
+		_mm_storeu_si128((__m128i *)uv, c);
+		src += 32;
+		y += 16;
+		uv += 16;
+	}
+	return i;
+}
+
+static int yuyv2yuv420sp_sse2(const uint8_t *src, int src_step,
+	uint8_t *y, int y_step, uint8_t *uv, int pixels) {
+	return _uvc_yuyv2yuv420sp_sse2(src, src_step, y, y_step, uv, pixels, 0);
+}
+
+static int yuyv2iyuv420sp_sse2(const uint8_t *src, int src_step,
+	uint8_t *y, int y_step, uint8_t *uv, int pixels) {
+	return _uvc_yuyv2yuv420sp_sse2(src, src_step, y, y_step, uv, pixels, 1);
+}
+
+/** @internal
+ * @brief coefficients of a color table as AVX2 constants, same layout as _uvc_coefs_sse2_t */
+typedef struct _uvc_coefs_avx2 {
+	__m256i y_offset;
+	__m256i y_gain;
+	__m256i cr[2];
+	__m256i cg;
+	__m256i cb[2];
+} _uvc_coefs_avx2_t;
+
+static inline AVX2 void _uvc_load_coefs_avx2(const uvc_color_table_t *color, _uvc_coefs_avx2_t *k) {
+	k->y_offset = _mm256_set1_epi16(color->y_offset);
+	k->y_gain = _mm256_set1_epi16(color->y_gain);
+	k->cr[0] = _mm256_set1_epi32((int) ((uint32_t) (uint16_t) color->cr_v[0] << 16));
+	k->cr[1] = _mm256_set1_epi32((int) ((uint32_t) (uint16_t) color->cr_v[1] << 16));
+	k->cg = _mm256_set1_epi32((int) (((uint32_t) (uint16_t) color->cg_v << 16) | (uint16_t) color->cg_u));
+	k->cb[0] = _mm256_set1_epi32((uint16_t) color->cb_u[0]);
+	k->cb[1] = _mm256_set1_epi32((uint16_t) color->cb_u[1]);
+}
+
+static inline AVX2 __m256i _uvc_chroma_avx2(const __m256i c0, const __m256i c1, const __m256i k0, const __m256i k1) {
+	return _mm256_packs_epi32(
+		_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(c0, k0), _mm256_madd_epi16(c0, k1)), 14),
+		_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(c1, k0), _mm256_madd_epi16(c1, k1)), 14));
+}
+
+/** @internal
+ * @brief r, g, b of 32 YUYV/UYVY pixels (64 bytes).
+ * Each 128 bit lane works like _uvc_yuv422_sse2, so the result is
+ * pixels 0-7 and 16-23 in the low lane and pixels 8-15 and 24-31 in the high lane */
+static inline AVX2 void _uvc_yuv422_avx2(const uint8_t *src, const int uyvy,
+	const _uvc_coefs_avx2_t *k, __m256i *r, __m256i *g, __m256i *b) {
+
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	const __m256i c128 = _mm256_set1_epi16(128);
+	const __m256i s0 = _mm256_loadu_si256((const __m256i *)src);
+	const __m256i s1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+	__m256i y0, y1, c0, c1, t;
+
+	if (uyvy) {
+		y0 = _mm256_srli_epi16(s0, 8);
+		y1 = _mm256_srli_epi16(s1, 8);
+		c0 = _mm256_and_si256(s0, mask);
+		c1 = _mm256_and_si256(s1, mask);
+	} else {
+		y0 = _mm256_and_si256(s0, mask);
+		y1 = _mm256_and_si256(s1, mask);
+		c0 = _mm256_srli_epi16(s0, 8);
+		c1 = _mm256_srli_epi16(s1, 8);
+	}
+	y0 = _mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y0, k->y_offset), 2), k->y_gain);
+	y1 = _mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y1, k->y_offset), 2), k->y_gain);
+	c0 = _mm256_sub_epi16(c0, c128);
+	c1 = _mm256_sub_epi16(c1, c128);
+
+	t = _uvc_chroma_avx2(c0, c1, k->cr[0], k->cr[1]);
+	*r = _mm256_packus_epi16(
+		_mm256_add_epi16(y0, _mm256_unpacklo_epi16(t, t)),
+		_mm256_add_epi16(y1, _mm256_unpackhi_epi16(t, t)));
+	t = _mm256_packs_epi32(
+		_mm256_srai_epi32(_mm256_madd_epi16(c0, k->cg), 14),
+		_mm256_srai_epi32(_mm256_madd_epi16(c1, k->cg), 14));
+	*g = _mm256_packus_epi16(
+		_mm256_add_epi16(y0, _mm256_unpacklo_epi16(t, t)),
+		_mm256_add_epi16(y1, _mm256_unpackhi_epi16(t, t)));
+	t = _uvc_chroma_avx2(c0, c1, k->cb[0], k->cb[1]);
+	*b = _mm256_packus_epi16(
+		_mm256_add_epi16(y0, _mm256_unpacklo_epi16(t, t)),
+		_mm256_add_epi16(y1, _mm256_unpackhi_epi16(t, t)));
+}
+
+static inline AVX2 void _uvc_store_rgbx_avx2(uint8_t *dst, __m256i r, __m256i g, __m256i b) {
+	const __m256i x = _mm256_set1_epi8((char) 0xff);
+	const __m256i rg0 = _mm256_unpacklo_epi8(r, g);	// pixels 0-7 | 8-15
+	const __m256i rg1 = _mm256_unpackhi_epi8(r, g);	// pixels 16-23 | 24-31
+	const __m256i bx0 = _mm256_unpacklo_epi8(b, x);
+	const __m256i bx1 = _mm256_unpackhi_epi8(b, x);
+	__m256i q0 = _mm256_unpacklo_epi16(rg0, bx0);	// pixels 0-3 | 8-11
+	__m256i q1 = _mm256_unpackhi_epi16(rg0, bx0);	// pixels 4-7 | 12-15
+	_mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(q0, q1, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(q0, q1, 0x31));
+	q0 = _mm256_unpacklo_epi16(rg1, bx1);
+	q1 = _mm256_unpackhi_epi16(rg1, bx1);
+	_mm256_storeu_si256((__m256i *)(dst + 64), _mm256_permute2x128_si256(q0, q1, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 96), _mm256_permute2x128_si256(q0, q1, 0x31));
+}
+
+static inline AVX2 __m256i _uvc_rgb565_avx2(__m256i r, __m256i g, __m256i b) {
+	const __m256i mr = _mm256_set1_epi16(0xf8);
+	const __m256i mg = _mm256_set1_epi16(0xfc);
+	return _mm256_or_si256(
+		_mm256_or_si256(
+			_mm256_slli_epi16(_mm256_and_si256(r, mr), 8),
+			_mm256_slli_epi16(_mm256_and_si256(g, mg), 3)),
+		_mm256_srli_epi16(b, 3));
+}
+
+static inline AVX2 void _uvc_store_rgb565_avx2(uint8_t *dst, __m256i r, __m256i g, __m256i b) {
+	const __m256i zero = _mm256_setzero_si256();
+	// unpack puts pixels 0-15 and 16-31 back in order
+	_mm256_storeu_si256((__m256i *)dst, _uvc_rgb565_avx2(
+		_mm256_unpacklo_epi8(r, zero), _mm256_unpacklo_epi8(g, zero), _mm256_unpacklo_epi8(b, zero)));
+	_mm256_storeu_si256((__m256i *)(dst + 32), _uvc_rgb565_avx2(
+		_mm256_unpackhi_epi8(r, zero), _mm256_unpackhi_epi8(g, zero), _mm256_unpackhi_epi8(b, zero)));
+}
+
+#define DEFINE_KERNEL_AVX2(name, uyvy, store, pixel_bytes) \
+static AVX2 int name##_avx2(const uint8_t *src, uint8_t *dst, int pixels, \
+	const uvc_color_table_t *color) { \
+	_uvc_coefs_avx2_t k; \
+	__m256i r, g, b; \
+	int i; \
+	_uvc_load_coefs_avx2(color, &k); \
+	for (i = 0; i + 32 <= pixels; i += 32) { \
+		_uvc_yuv422_avx2(src, uyvy, &k, &r, &g, &b); \
+		store(dst, r, g, b); \
+		src += 64; \
+		dst += 32 * pixel_bytes; \
+	} \
+	return i + name##_sse2(src, dst, pixels - i, color); \
+}
+
+DEFINE_KERNEL_AVX2(yuyv2rgbx, 0, _uvc_store_rgbx_avx2, 4)
+DEFINE_KERNEL_AVX2(yuyv2rgb565, 0, _uvc_store_rgb565_avx2, 2)
+DEFINE_KERNEL_AVX2(uyvy2rgbx, 1, _uvc_store_rgbx_avx2, 4)
+DEFINE_KERNEL_AVX2(uyvy2rgb565, 1, _uvc_store_rgb565_avx2, 2)
+
+/** @internal
+ * @brief Set the SSE2 kernels, and the AVX2 ones for RGBX/RGB565 if @a avx2.
+ * RGB/BGR and YUV420SP are bound by the stores and stay on SSE2.
+ */
+void uvc_init_convert_kernels_sse2(uvc_convert_kernels_t *kernels, int avx2) {
+	kernels->name = avx2 ? "avx2" : "sse2";
+	kernels->yuyv2rgbx = avx2 ? yuyv2rgbx_avx2 : yuyv2rgbx_sse2;
+	kernels->yuyv2rgb = yuyv2rgb_sse2;
+	kernels->yuyv2bgr = yuyv2bgr_sse2;
+	kernels->yuyv2rgb565 = avx2 ? yuyv2rgb565_avx2 : yuyv2rgb565_sse2;
+	kernels->uyvy2rgbx = avx2 ? uyvy2rgbx_avx2 : uyvy2rgbx_sse2;
+	kernels->uyvy2rgb = uyvy2rgb_sse2;
+	kernels->uyvy2bgr = uyvy2bgr_sse2;
+	kernels->uyvy2rgb565 = avx2 ? uyvy2rgb565_avx2 : uyvy2rgb565_sse2;
+	kernels->yuyv2yuv420sp = yuyv2yuv420sp_sse2;
+	kernels->yuyv2iyuv420sp = yuyv2iyuv420sp_sse2;
+}
+
+#endif	// defined(__SSE2__)
@@ -55,12 +55,17 @@
 /** @internal */
 uvc_error_t uvc_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes) {
 	if LIKELY(frame->library_owns_data) {
-		if UNLIKELY(!frame->data || frame->data_bytes != need_bytes) {
-			frame->actual_bytes = frame->data_bytes = need_bytes;	// XXX
-			frame->data = realloc(frame->data, frame->data_bytes);
+		if (UNLIKELY(!need_bytes))
+			return UVC_ERROR_NO_MEM;
+		// XXX grow only, keep the buffer (e.g. a pooled one) while the frame fits in it
+		if UNLIKELY(!frame->data || frame->alloc_bytes < need_bytes) {
+			frame->data = realloc(frame->data, need_bytes);
+			frame->alloc_bytes = frame->data ? need_bytes : 0;
 		}
-		if (UNLIKELY(!frame->data || !need_bytes))
+		if (UNLIKELY(!frame->data))
 			return UVC_ERROR_NO_MEM;
+		if (frame->data_bytes != need_bytes)
+			frame->actual_bytes = frame->data_bytes = need_bytes;	// XXX
 		return UVC_SUCCESS;
 	} else {
 		if (UNLIKELY(!frame->data || frame->data_bytes < need_bytes))
@@ -87,10 +92,15 @@ uvc_frame_t *uvc_allocate_frame(size_t data_bytes) {
 	memset(frame, 0, sizeof(*frame));	// bzero(frame, sizeof(*frame)); // bzero is deprecated
 #endif
 //	frame->library_owns_data = 1;	// XXX moved to lower
+	frame->color_matrix = UVC_COLOR_MATRIX_BT601;
+	frame->color_range = UVC_COLOR_RANGE_FULL;
+	frame->ref_count = 1;
+	frame->alloc_bytes = 0;
+	memset(frame->stage_ns, 0, sizeof(frame->stage_ns));
 
 	if (LIKELY(data_bytes > 0)) {
 		frame->library_owns_data = 1;
-		frame->actual_bytes = frame->data_bytes = data_bytes;	// XXX
+		frame->actual_bytes = frame->data_bytes = frame->alloc_bytes = data_bytes;	// XXX
 		frame->data = malloc(data_bytes);
 
 		if (UNLIKELY(!frame->data)) {
@@ -136,6 +146,9 @@ uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
+	memcpy(out->stage_ns, in->stage_ns, sizeof(out->stage_ns));	// XXX
 	out->actual_bytes = in->actual_bytes;	// XXX
 
 #if USE_STRIDE	 // XXX
@@ -202,6 +215,27 @@ uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out) {
 #define PIXEL16_BGR			PIXEL_BGR * 16
 #define PIXEL16_RGBX		PIXEL_RGBX * 16
 
+/** @internal
+ * @brief XXX number of pixels the 8 pixel loops below would convert from src/dst
+ * before reaching src_end/dst_end, also limited to max_pixels unless it is negative.
+ * The SIMD kernels never write more than the scalar loops do.
+ */
+static inline int _uvc_row_pixels(
+		const uint8_t *src, const uint8_t *src_end, const int src_bytes8,
+		const uint8_t *dst, const uint8_t *dst_end, const int dst_bytes8,
+		const int max_pixels) {
+
+	if ((src > src_end) || (dst > dst_end))
+		return 0;
+	int blocks = (src_end - src) / src_bytes8 + 1;
+	const int dst_blocks = (dst_end - dst) / dst_bytes8 + 1;
+	if (dst_blocks < blocks)
+		blocks = dst_blocks;
+	if ((max_pixels >= 0) && ((max_pixels + 7) / 8 < blocks))
+		blocks = (max_pixels + 7) / 8;
+	return blocks * 8;
+}
+
 #define RGB2RGBX_2(prgb, prgbx, ax, bx) { \
 		(prgbx)[bx+0] = (prgb)[ax+0]; \
 		(prgbx)[bx+1] = (prgb)[ax+1]; \
@@ -242,6 +276,8 @@ uvc_error_t uvc_rgb2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *prgb = in->data;
 	const uint8_t *prgb_end = prgb + in->data_bytes - PIXEL8_RGB;
@@ -324,6 +360,8 @@ uvc_error_t uvc_rgb2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *prgb = in->data;
 	const uint8_t *prgb_end = prgb + in->data_bytes - PIXEL8_RGB;
@@ -384,14 +422,14 @@ uvc_error_t uvc_rgb2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 #define IYUYV2RGB_2(pyuv, prgb, ax, bx) { \
 		const int d1 = (pyuv)[ax+1]; \
 		const int d3 = (pyuv)[ax+3]; \
-		const int r = (22987 * (d3/*(pyuv)[ax+3]*/ - 128)) >> 14; \
-		const int g = (-5636 * (d1/*(pyuv)[ax+1]*/ - 128) - 11698 * (d3/*(pyuv)[ax+3]*/ - 128)) >> 14; \
-		const int b = (29049 * (d1/*(pyuv)[ax+1]*/ - 128)) >> 14; \
-		const int y0 = (pyuv)[ax+0]; \
+		const int r = color->r_v[d3]; \
+		const int g = (color->g_u[d1] + color->g_v[d3]) >> 14; \
+		const int b = color->b_u[d1]; \
+		const int y0 = color->y[(pyuv)[ax+0]]; \
 		(prgb)[bx+0] = sat(y0 + r); \
 		(prgb)[bx+1] = sat(y0 + g); \
 		(prgb)[bx+2] = sat(y0 + b); \
-		const int y2 = (pyuv)[ax+2]; \
+		const int y2 = color->y[(pyuv)[ax+2]]; \
 		(prgb)[bx+3] = sat(y2 + r); \
 		(prgb)[bx+4] = sat(y2 + g); \
 		(prgb)[bx+5] = sat(y2 + b); \
@@ -427,11 +465,15 @@ uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *pyuv = in->data;
 	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_YUYV;
 	uint8_t *prgb = out->data;
 	const uint8_t *prgb_end = prgb + out->data_bytes - PIXEL8_RGB;
+	const uvc_convert_row_t convert = uvc_get_convert_kernels()->yuyv2rgb;
+	const uvc_color_table_t *color = uvc_get_color_table(in->color_matrix, in->color_range);
 
 #if USE_STRIDE
 	if (in->step && out->step && (in->step != out->step)) {
@@ -442,6 +484,11 @@ uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 			w = 0;
 			pyuv = in->data + in->step * h;
 			prgb = out->data + out->step * h;
+			if (convert) {
+				w = convert(pyuv, prgb, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, prgb, prgb_end, PIXEL8_RGB, ww), color);
+				pyuv += w * PIXEL_YUYV;
+				prgb += w * PIXEL_RGB;
+			}
 			for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
 				IYUYV2RGB_8(pyuv, prgb, 0, 0);
 
@@ -452,6 +499,11 @@ uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	} else {
 		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
+		if (convert) {
+			const int n = convert(pyuv, prgb, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, prgb, prgb_end, PIXEL8_RGB, -1), color);
+			pyuv += n * PIXEL_YUYV;
+			prgb += n * PIXEL_RGB;
+		}
 		for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) ;) {
 			IYUYV2RGB_8(pyuv, prgb, 0, 0);
 
@@ -461,6 +513,11 @@ uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 	}
 #else
 	// YUYV => RGB888
+	if (convert) {
+		const int n = convert(pyuv, prgb, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, prgb, prgb_end, PIXEL8_RGB, -1), color);
+		pyuv += n * PIXEL_YUYV;
+		prgb += n * PIXEL_RGB;
+	}
 	for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) ;) {
 		IYUYV2RGB_8(pyuv, prgb, 0, 0);
 
@@ -491,11 +548,15 @@ uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *pyuv = in->data;
 	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_YUYV;
 	uint8_t *prgb565 = out->data;
 	const uint8_t *prgb565_end = prgb565 + out->data_bytes - PIXEL8_RGB565;
+	const uvc_convert_row_t convert = uvc_get_convert_kernels()->yuyv2rgb565;
+	const uvc_color_table_t *color = uvc_get_color_table(in->color_matrix, in->color_range);
 
 	uint8_t tmp[PIXEL8_RGB];	// for temporary rgb888 data(8pixel)
 
@@ -508,6 +569,11 @@ uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 			w = 0;
 			pyuv = in->data + in->step * h;
 			prgb565 = out->data + out->step * h;
+			if (convert) {
+				w = convert(pyuv, prgb565, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, prgb565, prgb565_end, PIXEL8_RGB565, ww), color);
+				pyuv += w * PIXEL_YUYV;
+				prgb565 += w * PIXEL_RGB565;
+			}
 			for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
 				IYUYV2RGB_8(pyuv, tmp, 0, 0);
 				RGB2RGB565_8(tmp, prgb565, 0, 0);
@@ -519,6 +585,11 @@ uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	} else {
 		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
+		if (convert) {
+			const int n = convert(pyuv, prgb565, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, prgb565, prgb565_end, PIXEL8_RGB565, -1), color);
+			pyuv += n * PIXEL_YUYV;
+			prgb565 += n * PIXEL_RGB565;
+		}
 		for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) ;) {
 			IYUYV2RGB_8(pyuv, tmp, 0, 0);
 			RGB2RGB565_8(tmp, prgb565, 0, 0);
@@ -529,6 +600,11 @@ uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 	}
 #else
 	// YUYV => RGB565
+	if (convert) {
+		const int n = convert(pyuv, prgb565, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, prgb565, prgb565_end, PIXEL8_RGB565, -1), color);
+		pyuv += n * PIXEL_YUYV;
+		prgb565 += n * PIXEL_RGB565;
+	}
 	for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) ;) {
 		IYUYV2RGB_8(pyuv, tmp, 0, 0);
 		RGB2RGB565_8(tmp, prgb565, 0, 0);
@@ -543,15 +619,15 @@ uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 #define IYUYV2RGBX_2(pyuv, prgbx, ax, bx) { \
 		const int d1 = (pyuv)[ax+1]; \
 		const int d3 = (pyuv)[ax+3]; \
-		const int r = (22987 * (d3/*(pyuv)[ax+3]*/ - 128)) >> 14; \
-		const int g = (-5636 * (d1/*(pyuv)[ax+1]*/ - 128) - 11698 * (d3/*(pyuv)[ax+3]*/ - 128)) >> 14; \
-		const int b = (29049 * (d1/*(pyuv)[ax+1]*/ - 128)) >> 14; \
-		const int y0 = (pyuv)[ax+0]; \
+		const int r = color->r_v[d3]; \
+		const int g = (color->g_u[d1] + color->g_v[d3]) >> 14; \
+		const int b = color->b_u[d1]; \
+		const int y0 = color->y[(pyuv)[ax+0]]; \
 		(prgbx)[bx+0] = sat(y0 + r); \
 		(prgbx)[bx+1] = sat(y0 + g); \
 		(prgbx)[bx+2] = sat(y0 + b); \
 		(prgbx)[bx+3] = 0xff; \
-		const int y2 = (pyuv)[ax+2]; \
+		const int y2 = color->y[(pyuv)[ax+2]]; \
 		(prgbx)[bx+4] = sat(y2 + r); \
 		(prgbx)[bx+5] = sat(y2 + g); \
 		(prgbx)[bx+6] = sat(y2 + b); \
@@ -587,11 +663,15 @@ uvc_error_t uvc_yuyv2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *pyuv = in->data;
 	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_YUYV;
 	uint8_t *prgbx = out->data;
 	const uint8_t *prgbx_end = prgbx + out->data_bytes - PIXEL8_RGBX;
+	const uvc_convert_row_t convert = uvc_get_convert_kernels()->yuyv2rgbx;
+	const uvc_color_table_t *color = uvc_get_color_table(in->color_matrix, in->color_range);
 
 	// YUYV => RGBX8888
 #if USE_STRIDE
@@ -603,6 +683,11 @@ uvc_error_t uvc_yuyv2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 			w = 0;
 			pyuv = in->data + in->step * h;
 			prgbx = out->data + out->step * h;
+			if (convert) {
+				w = convert(pyuv, prgbx, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, prgbx, prgbx_end, PIXEL8_RGBX, ww), color);
+				pyuv += w * PIXEL_YUYV;
+				prgbx += w * PIXEL_RGBX;
+			}
 			for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
 				IYUYV2RGBX_8(pyuv, prgbx, 0, 0);
 
@@ -613,6 +698,11 @@ uvc_error_t uvc_yuyv2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	} else {
 		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
+		if (convert) {
+			const int n = convert(pyuv, prgbx, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, prgbx, prgbx_end, PIXEL8_RGBX, -1), color);
+			pyuv += n * PIXEL_YUYV;
+			prgbx += n * PIXEL_RGBX;
+		}
 		for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) ;) {
 			IYUYV2RGBX_8(pyuv, prgbx, 0, 0);
 
@@ -621,6 +711,11 @@ uvc_error_t uvc_yuyv2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	}
 #else
+	if (convert) {
+		const int n = convert(pyuv, prgbx, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, prgbx, prgbx_end, PIXEL8_RGBX, -1), color);
+		pyuv += n * PIXEL_YUYV;
+		prgbx += n * PIXEL_RGBX;
+	}
 	for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) ;) {
 		IYUYV2RGBX_8(pyuv, prgbx, 0, 0);
 
@@ -632,16 +727,16 @@ uvc_error_t uvc_yuyv2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 }
 
 #define IYUYV2BGR_2(pyuv, pbgr, ax, bx) { \
-		const int d1 = (pyuv)[1]; \
-		const int d3 = (pyuv)[3]; \
-	    const int r = (22987 * (d3/*(pyuv)[3]*/ - 128)) >> 14; \
-	    const int g = (-5636 * (d1/*(pyuv)[1]*/ - 128) - 11698 * (d3/*(pyuv)[3]*/ - 128)) >> 14; \
-	    const int b = (29049 * (d1/*(pyuv)[1]*/ - 128)) >> 14; \
-		const int y0 = (pyuv)[ax+0]; \
+		const int d1 = (pyuv)[ax+1]; \
+		const int d3 = (pyuv)[ax+3]; \
+	    const int r = color->r_v[d3]; \
+	    const int g = (color->g_u[d1] + color->g_v[d3]) >> 14; \
+	    const int b = color->b_u[d1]; \
+		const int y0 = color->y[(pyuv)[ax+0]]; \
 		(pbgr)[bx+0] = sat(y0 + b); \
 		(pbgr)[bx+1] = sat(y0 + g); \
 		(pbgr)[bx+2] = sat(y0 + r); \
-		const int y2 = (pyuv)[ax+2]; \
+		const int y2 = color->y[(pyuv)[ax+2]]; \
 		(pbgr)[bx+3] = sat(y2 + b); \
 		(pbgr)[bx+4] = sat(y2 + g); \
 		(pbgr)[bx+5] = sat(y2 + r); \
@@ -677,11 +772,15 @@ uvc_error_t uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *pyuv = in->data;
 	uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_YUYV;
 	uint8_t *pbgr = out->data;
 	uint8_t *pbgr_end = pbgr + out->data_bytes - PIXEL8_BGR;
+	const uvc_convert_row_t convert = uvc_get_convert_kernels()->yuyv2bgr;
+	const uvc_color_table_t *color = uvc_get_color_table(in->color_matrix, in->color_range);
 
 	// YUYV => BGR888
 #if USE_STRIDE
@@ -693,6 +792,11 @@ uvc_error_t uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 			w = 0;
 			pyuv = in->data + in->step * h;
 			pbgr = out->data + out->step * h;
+			if (convert) {
+				w = convert(pyuv, pbgr, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, pbgr, pbgr_end, PIXEL8_BGR, ww), color);
+				pyuv += w * PIXEL_YUYV;
+				pbgr += w * PIXEL_BGR;
+			}
 			for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
 				IYUYV2BGR_8(pyuv, pbgr, 0, 0);
 
@@ -703,6 +807,11 @@ uvc_error_t uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	} else {
 		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
+		if (convert) {
+			const int n = convert(pyuv, pbgr, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, pbgr, pbgr_end, PIXEL8_BGR, -1), color);
+			pyuv += n * PIXEL_YUYV;
+			pbgr += n * PIXEL_BGR;
+		}
 		for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) ;) {
 			IYUYV2BGR_8(pyuv, pbgr, 0, 0);
 
@@ -711,6 +820,11 @@ uvc_error_t uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	}
 #else
+	if (convert) {
+		const int n = convert(pyuv, pbgr, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_YUYV, pbgr, pbgr_end, PIXEL8_BGR, -1), color);
+		pyuv += n * PIXEL_YUYV;
+		pbgr += n * PIXEL_BGR;
+	}
 	for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) ;) {
 		IYUYV2BGR_8(pyuv, pbgr, 0, 0);
 
@@ -724,14 +838,14 @@ uvc_error_t uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 #define IUYVY2RGB_2(pyuv, prgb, ax, bx) { \
 		const int d0 = (pyuv)[ax+0]; \
 		const int d2 = (pyuv)[ax+2]; \
-	    const int r = (22987 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int g = (-5636 * (d0/*(pyuv)[ax+0]*/ - 128) - 11698 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int b = (29049 * (d0/*(pyuv)[ax+0]*/ - 128)) >> 14; \
-		const int y1 = (pyuv)[ax+1]; \
+	    const int r = color->r_v[d2]; \
+	    const int g = (color->g_u[d0] + color->g_v[d2]) >> 14; \
+	    const int b = color->b_u[d0]; \
+		const int y1 = color->y[(pyuv)[ax+1]]; \
 		(prgb)[bx+0] = sat(y1 + r); \
 		(prgb)[bx+1] = sat(y1 + g); \
 		(prgb)[bx+2] = sat(y1 + b); \
-		const int y3 = (pyuv)[ax+3]; \
+		const int y3 = color->y[(pyuv)[ax+3]]; \
 		(prgb)[bx+3] = sat(y3 + r); \
 		(prgb)[bx+4] = sat(y3 + g); \
 		(prgb)[bx+5] = sat(y3 + b); \
@@ -766,11 +880,15 @@ uvc_error_t uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *pyuv = in->data;
 	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_UYVY;
 	uint8_t *prgb = out->data;
 	const uint8_t *prgb_end = prgb + out->data_bytes - PIXEL8_RGB;
+	const uvc_convert_row_t convert = uvc_get_convert_kernels()->uyvy2rgb;
+	const uvc_color_table_t *color = uvc_get_color_table(in->color_matrix, in->color_range);
 
 	// UYVY => RGB888
 #if USE_STRIDE
@@ -782,6 +900,11 @@ uvc_error_t uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 			w = 0;
 			pyuv = in->data + in->step * h;
 			prgb = out->data + out->step * h;
+			if (convert) {
+				w = convert(pyuv, prgb, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, prgb, prgb_end, PIXEL8_RGB, ww), color);
+				pyuv += w * PIXEL_UYVY;
+				prgb += w * PIXEL_RGB;
+			}
 			for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
 				IUYVY2RGB_8(pyuv, prgb, 0, 0);
 
@@ -792,6 +915,11 @@ uvc_error_t uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	} else {
 		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
+		if (convert) {
+			const int n = convert(pyuv, prgb, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, prgb, prgb_end, PIXEL8_RGB, -1), color);
+			pyuv += n * PIXEL_UYVY;
+			prgb += n * PIXEL_RGB;
+		}
 		for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) ;) {
 			IUYVY2RGB_8(pyuv, prgb, 0, 0);
 
@@ -800,6 +928,11 @@ uvc_error_t uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	}
 #else
+	if (convert) {
+		const int n = convert(pyuv, prgb, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, prgb, prgb_end, PIXEL8_RGB, -1), color);
+		pyuv += n * PIXEL_UYVY;
+		prgb += n * PIXEL_RGB;
+	}
 	for (; ((prgb <= prgb_end) && (pyuv <= pyuv_end) ;) {
 		IUYVY2RGB_8(pyuv, prgb, 0, 0);
 
@@ -830,11 +963,15 @@ uvc_error_t uvc_uyvy2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *pyuv = in->data;
 	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_UYVY;
 	uint8_t *prgb565 = out->data;
 	const uint8_t *prgb565_end = prgb565 + out->data_bytes - PIXEL8_RGB565;
+	const uvc_convert_row_t convert = uvc_get_convert_kernels()->uyvy2rgb565;
+	const uvc_color_table_t *color = uvc_get_color_table(in->color_matrix, in->color_range);
 
 	uint8_t tmp[PIXEL8_RGB];		// for temporary rgb888 data(8pixel)
 
@@ -848,6 +985,11 @@ uvc_error_t uvc_uyvy2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 			w = 0;
 			pyuv = in->data + in->step * h;
 			prgb565 = out->data + out->step * h;
+			if (convert) {
+				w = convert(pyuv, prgb565, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, prgb565, prgb565_end, PIXEL8_RGB565, ww), color);
+				pyuv += w * PIXEL_UYVY;
+				prgb565 += w * PIXEL_RGB565;
+			}
 			for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
 				IUYVY2RGB_8(pyuv, tmp, 0, 0);
 				RGB2RGB565_8(tmp, prgb565, 0, 0);
@@ -859,6 +1001,11 @@ uvc_error_t uvc_uyvy2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	} else {
 		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
+		if (convert) {
+			const int n = convert(pyuv, prgb565, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, prgb565, prgb565_end, PIXEL8_RGB565, -1), color);
+			pyuv += n * PIXEL_UYVY;
+			prgb565 += n * PIXEL_RGB565;
+		}
 		for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) ;) {
 			IUYVY2RGB_8(pyuv, tmp, 0, 0);
 			RGB2RGB565_8(tmp, prgb565, 0, 0);
@@ -868,6 +1015,11 @@ uvc_error_t uvc_uyvy2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	}
 #else
+	if (convert) {
+		const int n = convert(pyuv, prgb565, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, prgb565, prgb565_end, PIXEL8_RGB565, -1), color);
+		pyuv += n * PIXEL_UYVY;
+		prgb565 += n * PIXEL_RGB565;
+	}
 	for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) ;) {
 		IUYVY2RGB_8(pyuv, tmp, 0, 0);
 		RGB2RGB565_8(tmp, prgb565, 0, 0);
@@ -882,15 +1034,15 @@ uvc_error_t uvc_uyvy2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 #define IUYVY2RGBX_2(pyuv, prgbx, ax, bx) { \
 		const int d0 = (pyuv)[ax+0]; \
 		const int d2 = (pyuv)[ax+2]; \
-	    const int r = (22987 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int g = (-5636 * (d0/*(pyuv)[ax+0]*/ - 128) - 11698 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int b = (29049 * (d0/*(pyuv)[ax+0]*/ - 128)) >> 14; \
-		const int y1 = (pyuv)[ax+1]; \
+	    const int r = color->r_v[d2]; \
+	    const int g = (color->g_u[d0] + color->g_v[d2]) >> 14; \
+	    const int b = color->b_u[d0]; \
+		const int y1 = color->y[(pyuv)[ax+1]]; \
 		(prgbx)[bx+0] = sat(y1 + r); \
 		(prgbx)[bx+1] = sat(y1 + g); \
 		(prgbx)[bx+2] = sat(y1 + b); \
 		(prgbx)[bx+3] = 0xff; \
-		const int y3 = (pyuv)[ax+3]; \
+		const int y3 = color->y[(pyuv)[ax+3]]; \
 		(prgbx)[bx+4] = sat(y3 + r); \
 		(prgbx)[bx+5] = sat(y3 + g); \
 		(prgbx)[bx+6] = sat(y3 + b); \
@@ -926,11 +1078,15 @@ uvc_error_t uvc_uyvy2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *pyuv = in->data;
 	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_UYVY;
 	uint8_t *prgbx = out->data;
 	const uint8_t *prgbx_end = prgbx + out->data_bytes - PIXEL8_RGBX;
+	const uvc_convert_row_t convert = uvc_get_convert_kernels()->uyvy2rgbx;
+	const uvc_color_table_t *color = uvc_get_color_table(in->color_matrix, in->color_range);
 
 	// UYVY => RGBX8888
 #if USE_STRIDE
@@ -942,6 +1098,11 @@ uvc_error_t uvc_uyvy2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 			w = 0;
 			pyuv = in->data + in->step * h;
 			prgbx = out->data + out->step * h;
+			if (convert) {
+				w = convert(pyuv, prgbx, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, prgbx, prgbx_end, PIXEL8_RGBX, ww), color);
+				pyuv += w * PIXEL_UYVY;
+				prgbx += w * PIXEL_RGBX;
+			}
 			for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
 				IUYVY2RGBX_8(pyuv, prgbx, 0, 0);
 
@@ -952,6 +1113,11 @@ uvc_error_t uvc_uyvy2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	} else {
 		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
+		if (convert) {
+			const int n = convert(pyuv, prgbx, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, prgbx, prgbx_end, PIXEL8_RGBX, -1), color);
+			pyuv += n * PIXEL_UYVY;
+			prgbx += n * PIXEL_RGBX;
+		}
 		for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) ;) {
 			IUYVY2RGBX_8(pyuv, prgbx, 0, 0);
 
@@ -960,6 +1126,11 @@ uvc_error_t uvc_uyvy2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	}
 #else
+	if (convert) {
+		const int n = convert(pyuv, prgbx, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, prgbx, prgbx_end, PIXEL8_RGBX, -1), color);
+		pyuv += n * PIXEL_UYVY;
+		prgbx += n * PIXEL_RGBX;
+	}
 	for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) ;) {
 		IUYVY2RGBX_8(pyuv, prgbx, 0, 0);
 
@@ -973,14 +1144,14 @@ uvc_error_t uvc_uyvy2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 #define IUYVY2BGR_2(pyuv, pbgr, ax, bx) { \
 		const int d0 = (pyuv)[ax+0]; \
 		const int d2 = (pyuv)[ax+2]; \
-	    const int r = (22987 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int g = (-5636 * (d0/*(pyuv)[ax+0]*/ - 128) - 11698 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int b = (29049 * (d0/*(pyuv)[ax+0]*/ - 128)) >> 14; \
-		const int y1 = (pyuv)[ax+1]; \
+	    const int r = color->r_v[d2]; \
+	    const int g = (color->g_u[d0] + color->g_v[d2]) >> 14; \
+	    const int b = color->b_u[d0]; \
+		const int y1 = color->y[(pyuv)[ax+1]]; \
 		(pbgr)[bx+0] = sat(y1 + b); \
 		(pbgr)[bx+1] = sat(y1 + g); \
 		(pbgr)[bx+2] = sat(y1 + r); \
-		const int y3 = (pyuv)[ax+3]; \
+		const int y3 = color->y[(pyuv)[ax+3]]; \
 		(pbgr)[bx+3] = sat(y3 + b); \
 		(pbgr)[bx+4] = sat(y3 + g); \
 		(pbgr)[bx+5] = sat(y3 + r); \
@@ -1015,11 +1186,15 @@ uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
+	out->color_matrix = in->color_matrix;
+	out->color_range = in->color_range;
 
 	uint8_t *pyuv = in->data;
 	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_UYVY;
 	uint8_t *pbgr = out->data;
 	const uint8_t *pbgr_end = pbgr + out->data_bytes - PIXEL8_BGR;
+	const uvc_convert_row_t convert = uvc_get_convert_kernels()->uyvy2bgr;
+	const uvc_color_table_t *color = uvc_get_color_table(in->color_matrix, in->color_range);
 
 	// UYVY => BGR888
 #if USE_STRIDE
@@ -1031,6 +1206,11 @@ uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 			w = 0;
 			pyuv = in->data + in->step * h;
 			pbgr = out->data + out->step * h;
+			if (convert) {
+				w = convert(pyuv, pbgr, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, pbgr, pbgr_end, PIXEL8_BGR, ww), color);
+				pyuv += w * PIXEL_UYVY;
+				pbgr += w * PIXEL_BGR;
+			}
 			for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
 				IUYVY2BGR_8(pyuv, pbgr, 0, 0);
 
@@ -1041,6 +1221,11 @@ uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	} else {
 		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
+		if (convert) {
+			const int n = convert(pyuv, pbgr, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, pbgr, pbgr_end, PIXEL8_BGR, -1), color);
+			pyuv += n * PIXEL_UYVY;
+			pbgr += n * PIXEL_BGR;
+		}
 		for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) ;) {
 			IUYVY2BGR_8(pyuv, pbgr, 0, 0);
 
@@ -1049,6 +1234,11 @@ uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 		}
 	}
 #else
+	if (convert) {
+		const int n = convert(pyuv, pbgr, _uvc_row_pixels(pyuv, pyuv_end, PIXEL8_UYVY, pbgr, pbgr_end, PIXEL8_BGR, -1), color);
+		pyuv += n * PIXEL_UYVY;
+		pbgr += n * PIXEL_BGR;
+	}
 	for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) ;) {
 		IUYVY2BGR_8(pyuv, pbgr, 0, 0);
 
@@ -1166,12 +1356,21 @@ uvc_error_t uvc_yuyv2yuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
 
 	const uint32_t hh = src_height < dest_height ? src_height : dest_height;
 	uint8_t *uv = dest + dest_width * dest_height;
+	const uvc_convert_row420sp_t convert = uvc_get_convert_kernels()->yuyv2yuv420sp;
 	int h, w;
 	for (h = 0; h < hh - 1; h += 2) {
 		uint8_t *y0 = dest + width * h;
 		uint8_t *y1 = y0 + width;
 		const uint8_t *yuv = src + src_width * h;
-		for (w = 0; w < width; w += 4) {
+		w = 0;
+		if (convert) {
+			w = convert(yuv, src_width, y0, width, uv, width);
+			y0 += w;
+			y1 += w;
+			uv += w;
+			yuv += w * 2;
+		}
+		for (; w < width; w += 4) {
 			*(y0++) = yuv[0];	// y
 			*(y0++) = yuv[2];	// y'
 			*(y0++) = yuv[4];	// y''
@@ -1211,12 +1410,21 @@ uvc_error_t uvc_yuyv2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
 
 	const uint32_t hh = src_height < dest_height ? src_height : dest_height;
 	uint8_t *uv = dest + dest_width * dest_height;
+	const uvc_convert_row420sp_t convert = uvc_get_convert_kernels()->yuyv2iyuv420sp;
 	int h, w;
 	for (h = 0; h < hh - 1; h += 2) {
 		uint8_t *y0 = dest + width * h;
 		uint8_t *y1 = y0 + width;
 		const uint8_t *yuv = src + src_width * h;
-		for (w = 0; w < width; w += 4) {
+		w = 0;
+		if (convert) {
+			w = convert(yuv, src_width, y0, width, uv, width);
+			y0 += w;
+			y1 += w;
+			uv += w;
+			yuv += w * 2;
+		}
+		for (; w < width; w += 4) {
 			*(y0++) = yuv[0];	// y
 			*(y0++) = yuv[2];	// y'
 			*(y0++) = yuv[4];	// y''
@@ -1250,13 +1458,13 @@ uvc_error_t uvc_any2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 		return uvc_mjpeg2rgb565(in, out);
 #endif
 	case UVC_FRAME_FORMAT_YUYV:
-		return uvc_yuyv2rgb565(in, out);
+		return uvc_convert_sliced(uvc_yuyv2rgb565, in, out, PIXEL_RGB565, UVC_FRAME_FORMAT_RGB565);
 	case UVC_FRAME_FORMAT_UYVY:
-		return uvc_uyvy2rgb565(in, out);
+		return uvc_convert_sliced(uvc_uyvy2rgb565, in, out, PIXEL_RGB565, UVC_FRAME_FORMAT_RGB565);
 	case UVC_FRAME_FORMAT_RGB565:
 		return uvc_duplicate_frame(in, out);
 	case UVC_FRAME_FORMAT_RGB:
-		return uvc_rgb2rgb565(in, out);
+		return uvc_convert_sliced(uvc_rgb2rgb565, in, out, PIXEL_RGB565, UVC_FRAME_FORMAT_RGB565);
 	default:
 		return UVC_ERROR_NOT_SUPPORTED;
 	}
@@ -1276,9 +1484,9 @@ uvc_error_t uvc_any2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 		return uvc_mjpeg2rgb(in, out);
 #endif
 	case UVC_FRAME_FORMAT_YUYV:
-		return uvc_yuyv2rgb(in, out);
+		return uvc_convert_sliced(uvc_yuyv2rgb, in, out, PIXEL_RGB, UVC_FRAME_FORMAT_RGB);
 	case UVC_FRAME_FORMAT_UYVY:
-		return uvc_uyvy2rgb(in, out);
+		return uvc_convert_sliced(uvc_uyvy2rgb, in, out, PIXEL_RGB, UVC_FRAME_FORMAT_RGB);
 	case UVC_FRAME_FORMAT_RGB:
 		return uvc_duplicate_frame(in, out);
 	default:
@@ -1300,9 +1508,9 @@ uvc_error_t uvc_any2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 		return uvc_mjpeg2bgr(in, out);
 #endif
 	case UVC_FRAME_FORMAT_YUYV:
-		return uvc_yuyv2bgr(in, out);
+		return uvc_convert_sliced(uvc_yuyv2bgr, in, out, PIXEL_BGR, UVC_FRAME_FORMAT_BGR);
 	case UVC_FRAME_FORMAT_UYVY:
-		return uvc_uyvy2bgr(in, out);
+		return uvc_convert_sliced(uvc_uyvy2bgr, in, out, PIXEL_BGR, UVC_FRAME_FORMAT_BGR);
 	case UVC_FRAME_FORMAT_BGR:
 		return uvc_duplicate_frame(in, out);
 	default:
@@ -1324,13 +1532,13 @@ uvc_error_t uvc_any2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 		return uvc_mjpeg2rgbx(in, out);
 #endif
 	case UVC_FRAME_FORMAT_YUYV:
-		return uvc_yuyv2rgbx(in, out);
+		return uvc_convert_sliced(uvc_yuyv2rgbx, in, out, PIXEL_RGBX, UVC_FRAME_FORMAT_RGBX);
 	case UVC_FRAME_FORMAT_UYVY:
-		return uvc_uyvy2rgbx(in, out);
+		return uvc_convert_sliced(uvc_uyvy2rgbx, in, out, PIXEL_RGBX, UVC_FRAME_FORMAT_RGBX);
 	case UVC_FRAME_FORMAT_RGBX:
 		return uvc_duplicate_frame(in, out);
 	case UVC_FRAME_FORMAT_RGB:
-		return uvc_rgb2rgbx(in, out);
+		return uvc_convert_sliced(uvc_rgb2rgbx, in, out, PIXEL_RGBX, UVC_FRAME_FORMAT_RGBX);
 	default:
 		return UVC_ERROR_NOT_SUPPORTED;
 	}
@@ -1363,6 +1571,10 @@ uvc_error_t uvc_any2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
  * @param out yuv420sp frame
  */
 uvc_error_t uvc_any2yuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
+#ifdef LIBUVC_HAS_JPEG
+	if (in->frame_format == UVC_FRAME_FORMAT_MJPEG)
+		return uvc_mjpeg2yuv420SP(in, out);	// XXX without YUYV
+#endif
 	uvc_error_t result = UVC_ERROR_NO_MEM;
 	uvc_frame_t *yuv = uvc_allocate_frame((in->width * in->height * 3) / 2);
 	if (yuv) {
@@ -1382,6 +1594,10 @@ uvc_error_t uvc_any2yuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
  * @param out iyuv420SP(NV21) frame
  */
 uvc_error_t uvc_any2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
+#ifdef LIBUVC_HAS_JPEG
+	if (in->frame_format == UVC_FRAME_FORMAT_MJPEG)
+		return uvc_mjpeg2iyuv420SP(in, out);	// XXX without YUYV
+#endif
 	uvc_error_t result = UVC_ERROR_NO_MEM;
 	uvc_frame_t *yuv = uvc_allocate_frame((in->width * in->height * 3) / 2);
 	if (yuv) {
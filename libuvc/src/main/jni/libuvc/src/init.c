@@ -141,8 +141,10 @@ uvc_error_t uvc_init2(uvc_context_t **pctx, struct libusb_context *usb_ctx, cons
 		ctx->usb_ctx = usb_ctx;
 	}
 
-	if (ctx != NULL)
+	if (ctx != NULL) {
+		pthread_mutex_init(&ctx->open_devices_mutex, NULL);	// XXX
 		*pctx = ctx;
+	}
 
 	return ret;
 }
@@ -195,9 +197,69 @@ void uvc_exit(uvc_context_t *ctx) {
 	if (ctx->own_usb_ctx)
 		libusb_exit(ctx->usb_ctx);
 
+	pthread_mutex_destroy(&ctx->open_devices_mutex);	// XXX
 	free(ctx);
 }
 
+/* XXX process wide context shared by cameras, so that all of them are
+ * serviced by one libusb context and one event handler thread */
+static pthread_mutex_t shared_ctx_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uvc_context_t *shared_ctx = NULL;
+static int shared_ctx_refs = 0;
+
+/** @brief Get the process wide UVC context, creating it on first call
+ * @ingroup init
+ *
+ * Each successful call must be paired with #uvc_exit_shared.
+ * usbfs is only used when the context is created.
+ *
+ * @param[out] pctx The location where the context reference should be stored.
+ * @param[in]  usbfs path of usbfs, optional
+ * @return Error opening context or UVC_SUCCESS
+ */
+uvc_error_t uvc_init_shared(uvc_context_t **pctx, const char *usbfs) {
+	uvc_error_t ret = UVC_SUCCESS;
+
+	pthread_mutex_lock(&shared_ctx_mutex);
+	{
+		if (!shared_ctx) {
+			ret = uvc_init2(&shared_ctx, NULL, usbfs);
+			if (UNLIKELY(ret != UVC_SUCCESS))
+				shared_ctx = NULL;
+		}
+		if (LIKELY(shared_ctx)) {
+			shared_ctx_refs++;
+			*pctx = shared_ctx;
+		}
+	}
+	pthread_mutex_unlock(&shared_ctx_mutex);
+
+	return ret;
+}
+
+/** @brief Release the reference to the process wide UVC context
+ * @ingroup init
+ *
+ * The context is closed when the last reference is released,
+ * all devices in it should have been closed before that.
+ *
+ * @param ctx UVC context that #uvc_init_shared returned
+ */
+void uvc_exit_shared(uvc_context_t *ctx) {
+	pthread_mutex_lock(&shared_ctx_mutex);
+	{
+		if (LIKELY(ctx && (ctx == shared_ctx))) {
+			if (!--shared_ctx_refs) {
+				uvc_exit(shared_ctx);
+				shared_ctx = NULL;
+			}
+		} else {
+			LOGW("not a shared context");
+		}
+	}
+	pthread_mutex_unlock(&shared_ctx_mutex);
+}
+
 /**
  * @internal
  * @brief Spawns a handler thread for the context
@@ -208,6 +270,8 @@ void uvc_exit(uvc_context_t *ctx) {
  */
 void uvc_start_handler_thread(uvc_context_t *ctx) {
 	if (ctx->own_usb_ctx) {
+		// XXX the flag remains set if the thread was killed by closing the last device
+		ctx->kill_handler_thread = 0;
 		pthread_create(&ctx->handler_thread, NULL, _uvc_handle_events, (void*) ctx);
 	}
 }
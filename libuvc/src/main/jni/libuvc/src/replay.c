@@ -0,0 +1,101 @@
+#include "libuvc/libuvc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Replays a payload trace recorded with uvc_stream_set_trace() through
+ * the frame assembly of libuvc without the camera, and prints how many
+ * frames were assembled and how fast.
+ *
+ *   uvc_replay [-r] [-d] trace_file
+ *     -r  feed transfers at the recorded timing (frames may be dropped)
+ *     -d  also decode MJPEG frames to RGB
+ */
+
+typedef struct replay_result {
+	int decode;
+	uint32_t frames;
+	uint32_t empty_frames;
+	uint32_t sequence_gaps;
+	uint32_t decode_errors;
+	uint32_t last_sequence;
+	uint64_t bytes;
+	uvc_frame_t *rgb;
+} replay_result_t;
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void cb(uvc_frame_t *frame, void *ptr) {
+	replay_result_t *result = (replay_result_t *) ptr;
+
+	if (result->frames && frame->sequence != result->last_sequence + 1)
+		result->sequence_gaps++;
+	result->last_sequence = frame->sequence;
+	result->frames++;
+	result->bytes += frame->actual_bytes;
+	if (!frame->actual_bytes) {
+		result->empty_frames++;
+		return;
+	}
+
+#ifdef LIBUVC_HAS_JPEG
+	if (result->decode && frame->frame_format == UVC_FRAME_FORMAT_MJPEG) {
+		if (!result->rgb)
+			result->rgb = uvc_allocate_frame(frame->width * frame->height * 3);
+		if (!result->rgb || uvc_mjpeg2rgb(frame, result->rgb))
+			result->decode_errors++;
+	}
+#endif
+}
+
+int main(int argc, char **argv) {
+	replay_result_t result;
+	uvc_stream_stats_t stats;
+	const char *path = NULL;
+	int flags = 0;
+	double start, elapsed;
+	uvc_error_t res;
+	int i;
+
+	memset(&result, 0, sizeof(result));
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-r"))
+			flags |= UVC_REPLAY_REALTIME;
+		else if (!strcmp(argv[i], "-d"))
+			result.decode = 1;
+		else
+			path = argv[i];
+	}
+	if (!path) {
+		fprintf(stderr, "usage: %s [-r] [-d] trace_file\n", argv[0]);
+		return 1;
+	}
+
+	start = now_sec();
+	res = uvc_replay_trace(path, cb, &result, flags, &stats);
+	elapsed = now_sec() - start;
+	if (res < 0) {
+		uvc_perror(res, "uvc_replay_trace");
+		return 1;
+	}
+
+	printf("frames: %u (%u empty, %u sequence gaps, %u decode errors)\n",
+		result.frames, result.empty_frames, result.sequence_gaps, result.decode_errors);
+	printf("frame bytes: %llu\n", (unsigned long long) result.bytes);
+	printf("elapsed: %.3f sec, %.1f frames/sec\n",
+		elapsed, elapsed > 0 ? result.frames / elapsed : 0.0);
+	printf("packets: %llu, bytes: %llu, packet errors: %u\n",
+		(unsigned long long) stats.packets, (unsigned long long) stats.bytes, stats.packet_errors);
+	printf("frames eof: %u, fid: %u, error: %u, truncations: %u, overwritten: %u\n",
+		stats.frames_eof, stats.frames_fid, stats.frames_error,
+		stats.truncations, stats.frames_overwritten);
+
+	if (result.rgb)
+		uvc_free_frame(result.rgb);
+	return 0;
+}
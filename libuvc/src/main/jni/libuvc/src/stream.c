@@ -62,6 +62,8 @@
 #include "libuvc/libuvc.h"
 #include "libuvc/libuvc_internal.h"
 #include <errno.h>
+#include <unistd.h>	// XXX for usleep
+#include <sched.h>	// XXX for sched_yield
 
 uvc_frame_desc_t *uvc_find_frame_desc_stream(uvc_stream_handle_t *strmh,
 		uint16_t format_id, uint16_t frame_id);
@@ -69,6 +71,8 @@ uvc_frame_desc_t *uvc_find_frame_desc(uvc_device_handle_t *devh,
 		uint16_t format_id, uint16_t frame_id);
 static void *_uvc_user_caller(void *arg);
 static void _uvc_populate_frame(uvc_stream_handle_t *strmh);
+static void _uvc_populate_frame_info(uvc_stream_handle_t *strmh, uvc_frame_t *frame);
+static void _uvc_stream_free(uvc_stream_handle_t *strmh);
 
 struct format_table_entry {
 	enum uvc_frame_format format;
@@ -101,7 +105,8 @@ struct format_table_entry *_get_format_entry(enum uvc_frame_format format) {
 		{UVC_FRAME_FORMAT_UNCOMPRESSED, UVC_FRAME_FORMAT_COMPRESSED})
 
 	ABS_FMT(UVC_FRAME_FORMAT_UNCOMPRESSED,
-		{UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_GRAY8})
+		{UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_GRAY8,
+		UVC_FRAME_FORMAT_NV12, UVC_FRAME_FORMAT_I420})
 	FMT(UVC_FRAME_FORMAT_YUYV,
 		{'Y', 'U', 'Y', '2', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
 	FMT(UVC_FRAME_FORMAT_UYVY,
@@ -110,11 +115,20 @@ struct format_table_entry *_get_format_entry(enum uvc_frame_format format) {
 		{'Y', '8', '0', '0', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
     FMT(UVC_FRAME_FORMAT_BY8,
     	{'B', 'Y', '8', ' ', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
+	FMT(UVC_FRAME_FORMAT_NV12,
+		{'N', 'V', '1', '2', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
+	FMT(UVC_FRAME_FORMAT_I420,
+		{'I', '4', '2', '0', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
 
 	ABS_FMT(UVC_FRAME_FORMAT_COMPRESSED,
-		{UVC_FRAME_FORMAT_MJPEG})
+		{UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_H264, UVC_FRAME_FORMAT_H265})
 	FMT(UVC_FRAME_FORMAT_MJPEG,
 		{'M', 'J', 'P', 'G'})
+	// XXX frame based formats, the payloads are passed through as is
+	FMT(UVC_FRAME_FORMAT_H264,
+		{'H', '2', '6', '4', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
+	FMT(UVC_FRAME_FORMAT_H265,
+		{'H', '2', '6', '5', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
 
 	default:
 		return NULL;
@@ -601,26 +615,200 @@ uvc_error_t uvc_probe_stream_ctrl(uvc_device_handle_t *devh,
 }
 
 /** @internal
- * @brief Swap the working buffer with the presented buffer and notify consumers
+ * @brief Release a frame held by the stream to where it came from
  */
-static void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
-	uint8_t *tmp_buf;
+static void _uvc_release_frame(uvc_stream_handle_t *strmh, uvc_frame_t *frame) {
+	if (strmh->zero_copy && strmh->frame_release_cb)
+		strmh->frame_release_cb(frame, strmh->frame_alloc_ptr);
+	else
+		uvc_free_frame(frame);
+}
 
-	pthread_mutex_lock(&strmh->cb_mutex);
-	{
-		/* swap the buffers */
-		tmp_buf = strmh->holdbuf;
-		strmh->hold_bfh_err = strmh->bfh_err;	// XXX
-		strmh->hold_bytes = strmh->got_bytes;
-		strmh->holdbuf = strmh->outbuf;
-		strmh->outbuf = tmp_buf;
-		strmh->hold_last_scr = strmh->last_scr;
-		strmh->hold_pts = strmh->pts;
-		strmh->hold_seq = strmh->seq;
+/** @internal
+ * @brief Get a frame to assemble payloads into on zero copy mode
+ * @param need_bytes minimum size of the data buffer
+ * @return frame that can hold need_bytes, or NULL on error
+ */
+static uvc_frame_t *_uvc_get_assemble_frame(uvc_stream_handle_t *strmh, size_t need_bytes) {
+	uvc_frame_t *frame = strmh->frame_alloc_cb
+		? strmh->frame_alloc_cb(need_bytes, strmh->frame_alloc_ptr)
+		: uvc_allocate_frame(need_bytes);
 
-		pthread_cond_broadcast(&strmh->cb_cond);
+	if (UNLIKELY(!frame))
+		return NULL;
+	if (UNLIKELY(!frame->data || (frame->data_bytes < need_bytes))) {
+		if (UNLIKELY(!frame->library_owns_data)) {
+			_uvc_release_frame(strmh, frame);
+			return NULL;
+		}
+		// previous contents are never used, so we don't need realloc here
+		free(frame->data);
+		frame->data = malloc(need_bytes);
+		frame->data_bytes = frame->alloc_bytes = frame->data ? need_bytes : 0;
+		if (UNLIKELY(!frame->data)) {
+			_uvc_release_frame(strmh, frame);
+			return NULL;
+		}
+	}
+	frame->actual_bytes = 0;
+	return frame;
+}
+
+/** @internal
+ * @brief Claim the oldest filled slot of the frame ring
+ * Both of the consumer and the producer (to drop the oldest frame) may call this.
+ * @param expected if non-zero, claim only when the oldest slot is at expected - 1
+ * @param[out] pos position of the claimed slot
+ * @return claimed slot, or NULL if the ring is empty or the slot was taken by others
+ */
+static uvc_frame_slot_t *_uvc_ring_claim(uvc_stream_handle_t *strmh, uint32_t expected, uint32_t *pos) {
+	const uint32_t mask = strmh->num_slots - 1;
+	uint32_t p = expected ? expected - 1 : __atomic_load_n(&strmh->ring_tail, __ATOMIC_RELAXED);
+
+	for (; 1 ;) {
+		uvc_frame_slot_t *slot = &strmh->slots[p & mask];
+		const int32_t dif = (int32_t)(__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) - (p + 1));
+		if (!dif) {
+			if (__atomic_compare_exchange_n(&strmh->ring_tail, &p, p + 1,
+				0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				*pos = p;
+				return slot;
+			}
+			// p was updated with current ring_tail
+		} else if (dif < 0) {
+			return NULL;	// empty
+		} else {
+			p = __atomic_load_n(&strmh->ring_tail, __ATOMIC_RELAXED);
+		}
+		if (expected)
+			return NULL;
+	}
+}
+
+/** @internal
+ * @brief Give back the claimed slot to the producer
+ */
+static inline void _uvc_ring_release(uvc_stream_handle_t *strmh, uvc_frame_slot_t *slot, uint32_t pos) {
+	__atomic_store_n(&slot->turn, pos + strmh->num_slots, __ATOMIC_RELEASE);
+}
+
+/** @internal
+ * @brief Publish the assembled frame to the frame ring and continue on a free frame buffer
+ * This is called only from the USB event thread and never blocks.
+ * @return 0 if the frame was published, otherwise the frame is dropped
+ */
+static int _uvc_ring_push(uvc_stream_handle_t *strmh) {
+	const uint32_t pos = strmh->ring_head;
+	uvc_frame_slot_t *slot = &strmh->slots[pos & (strmh->num_slots - 1)];
+	uvc_frame_t *next;
+
+	if (__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) != pos) {
+		// the ring is full
+		__atomic_fetch_add(&strmh->overwritten_frames, 1, __ATOMIC_RELAXED);
+		if (strmh->drop_policy == UVC_FRAME_DROP_NEWEST)
+			return -1;
+		uint32_t old_pos;
+		uvc_frame_slot_t *oldest = _uvc_ring_claim(strmh, pos - strmh->num_slots + 1, &old_pos);
+		if (UNLIKELY(!oldest))
+			return -1;	// the consumer is taking it now, drop newest instead
+		// the frame of the oldest slot is reused as a free frame buffer
+		_uvc_ring_release(strmh, oldest, old_pos);
+	}
+
+	next = slot->frame;
+	if (!next)
+		next = _uvc_get_assemble_frame(strmh, strmh->assemble_bytes);
+	if (UNLIKELY(!next))
+		return -1;
+
+	slot->frame = strmh->assemble_frame;
+	slot->bytes = strmh->got_bytes;
+	slot->bfh_err = strmh->bfh_err;
+	slot->seq = strmh->seq;
+	slot->pts = strmh->pts;
+	slot->last_scr = strmh->last_scr;
+	slot->capture_ns = strmh->capture_ns;
+	slot->received_ns = strmh->frame_host_ns;
+	slot->completed_ns = strmh->pkt_host_ns;
+	__atomic_store_n(&slot->turn, pos + 1, __ATOMIC_RELEASE);
+	strmh->ring_head = pos + 1;
+
+	strmh->assemble_frame = next;
+	strmh->outbuf = next->data;
+	strmh->outbuf_bytes = next->data_bytes;
+	return 0;
+}
+
+/** @internal
+ * @brief Take the oldest frame in the frame ring as hold_frame
+ * Current hold_frame (if any) is left in the slot as a free frame buffer.
+ * This is called only from the consumer thread.
+ * @return non-zero if a frame was taken, 0 if the ring is empty
+ */
+static int _uvc_ring_pop(uvc_stream_handle_t *strmh) {
+	uint32_t pos;
+	uvc_frame_slot_t *slot = _uvc_ring_claim(strmh, 0, &pos);
+	uvc_frame_t *frame;
+
+	if (!slot)
+		return 0;
+
+	frame = slot->frame;
+	slot->frame = strmh->hold_frame;
+	strmh->hold_frame = frame;
+	strmh->hold_bytes = slot->bytes;
+	strmh->hold_bfh_err = slot->bfh_err;
+	strmh->hold_seq = slot->seq;
+	strmh->hold_pts = slot->pts;
+	strmh->hold_last_scr = slot->last_scr;
+	strmh->hold_capture_ns = slot->capture_ns;
+	strmh->hold_received_ns = slot->received_ns;
+	strmh->hold_completed_ns = slot->completed_ns;
+	_uvc_ring_release(strmh, slot, pos);
+
+	return 1;
+}
+
+/** @internal
+ * @brief Whether the producer has no free slot to publish a frame
+ */
+static inline int _uvc_ring_full(uvc_stream_handle_t *strmh) {
+	const uint32_t pos = strmh->ring_head;
+	return __atomic_load_n(&strmh->slots[pos & (strmh->num_slots - 1)].turn, __ATOMIC_ACQUIRE) != pos;
+}
+
+/** @internal
+ * @brief Whether the consumer has taken all published frames
+ */
+static inline int _uvc_ring_empty(uvc_stream_handle_t *strmh) {
+	return __atomic_load_n(&strmh->ring_tail, __ATOMIC_ACQUIRE) == strmh->ring_head;
+}
+
+/** @internal
+ * @brief Publish the working buffer to the frame ring and notify consumers
+ */
+static void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
+
+	// XXX capture time from PTS, arrival of the first payload if it is not available
+	if (!strmh->pts || !uvc_clock_to_host(&strmh->clock, strmh->pts, &strmh->capture_ns))
+		strmh->capture_ns = strmh->frame_host_ns;
+	// frames with error are never passed to the consumer
+	if (UNLIKELY(strmh->bfh_err)) {
+		strmh->stats.frames_error++;
+	} else if (LIKELY(!_uvc_ring_push(strmh))) {
+		pthread_mutex_lock(&strmh->cb_mutex);
+		{
+			pthread_cond_broadcast(&strmh->cb_cond);
+		}
+		pthread_mutex_unlock(&strmh->cb_mutex);
+		strmh->fps_frames++;
+	}
+	if (strmh->xfer_host_ns - strmh->fps_start_ns >= 1000000000LL) {
+		if (strmh->fps_start_ns)
+			strmh->stats.fps = strmh->fps_frames * 1e9f / (strmh->xfer_host_ns - strmh->fps_start_ns);
+		strmh->fps_frames = 0;
+		strmh->fps_start_ns = strmh->xfer_host_ns;
 	}
-	pthread_mutex_unlock(&strmh->cb_mutex);
 
 	strmh->seq++;
 	strmh->got_bytes = 0;
@@ -629,6 +817,47 @@ static void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
 	strmh->bfh_err = 0;	// XXX
 }
 
+/** @internal
+ * @brief Record the completed transfer if the trace is open, called from the USB event thread
+ */
+static inline void _uvc_trace_transfer(uvc_stream_handle_t *strmh,
+		const struct libusb_transfer *transfer, int64_t host_ns) {
+
+	// _uvc_close_trace waits until trace_users becomes zero before closing
+	__atomic_fetch_add(&strmh->trace_users, 1, __ATOMIC_SEQ_CST);
+	uvc_trace_t *trace = __atomic_load_n(&strmh->trace, __ATOMIC_SEQ_CST);
+	if (LIKELY(trace))
+		uvc_trace_write_transfer(trace, transfer, host_ns);
+	__atomic_fetch_sub(&strmh->trace_users, 1, __ATOMIC_RELEASE);
+}
+
+/** @internal
+ * @brief Close the trace, the event thread never touches it after this
+ */
+static void _uvc_close_trace(uvc_stream_handle_t *strmh) {
+	uvc_trace_t *trace = __atomic_exchange_n(&strmh->trace, NULL, __ATOMIC_SEQ_CST);
+
+	if (trace) {
+		// the event thread may be writing the transfer that completed just before
+		for (; __atomic_load_n(&strmh->trace_users, __ATOMIC_SEQ_CST) ;)
+			sched_yield();
+		uvc_trace_close(trace);
+	}
+}
+
+/** @internal
+ * @brief Whether all transfers were freed, call this while holding cb_mutex
+ */
+static int _uvc_all_transfers_reaped(uvc_stream_handle_t *strmh) {
+	int i;
+
+	for (i = 0; i < strmh->num_transfers; i++) {
+		if (strmh->transfers[i])
+			return 0;
+	}
+	return 1;
+}
+
 static void _uvc_delete_transfer(struct libusb_transfer *transfer) {
 	ENTER();
 
@@ -640,7 +869,7 @@ static void _uvc_delete_transfer(struct libusb_transfer *transfer) {
 	pthread_mutex_lock(&strmh->cb_mutex);	// XXX crash while calling uvc_stop_streaming
 	{
 		// Mark transfer as deleted.
-		for (i = 0; i < LIBUVC_NUM_TRANSFER_BUFS; i++) {
+		for (i = 0; i < strmh->num_transfers; i++) {
 			if (strmh->transfers[i] == transfer) {
 				libusb_cancel_transfer(strmh->transfers[i]);	// XXX 20141112追加
 				UVC_DEBUG("Freeing transfer %d (%p)", i, transfer);
@@ -650,9 +879,13 @@ static void _uvc_delete_transfer(struct libusb_transfer *transfer) {
 				break;
 			}
 		}
-		if (UNLIKELY(i == LIBUVC_NUM_TRANSFER_BUFS)) {
+		if (UNLIKELY(i == strmh->num_transfers)) {
 			UVC_DEBUG("transfer %p not found; not freeing!", transfer);
 		}
+		if (UNLIKELY(strmh->trace) && !strmh->running && _uvc_all_transfers_reaped(strmh)) {
+			// XXX uvc_stream_stop gave up waiting for this transfer, close the trace instead of it
+			_uvc_close_trace(strmh);
+		}
 
 		pthread_cond_broadcast(&strmh->cb_cond);
 	}
@@ -660,8 +893,54 @@ static void _uvc_delete_transfer(struct libusb_transfer *transfer) {
 	EXIT();
 }
 
+/** @internal
+ * @brief Append payload data to the buffer of the frame being assembled
+ * The frame buffer grows up to size_buf when the camera sends
+ * more data than dwMaxVideoFrameSize.
+ */
+static inline void _uvc_append_payload(uvc_stream_handle_t *strmh, const uint8_t *data, size_t data_len) {
+	const size_t need_bytes = strmh->got_bytes + data_len;
+
+	if (UNLIKELY(need_bytes > strmh->outbuf_bytes)) {
+		uvc_frame_t *frame = strmh->assemble_frame;
+		size_t new_bytes = need_bytes + (need_bytes >> 1);
+		uint8_t *buf = NULL;
+
+		if (new_bytes > strmh->size_buf)
+			new_bytes = strmh->size_buf;
+		if (frame && frame->library_owns_data && (need_bytes <= new_bytes))
+			buf = realloc(frame->data, new_bytes);
+		if (UNLIKELY(!buf)) {
+			strmh->bfh_err |= UVC_STREAM_ERR;
+			strmh->stats.truncations++;
+			return;
+		}
+		frame->data = strmh->outbuf = buf;
+		frame->data_bytes = frame->alloc_bytes = strmh->outbuf_bytes = new_bytes;
+	}
+	if (!strmh->got_bytes)
+		strmh->frame_host_ns = strmh->pkt_host_ns;
+	memcpy(strmh->outbuf + strmh->got_bytes, data, data_len);
+	strmh->got_bytes = need_bytes;
+}
+
 #define USE_EOF
 
+/** @internal
+ * @brief Clear halt of the streaming endpoint after a payload error
+ * Nothing to do while replaying a trace because there is no device.
+ * @param get_error_code if non-zero, also read the stream error code from the device
+ */
+static void _uvc_recover_stream_error(uvc_stream_handle_t *strmh, int get_error_code) {
+	uvc_vs_error_code_control_t vs_error_code;
+
+	if (UNLIKELY(!strmh->stream_if))
+		return;
+	libusb_clear_halt(strmh->devh->usb_devh, strmh->stream_if->bEndpointAddress);
+	if (get_error_code)
+		uvc_vs_get_error_code(strmh->devh, &vs_error_code, UVC_GET_CUR);
+}
+
 /** @internal
  * @brief Process a payload transfer
  * 
@@ -678,7 +957,6 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 	size_t data_len;
 	struct libusb_iso_packet_descriptor *pkt;
 	uvc_vc_error_code_control_t vc_error_code;
-	uvc_vs_error_code_control_t vs_error_code;
 
 	// magic numbers for identifying header packets from some iSight cameras
 	static const uint8_t isight_tag[] = {
@@ -728,11 +1006,11 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 		header_info = payload[1];
 
 		if (UNLIKELY(header_info & UVC_STREAM_ERR)) {
+			strmh->stats.packet_errors++;
 //			strmh->bfh_err |= UVC_STREAM_ERR;
 			UVC_DEBUG("bad packet: error bit set");
-			libusb_clear_halt(strmh->devh->usb_devh, strmh->stream_if->bEndpointAddress);
 //			uvc_vc_get_error_code(strmh->devh, &vc_error_code, UVC_GET_CUR);
-			uvc_vs_get_error_code(strmh->devh, &vs_error_code, UVC_GET_CUR);
+			_uvc_recover_stream_error(strmh, 1);
 //			return;
 		}
 
@@ -740,6 +1018,7 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 			/* The frame ID bit was flipped, but we have image data sitting
 				around from prior transfers. This means the camera didn't send
 				an EOF for the last transfer of the previous frame. */
+			strmh->stats.frames_fid++;
 			_uvc_swap_buffers(strmh);
 		}
 
@@ -759,9 +1038,10 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 		if (header_info & UVC_STREAM_SCR) {
 			// @todo read the SOF token counter
 			// XXX saki some camera may send broken packet or failed to receive all data
-			if (LIKELY(variable_offset + 4 <= header_len)) {
+			if (LIKELY(variable_offset + 6 <= header_len)) {
 				strmh->last_scr = DW_TO_INT(payload + variable_offset);
-				variable_offset += 4;
+				uvc_clock_add_sample(&strmh->clock, strmh->last_scr, strmh->pkt_host_ns);
+				variable_offset += 6;
 			} else {
 				MARK("bogus packet: header info has UVC_STREAM_SCR, but no data");
 				strmh->last_scr = 0;
@@ -770,15 +1050,11 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 	}
 
 	if (LIKELY(data_len > 0)) {
-		if (LIKELY(strmh->got_bytes + data_len < strmh->size_buf)) {
-			memcpy(strmh->outbuf + strmh->got_bytes, payload + header_len, data_len);
-			strmh->got_bytes += data_len;
-		} else {
-			strmh->bfh_err |= UVC_STREAM_ERR;
-		}
+		_uvc_append_payload(strmh, payload + header_len, data_len);
 
 		if (header_info & UVC_STREAM_EOF/*(1 << 1)*/) {
 			// The EOF bit is set, so publish the complete frame
+			strmh->stats.frames_eof++;
 			_uvc_swap_buffers(strmh);
 		}
 	}
@@ -820,19 +1096,21 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 		0xbe, 0xef, 0xde, 0xad, 0xfa, 0xce };
 	int packet_id;
 	uvc_vc_error_code_control_t vc_error_code;
-	uvc_vs_error_code_control_t vs_error_code;
 
 	for (packet_id = 0; packet_id < transfer->num_iso_packets; ++packet_id) {
 		check_header = 1;
 
 		pkt = transfer->iso_packet_desc + packet_id;
+		// XXX estimate when this packet arrived from completion of the transfer
+		strmh->pkt_host_ns = strmh->xfer_host_ns
+			- (int64_t)(transfer->num_iso_packets - 1 - packet_id) * strmh->packet_us * 1000;
 
 		if (UNLIKELY(pkt->status != 0)) {
 			MARK("bad packet:status=%d,actual_length=%d", pkt->status, pkt->actual_length);
+			strmh->stats.packet_errors++;
 			strmh->bfh_err |= UVC_STREAM_ERR;
-			libusb_clear_halt(strmh->devh->usb_devh, strmh->stream_if->bEndpointAddress);
+			_uvc_recover_stream_error(strmh, 0);
 //			uvc_vc_get_error_code(strmh->devh, &vc_error_code, UVC_GET_CUR);
-//			uvc_vs_get_error_code(strmh->devh, &vs_error_code, UVC_GET_CUR);
 			continue;
 		}
 
@@ -841,6 +1119,8 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 //			strmh->bfh_err |= UVC_STREAM_ERR;	// don't set this flag here
 			continue;
 		}
+		strmh->stats.packets++;
+		strmh->stats.bytes += pkt->actual_length;
 		// XXX accessing to pktbuf could lead to crash on the original implementation
 		// because the substances of pktbuf will be deleted in uvc_stream_stop.
 		pktbuf = libusb_get_iso_packet_buffer_simple(transfer, packet_id);
@@ -870,9 +1150,9 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 				if (UNLIKELY(header_info & UVC_STREAM_ERR)) {
 //					strmh->bfh_err |= UVC_STREAM_ERR;
 					MARK("bad packet:status=0x%2x", header_info);
-					libusb_clear_halt(strmh->devh->usb_devh, strmh->stream_if->bEndpointAddress);
+					strmh->stats.packet_errors++;
 //					uvc_vc_get_error_code(strmh->devh, &vc_error_code, UVC_GET_CUR);
-					uvc_vs_get_error_code(strmh->devh, &vs_error_code, UVC_GET_CUR);
+					_uvc_recover_stream_error(strmh, 1);
 					continue;
 				}
 #ifdef USE_EOF
@@ -880,6 +1160,7 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 				/* The frame ID bit was flipped, but we have image data sitting
 	             around from prior transfers. This means the camera didn't send
     		     an EOF for the last transfer of the previous frame or some frames losted. */
+					strmh->stats.frames_fid++;
 					_uvc_swap_buffers(strmh);
 				}
 				strmh->fid = header_info & UVC_STREAM_FID;
@@ -901,8 +1182,11 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 
 				if (header_info & UVC_STREAM_SCR) {
 					// XXX saki some camera may send broken packet or failed to receive all data
-					if (LIKELY(header_len >= 10)) {
-						strmh->last_scr = DW_TO_INT(pktbuf + 6);
+					// SCR follows PTS only when PTS exists
+					const size_t scr_offset = header_info & UVC_STREAM_PTS ? 6 : 2;
+					if (LIKELY(header_len >= scr_offset + 6)) {
+						strmh->last_scr = DW_TO_INT(pktbuf + scr_offset);
+						uvc_clock_add_sample(&strmh->clock, strmh->last_scr, strmh->pkt_host_ns);
 					} else {
 						MARK("bogus packet: header info has UVC_STREAM_SCR, but no data");
 						strmh->last_scr = 0;
@@ -923,6 +1207,7 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 			if (UNLIKELY(pkt->actual_length < header_len)) {
 				/* Bogus packet received */
 				strmh->bfh_err |= UVC_STREAM_ERR;
+				strmh->stats.packet_errors++;
 				MARK("bogus packet: actual_len=%d, header_len=%zd", pkt->actual_length, header_len);
 				continue;
 			}
@@ -932,21 +1217,18 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 			// therefor changed to "if (pkt->actual_length > header_len)"
 			// from "if (pkt->actual_length - header_len > 0)"
 			if (LIKELY(pkt->actual_length > header_len)) {
-				const size_t odd_bytes = pkt->actual_length - header_len;
-				assert(strmh->got_bytes + odd_bytes < strmh->size_buf);
-				assert(strmh->outbuf);
-				assert(pktbuf);
-				memcpy(strmh->outbuf + strmh->got_bytes, pktbuf + header_len, odd_bytes);
-				strmh->got_bytes += odd_bytes;
+				_uvc_append_payload(strmh, pktbuf + header_len, pkt->actual_length - header_len);
 			}
 #ifdef USE_EOF
 			if ((pktbuf[1] & UVC_STREAM_EOF) && strmh->got_bytes != 0) {
 				/* The EOF bit is set, so publish the complete frame */
+				strmh->stats.frames_eof++;
 				_uvc_swap_buffers(strmh);
 			}
 #endif
 		} else {	// if (LIKELY(pktbuf))
 			strmh->bfh_err |= UVC_STREAM_ERR;
+			strmh->stats.packet_errors++;
 			MARK("libusb_get_iso_packet_buffer_simple returned null");
 			continue;
 		}
@@ -954,6 +1236,47 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 }
 #endif
 
+/** @internal
+ * @brief Process a completed transfer
+ * @param host_ns the host time when the transfer completed
+ */
+static void _uvc_process_transfer(uvc_stream_handle_t *strmh, struct libusb_transfer *transfer, int64_t host_ns) {
+	strmh->xfer_host_ns = host_ns;
+	if (!transfer->num_iso_packets) {
+		/* This is a bulk mode transfer, so it just has one payload transfer */
+		strmh->pkt_host_ns = strmh->xfer_host_ns;
+		strmh->stats.packets++;
+		strmh->stats.bytes += transfer->actual_length;
+		_uvc_process_payload(strmh, transfer->buffer, transfer->actual_length);
+	} else {
+		/* This is an isochronous mode transfer, so each packet has a payload transfer */
+		_uvc_process_payload_iso(strmh, transfer);
+	}
+}
+
+/** @internal
+ * @brief Submit the spare transfer in place of the completed transfer
+ * The spare transfer is one of strmh->transfers, only the USB event thread
+ * touches spare_transfer while the stream is running, so this takes no lock.
+ * The caller makes the completed transfer the spare one after processing it.
+ * @return non-zero if the spare transfer was submitted
+ */
+static int _uvc_submit_spare_transfer(uvc_stream_handle_t *strmh) {
+	int ret = 0;
+
+	// uvc_stream_stop waits until spare_users becomes zero before cancelling the transfers
+	__atomic_fetch_add(&strmh->spare_users, 1, __ATOMIC_SEQ_CST);
+	if (LIKELY(__atomic_load_n(&strmh->running, __ATOMIC_SEQ_CST))
+		&& !libusb_submit_transfer(strmh->spare_transfer)) {
+
+		strmh->spare_transfer = NULL;
+		ret = 1;
+	}
+	__atomic_fetch_sub(&strmh->spare_users, 1, __ATOMIC_RELEASE);
+
+	return ret;
+}
+
 /** @internal
  * @brief Isochronous transfer callback
  * 
@@ -977,14 +1300,25 @@ static void _uvc_stream_callback(struct libusb_transfer *transfer) {
 #endif
 	switch (transfer->status) {
 	case LIBUSB_TRANSFER_COMPLETED:
-		if (!transfer->num_iso_packets) {
-			/* This is a bulk mode transfer, so it just has one payload transfer */
-			_uvc_process_payload(strmh, transfer->buffer, transfer->actual_length);
-		} else {
-			/* This is an isochronous mode transfer, so each packet has a payload transfer */
-			_uvc_process_payload_iso(strmh, transfer);
+	{
+		const int64_t host_ns = uvc_clock_host_ns();
+		// XXX keep the number of queued transfers while processing the completed one
+		const int swapped = strmh->spare_transfer
+			&& _uvc_submit_spare_transfer(strmh);
+		if (UNLIKELY(strmh->trace)) {
+			// XXX record the transfer before processing, this only copies it
+			_uvc_trace_transfer(strmh, transfer, host_ns);
+		}
+		_uvc_process_transfer(strmh, transfer, host_ns);
+		if (swapped) {
+			if (LIKELY(strmh->running)) {
+				strmh->spare_transfer = transfer;	// the completed transfer is the spare one now
+				return;
+			}
+			resubmit = 0;
 		}
 	    break;
+	}
 	case LIBUSB_TRANSFER_NO_DEVICE:
 		strmh->running = 0;	// this needs for unexpected disconnect of cable otherwise hangup
 		// pass through to following lines
@@ -1336,12 +1670,11 @@ uvc_error_t uvc_stream_open_ctrl(uvc_device_handle_t *devh,
 	if (UNLIKELY(ret != UVC_SUCCESS))
 		goto fail;
 
-	// Set up the streaming status and data space
+	// Set up the streaming status, data space is allocated when the stream starts
 	strmh->running = 0;
-	/** @todo take only what we need */
-	strmh->outbuf = malloc(LIBUVC_XFER_BUF_SIZE);
-	strmh->holdbuf = malloc(LIBUVC_XFER_BUF_SIZE);
 	strmh->size_buf = LIBUVC_XFER_BUF_SIZE;	// xxx for boundary check
+	strmh->num_slots = LIBUVC_NUM_FRAME_SLOTS;
+	strmh->drop_policy = UVC_FRAME_DROP_OLDEST;
 
 	pthread_mutex_init(&strmh->cb_mutex, NULL);
 	pthread_cond_init(&strmh->cb_cond, NULL);
@@ -1360,6 +1693,588 @@ fail:
 	return ret;
 }
 
+/** @internal
+ * @brief Free the frame ring and the frames in it
+ */
+static void _uvc_free_frame_ring(uvc_stream_handle_t *strmh) {
+	uint32_t i;
+
+	if (strmh->slots) {
+		for (i = 0; i < strmh->num_slots; i++) {
+			if (strmh->slots[i].frame)
+				_uvc_release_frame(strmh, strmh->slots[i].frame);
+		}
+		free(strmh->slots);
+		strmh->slots = NULL;
+	}
+}
+
+/** XXX Assemble frames directly into frame buffers that are handed over to the user callback.
+ * @ingroup streaming
+ *
+ * Without this, received payloads are copied into the internal buffer
+ * and copied again into the frame that is passed to the user callback.
+ * On zero copy mode the user callback owns the frame passed to it and
+ * must release it with uvc_free_frame (or return it to the pool of alloc_cb).
+ * The frames the stream still holds are released with release_cb.
+ * Polling with uvc_stream_get_frame is not available on this mode.
+ * This must be called before starting the stream.
+ *
+ * @param strmh UVC stream
+ * @param alloc_cb function to provide frame buffers, NULL to use uvc_allocate_frame
+ * @param release_cb function to take back frame buffers, NULL to use uvc_free_frame
+ * @param alloc_ptr user pointer passed to alloc_cb and release_cb
+ */
+uvc_error_t uvc_stream_set_zero_copy(uvc_stream_handle_t *strmh,
+		uvc_frame_alloc_t *alloc_cb, uvc_frame_release_t *release_cb, void *alloc_ptr) {
+
+	if (UNLIKELY(!strmh))
+		return UVC_ERROR_INVALID_PARAM;
+	if (UNLIKELY(strmh->running))
+		return UVC_ERROR_BUSY;
+
+	// frames kept from the previous stream may come from another allocator
+	_uvc_free_frame_ring(strmh);
+	if (strmh->assemble_frame) {
+		_uvc_release_frame(strmh, strmh->assemble_frame);
+		strmh->assemble_frame = NULL;
+		strmh->outbuf = NULL;
+	}
+	if (strmh->hold_frame) {
+		_uvc_release_frame(strmh, strmh->hold_frame);
+		strmh->hold_frame = NULL;
+	}
+	strmh->zero_copy = 1;
+	strmh->frame_alloc_cb = alloc_cb;
+	strmh->frame_release_cb = release_cb;
+	strmh->frame_alloc_ptr = alloc_ptr;
+
+	return UVC_SUCCESS;
+}
+
+/** XXX Set the number of slots and the drop policy of the frame ring
+ * @ingroup streaming
+ *
+ * Completed frames are queued into the frame ring until the callback thread
+ * (or uvc_stream_get_frame) takes them, so a short stall of the user callback
+ * does not lose frames. When the ring is full, a frame is dropped according
+ * to the policy and counted as an overwritten frame.
+ * The number of slots can be changed only while the stream is stopped,
+ * the policy can be changed at any time.
+ *
+ * @param strmh UVC stream
+ * @param num_slots number of slots, rounded up to power of 2 in [2, LIBUVC_MAX_FRAME_SLOTS],
+ *        zero or negative to keep current value
+ * @param policy what to do when the ring is full
+ */
+uvc_error_t uvc_stream_set_frame_ring(uvc_stream_handle_t *strmh,
+		int num_slots, enum uvc_frame_drop_policy policy) {
+	uint32_t n;
+
+	if (UNLIKELY(!strmh))
+		return UVC_ERROR_INVALID_PARAM;
+
+	if (num_slots > 0) {
+		if (UNLIKELY(strmh->running))
+			return UVC_ERROR_BUSY;
+		for (n = 2; (n < (uint32_t)num_slots) && (n < LIBUVC_MAX_FRAME_SLOTS); n <<= 1);
+		if (n != strmh->num_slots) {
+			_uvc_free_frame_ring(strmh);
+			strmh->num_slots = n;
+		}
+	}
+	strmh->drop_policy = policy;
+
+	return UVC_SUCCESS;
+}
+
+/** XXX Get the transport statistics of the stream
+ * @ingroup streaming
+ *
+ * The counters are updated by the USB event thread without lock,
+ * so they may be slightly inconsistent with each other.
+ *
+ * @param strmh UVC stream
+ * @param[out] stats statistics since the stream started
+ */
+uvc_error_t uvc_stream_get_stats(uvc_stream_handle_t *strmh, uvc_stream_stats_t *stats) {
+	if (UNLIKELY(!strmh || !stats))
+		return UVC_ERROR_INVALID_PARAM;
+
+	*stats = strmh->stats;
+	stats->frames_overwritten = __atomic_load_n(&strmh->overwritten_frames, __ATOMIC_RELAXED);
+
+	return UVC_SUCCESS;
+}
+
+/** @internal
+ * @brief Add a frame buffer to the footprint
+ */
+static inline void _uvc_footprint_add_frame(uvc_stream_footprint_t *footprint, const uvc_frame_t *frame) {
+	if (frame) {
+		footprint->frames++;
+		footprint->frame_bytes += frame->data_bytes;
+	}
+}
+
+/** XXX Get the memory held by the stream for transfers and frame buffers
+ * @ingroup streaming
+ *
+ * Frame buffers grow when the camera sends frames larger than
+ * dwMaxVideoFrameSize, so the value may change while the stream is running.
+ * On zero copy mode, frames handed over to the user callback are not counted.
+ *
+ * @param strmh UVC stream
+ * @param[out] footprint memory held by the stream
+ */
+uvc_error_t uvc_stream_get_footprint(uvc_stream_handle_t *strmh, uvc_stream_footprint_t *footprint) {
+	uint32_t i;
+
+	if (UNLIKELY(!strmh || !footprint))
+		return UVC_ERROR_INVALID_PARAM;
+
+	memset(footprint, 0, sizeof(*footprint));
+	// transfers are reaped and the consumer takes frames from the ring while holding cb_mutex,
+	// so none of them is freed while reading. The USB event thread swaps frames between
+	// the slots and assemble_frame without the lock, a frame being swapped may be counted twice or missed.
+	pthread_mutex_lock(&strmh->cb_mutex);
+	{
+		// the spare transfer is one of the transfers
+		for (i = 0; i < (uint32_t)strmh->num_transfers; i++) {
+			if (strmh->transfers[i]) {
+				footprint->transfers++;
+				footprint->transfer_bytes += strmh->transfers[i]->length;
+			}
+		}
+		if (strmh->slots) {
+			for (i = 0; i < strmh->num_slots; i++)
+				_uvc_footprint_add_frame(footprint, __atomic_load_n(&strmh->slots[i].frame, __ATOMIC_ACQUIRE));
+		}
+		_uvc_footprint_add_frame(footprint, __atomic_load_n(&strmh->assemble_frame, __ATOMIC_ACQUIRE));
+		if (!strmh->zero_copy) {
+			// otherwise hold_frame is handed over to the user callback without lock
+			_uvc_footprint_add_frame(footprint, strmh->hold_frame);
+			if (strmh->frame.data)
+				_uvc_footprint_add_frame(footprint, &strmh->frame);
+		}
+	}
+	pthread_mutex_unlock(&strmh->cb_mutex);
+
+	footprint->total_bytes = footprint->transfer_bytes + footprint->frame_bytes
+		+ sizeof(*strmh)
+		+ (strmh->slots ? strmh->num_slots * sizeof(uvc_frame_slot_t) : 0)
+		+ strmh->num_transfers * (sizeof(struct libusb_transfer *) + sizeof(uint8_t *));
+
+	return UVC_SUCCESS;
+}
+
+/** XXX Record completed transfers of the stream into a trace file
+ * @ingroup streaming
+ *
+ * The file is created when the stream starts and closed when it stops.
+ * The trace can be fed back with uvc_replay_trace without the device.
+ * This must be called before starting the stream.
+ *
+ * @param strmh UVC stream
+ * @param path path of the trace file, NULL to stop recording
+ */
+uvc_error_t uvc_stream_set_trace(uvc_stream_handle_t *strmh, const char *path) {
+	char *trace_path = NULL;
+
+	if (UNLIKELY(!strmh))
+		return UVC_ERROR_INVALID_PARAM;
+	if (UNLIKELY(strmh->running))
+		return UVC_ERROR_BUSY;
+
+	if (path) {
+		trace_path = strdup(path);
+		if (UNLIKELY(!trace_path))
+			return UVC_ERROR_NO_MEM;
+	}
+	if (strmh->trace_path)
+		free(strmh->trace_path);
+	strmh->trace_path = trace_path;
+
+	return UVC_SUCCESS;
+}
+
+/** XXX Get the number of frames dropped because the frame ring was full
+ * @ingroup streaming
+ *
+ * @param strmh UVC stream
+ * @return number of dropped frames since the stream started
+ */
+uint32_t uvc_stream_get_overwritten_frames(uvc_stream_handle_t *strmh) {
+	return LIKELY(strmh) ? __atomic_load_n(&strmh->overwritten_frames, __ATOMIC_RELAXED) : 0;
+}
+
+/** @internal
+ * @brief Free the frame buffer kept from the previous stream if it does not fit
+ * the frame size of the current stream, it will be allocated again when needed.
+ */
+static void _uvc_fit_frame(uvc_stream_handle_t *strmh, uvc_frame_t **frame, size_t bytes) {
+	if (*frame && (((*frame)->data_bytes < bytes) || ((*frame)->data_bytes > bytes * 2))) {
+		_uvc_release_frame(strmh, *frame);
+		*frame = NULL;
+	}
+}
+
+/** @internal
+ * @brief Prepare the frame ring and the frame buffer to assemble frames into
+ * Frames left in the ring are reused as free frame buffers if they fit the frame size.
+ * @param frame_bytes expected maximum frame size, zero if unknown
+ */
+static uvc_error_t _uvc_stream_prepare_buffers(uvc_stream_handle_t *strmh, size_t frame_bytes) {
+	uint32_t i;
+
+	if (!frame_bytes) {
+		// XXX the camera did not tell the frame size, assume 16 bits per pixel
+		// the frame buffer grows up to size_buf if the frame is larger than this
+		frame_bytes = (size_t)strmh->frame_width * strmh->frame_height * 2;
+	}
+	strmh->got_bytes = 0;
+	strmh->assemble_bytes = frame_bytes && (frame_bytes < strmh->size_buf)
+		? frame_bytes : strmh->size_buf;
+
+	if (!strmh->slots) {
+		strmh->slots = calloc(strmh->num_slots, sizeof(uvc_frame_slot_t));
+		if (UNLIKELY(!strmh->slots))
+			return UVC_ERROR_NO_MEM;
+	}
+	for (i = 0; i < strmh->num_slots; i++) {
+		strmh->slots[i].turn = i;
+		// XXX the frame size may have been changed by uvc_stream_ctrl
+		_uvc_fit_frame(strmh, &strmh->slots[i].frame, strmh->assemble_bytes);
+	}
+	strmh->ring_head = strmh->ring_tail = 0;
+	strmh->overwritten_frames = 0;
+
+	_uvc_fit_frame(strmh, &strmh->hold_frame, strmh->assemble_bytes);
+	_uvc_fit_frame(strmh, &strmh->assemble_frame, strmh->assemble_bytes);
+	if (strmh->frame.data && (strmh->frame.data_bytes > strmh->assemble_bytes * 2)) {
+		// the frame to copy into on non zero copy mode, this grows on demand
+		free(strmh->frame.data);
+		strmh->frame.data = NULL;
+		strmh->frame.data_bytes = 0;
+	}
+	if (!strmh->assemble_frame) {
+		strmh->assemble_frame = _uvc_get_assemble_frame(strmh, strmh->assemble_bytes);
+		if (UNLIKELY(!strmh->assemble_frame))
+			return UVC_ERROR_NO_MEM;
+	}
+	strmh->outbuf = strmh->assemble_frame->data;
+	strmh->outbuf_bytes = strmh->assemble_frame->data_bytes;
+
+	return UVC_SUCCESS;
+}
+
+/** XXX Override the number of transfers and the packets per transfer
+ * @ingroup streaming
+ *
+ * By default they are decided from the frame size, the frame interval
+ * and the bandwidth of the endpoint when the stream starts.
+ * packets_per_transfer is used only for isochronous transfer.
+ * This must be called before starting the stream.
+ *
+ * @param strmh UVC stream
+ * @param num_transfers number of transfers to queue [1, LIBUVC_MAX_TRANSFER_BUFS], zero for auto
+ * @param packets_per_transfer packets per isochronous transfer [1, LIBUVC_MAX_ISO_PACKETS], zero for auto
+ */
+uvc_error_t uvc_stream_set_transfer_config(uvc_stream_handle_t *strmh,
+		int num_transfers, int packets_per_transfer) {
+
+	if (UNLIKELY(!strmh
+		|| (num_transfers < 0) || (num_transfers > LIBUVC_MAX_TRANSFER_BUFS)
+		|| (packets_per_transfer < 0) || (packets_per_transfer > LIBUVC_MAX_ISO_PACKETS)))
+		return UVC_ERROR_INVALID_PARAM;
+	if (UNLIKELY(strmh->running))
+		return UVC_ERROR_BUSY;
+
+	strmh->req_num_transfers = num_transfers;
+	strmh->req_packets_per_transfer = packets_per_transfer;
+
+	return UVC_SUCCESS;
+}
+
+/** XXX Enable or disable resubmit first mode
+ * @ingroup streaming
+ *
+ * When enabled, one spare transfer is allocated in addition to the queued
+ * transfers. On completion of a transfer the spare one is submitted before
+ * the payloads of the completed transfer are processed, and the completed
+ * transfer becomes the spare one. The number of transfers queued in the
+ * host controller then does not drop while the payloads are processed.
+ * This must be called before starting the stream.
+ *
+ * @param strmh UVC stream
+ * @param enable non-zero to enable
+ */
+uvc_error_t uvc_stream_set_resubmit_first(uvc_stream_handle_t *strmh, uint8_t enable) {
+
+	if (UNLIKELY(!strmh))
+		return UVC_ERROR_INVALID_PARAM;
+	if (UNLIKELY(strmh->running))
+		return UVC_ERROR_BUSY;
+
+	strmh->resubmit_first = enable ? 1 : 0;
+
+	return UVC_SUCCESS;
+}
+
+/** XXX Set the color matrix and the quantization range of the YUV frames
+ * @ingroup streaming
+ *
+ * The values are stored to each frame of the stream and used by the
+ * YUYV/UYVY => RGB conversions. UVC devices report them in the color
+ * matching descriptor, but many of them send BT.601 full range regardless.
+ * This can be called while streaming, the frames after the call use the new values.
+ *
+ * @param strmh UVC stream
+ * @param matrix color matrix, default UVC_COLOR_MATRIX_BT601
+ * @param range quantization range, default UVC_COLOR_RANGE_FULL
+ */
+uvc_error_t uvc_stream_set_color(uvc_stream_handle_t *strmh,
+		enum uvc_color_matrix matrix, enum uvc_color_range range) {
+
+	if (UNLIKELY(!strmh))
+		return UVC_ERROR_INVALID_PARAM;
+	if (UNLIKELY(((unsigned)matrix >= UVC_COLOR_MATRIX_COUNT) || ((unsigned)range >= UVC_COLOR_RANGE_COUNT)))
+		return UVC_ERROR_INVALID_PARAM;
+
+	strmh->color_matrix = matrix;
+	strmh->color_range = range;
+
+	return UVC_SUCCESS;
+}
+
+/** XXX Get the bandwidth selected for the stream
+ * @ingroup streaming
+ *
+ * @param strmh UVC stream
+ * @param[out] alt_setting altsetting of the streaming interface, zero on bulk transfer
+ * @param[out] bytes_per_interval bytes per service interval of the endpoint on isochronous transfer,
+ *             bytes per transfer on bulk transfer
+ * @param[out] bytes_per_sec bandwidth reserved for the isochronous endpoint, zero on bulk transfer
+ */
+uvc_error_t uvc_stream_get_bandwidth(uvc_stream_handle_t *strmh,
+		int *alt_setting, size_t *bytes_per_interval, uint32_t *bytes_per_sec) {
+
+	if (UNLIKELY(!strmh))
+		return UVC_ERROR_INVALID_PARAM;
+
+	if (alt_setting)
+		*alt_setting = strmh->alt_setting;
+	if (bytes_per_interval)
+		*bytes_per_interval = strmh->bytes_per_interval;
+	if (bytes_per_sec)
+		*bytes_per_sec = strmh->packet_us
+			? (uint32_t)((uint64_t)strmh->bytes_per_interval * 1000000 / strmh->packet_us) : 0;
+
+	return UVC_SUCCESS;
+}
+
+/** XXX Get the number of transfers and the packets per transfer in use
+ * @ingroup streaming
+ *
+ * @param strmh UVC stream
+ * @param[out] num_transfers number of queued transfers
+ * @param[out] packets_per_transfer packets per isochronous transfer, zero on bulk transfer
+ */
+uvc_error_t uvc_stream_get_transfer_config(uvc_stream_handle_t *strmh,
+		int *num_transfers, int *packets_per_transfer) {
+
+	if (UNLIKELY(!strmh))
+		return UVC_ERROR_INVALID_PARAM;
+
+	if (num_transfers)
+		*num_transfers = strmh->num_transfers;
+	if (packets_per_transfer)
+		*packets_per_transfer = strmh->packets_per_transfer;
+
+	return UVC_SUCCESS;
+}
+
+/** @internal
+ * @brief Maximum bytes that the isochronous endpoint transfers per service interval
+ * On SuperSpeed this is taken from the endpoint companion descriptor,
+ * wMaxPacketSize has only the size of one packet of a burst.
+ */
+static size_t _uvc_endpoint_bytes_per_interval(uvc_stream_handle_t *strmh,
+		const struct libusb_endpoint_descriptor *endpoint) {
+
+	const int speed = libusb_get_device_speed(libusb_get_device(strmh->devh->usb_devh));
+	// wMaxPacketSize: [unused:2 (multiplier-1):3 size:11]
+	// bit10…0:		maximum packet size
+	// bit12…11:	the number of additional transaction opportunities per microframe for high-speed
+	//				00 = None (1 transaction per microframe)
+	//				01 = 1 additional (2 per microframe)
+	//				10 = 2 additional (3 per microframe)
+	//				11 = Reserved
+	const size_t packet_size = endpoint->wMaxPacketSize & 0x07ff;
+	size_t bytes = packet_size * (((endpoint->wMaxPacketSize >> 11) & 3) + 1);
+
+	if (speed >= LIBUSB_SPEED_SUPER) {
+		struct libusb_ss_endpoint_companion_descriptor *ep_comp = NULL;
+		if (!libusb_get_ss_endpoint_companion_descriptor(strmh->devh->dev->ctx->usb_ctx,
+				endpoint, &ep_comp) && ep_comp) {
+			// bmAttributes bit1…0 is Mult (packets = (Mult + 1) * (bMaxBurst + 1) per service interval)
+			bytes = ep_comp->wBytesPerInterval
+				? ep_comp->wBytesPerInterval
+				: packet_size * (ep_comp->bMaxBurst + 1) * ((ep_comp->bmAttributes & 3) + 1);
+			libusb_free_ss_endpoint_companion_descriptor(ep_comp);
+		} else {
+			// SuperSpeed endpoint must have the companion descriptor
+			LOGW("no endpoint companion descriptor for 0x%02x", endpoint->bEndpointAddress);
+		}
+	}
+
+	return bytes;
+}
+
+/** @internal
+ * @brief Decide the number of transfers and the packets per transfer for isochronous transfer
+ * Each transfer covers half of the frame interval within [LIBUVC_XFER_MIN_US, LIBUVC_XFER_MAX_US]
+ * and queued transfers cover LIBUVC_XFER_QUEUE_US within LIBUVC_MAX_XFER_MEMORY.
+ * @param endpoint endpoint of the selected altsetting
+ * @param frame_us frame interval in micro seconds
+ * @param endpoint_bytes_per_packet maximum bytes per service interval of the endpoint
+ */
+static void _uvc_tune_iso_transfers(uvc_stream_handle_t *strmh,
+		const struct libusb_endpoint_descriptor *endpoint,
+		uint32_t frame_us, size_t endpoint_bytes_per_packet) {
+
+	const int speed = libusb_get_device_speed(libusb_get_device(strmh->devh->usb_devh));
+	uint32_t packet_us, xfer_us;
+	int packets, num;
+
+	/* service interval is 2^(bInterval-1) (micro)frames */
+	packet_us = speed >= LIBUSB_SPEED_HIGH ? 125 : 1000;
+	if ((endpoint->bInterval > 1) && (endpoint->bInterval <= 16))
+		packet_us <<= (endpoint->bInterval - 1);
+
+	if (strmh->req_packets_per_transfer > 0) {
+		packets = strmh->req_packets_per_transfer;
+	} else {
+		xfer_us = frame_us / 2;
+		if (xfer_us < LIBUVC_XFER_MIN_US)
+			xfer_us = LIBUVC_XFER_MIN_US;
+		else if (xfer_us > LIBUVC_XFER_MAX_US)
+			xfer_us = LIBUVC_XFER_MAX_US;
+		packets = xfer_us / packet_us;
+	}
+	if (packets < 1)
+		packets = 1;
+	else if (packets > LIBUVC_MAX_ISO_PACKETS)
+		packets = LIBUVC_MAX_ISO_PACKETS;
+	xfer_us = packets * packet_us;
+
+	if (strmh->req_num_transfers > 0) {
+		num = strmh->req_num_transfers;
+	} else {
+		const size_t xfer_bytes = packets * endpoint_bytes_per_packet;
+		num = (LIBUVC_XFER_QUEUE_US + xfer_us - 1) / xfer_us;
+		if (num > LIBUVC_MAX_TRANSFER_BUFS)
+			num = LIBUVC_MAX_TRANSFER_BUFS;
+		for (; (num > LIBUVC_MIN_TRANSFER_BUFS) && (num * xfer_bytes > LIBUVC_MAX_XFER_MEMORY); num--);
+		if (num < LIBUVC_MIN_TRANSFER_BUFS)
+			num = LIBUVC_MIN_TRANSFER_BUFS;
+	}
+
+	strmh->num_transfers = num;
+	strmh->packets_per_transfer = packets;
+	strmh->packet_us = packet_us;
+	MARK("speed=%d,packet_us=%d,frame_us=%d,num_transfers=%d,packets_per_transfer=%d",
+		speed, packet_us, frame_us, num, packets);
+}
+
+/** @internal
+ * @brief Decide the number of transfers for bulk transfer
+ * Queued transfers cover LIBUVC_XFER_QUEUE_US within LIBUVC_MAX_XFER_MEMORY.
+ * @param frame_us frame interval in micro seconds
+ * @param frame_bytes maximum frame size
+ */
+static void _uvc_tune_bulk_transfers(uvc_stream_handle_t *strmh,
+		uint32_t frame_us, size_t frame_bytes) {
+
+	const size_t xfer_bytes = strmh->cur_ctrl.dwMaxPayloadTransferSize;
+	int num;
+
+	if (strmh->req_num_transfers > 0) {
+		num = strmh->req_num_transfers;
+	} else if (LIKELY(xfer_bytes && frame_us)) {
+		/* bytes that the camera sends within LIBUVC_XFER_QUEUE_US */
+		const uint64_t queue_bytes = (uint64_t)frame_bytes * LIBUVC_XFER_QUEUE_US / frame_us;
+		num = (int)((queue_bytes + xfer_bytes - 1) / xfer_bytes);
+		if (num > LIBUVC_MAX_TRANSFER_BUFS)
+			num = LIBUVC_MAX_TRANSFER_BUFS;
+		for (; (num > LIBUVC_MIN_TRANSFER_BUFS) && (num * xfer_bytes > LIBUVC_MAX_XFER_MEMORY); num--);
+		if (num < LIBUVC_MIN_TRANSFER_BUFS)
+			num = LIBUVC_MIN_TRANSFER_BUFS;
+	} else {
+		num = LIBUVC_MIN_TRANSFER_BUFS;
+	}
+
+	strmh->num_transfers = num;
+	strmh->packets_per_transfer = 0;
+	strmh->packet_us = 0;
+	strmh->alt_setting = 0;
+	strmh->bytes_per_interval = xfer_bytes;
+	MARK("frame_us=%d,num_transfers=%d", frame_us, num);
+}
+
+/** @internal
+ * @brief Free the arrays of transfers, transfers themselves are freed on their completion
+ * or by uvc_stream_stop, including the spare transfer
+ */
+static void _uvc_free_transfer_array(uvc_stream_handle_t *strmh) {
+	strmh->spare_transfer = NULL;
+	if (strmh->transfers) {
+		free(strmh->transfers);
+		strmh->transfers = NULL;
+	}
+	if (strmh->transfer_bufs) {
+		free(strmh->transfer_bufs);
+		strmh->transfer_bufs = NULL;
+	}
+	strmh->num_transfers = 0;
+}
+
+/** @internal
+ * @brief Free the transfers [first, last) and their buffers that were never submitted
+ * or failed to submit, these are never reaped by _uvc_delete_transfer
+ */
+static void _uvc_free_transfers(uvc_stream_handle_t *strmh, int first, int last) {
+	int i;
+
+	for (i = first; i < last; i++) {
+		if (strmh->transfers[i]) {
+			libusb_free_transfer(strmh->transfers[i]);
+			strmh->transfers[i] = NULL;
+		}
+		free(strmh->transfer_bufs[i]);
+		strmh->transfer_bufs[i] = NULL;
+	}
+}
+
+/** @internal
+ * @brief Allocate the arrays of transfers for strmh->num_transfers
+ * and the spare transfer on resubmit first mode, which is the last one
+ */
+static uvc_error_t _uvc_alloc_transfer_array(uvc_stream_handle_t *strmh) {
+	const int num = strmh->num_transfers + (strmh->resubmit_first ? 1 : 0);
+
+	_uvc_free_transfer_array(strmh);
+	strmh->transfers = calloc(num, sizeof(struct libusb_transfer *));
+	strmh->transfer_bufs = calloc(num, sizeof(uint8_t *));
+	if (UNLIKELY(!strmh->transfers || !strmh->transfer_bufs)) {
+		_uvc_free_transfer_array(strmh);
+		return UVC_ERROR_NO_MEM;
+	}
+	strmh->num_transfers = num;
+
+	return UVC_SUCCESS;
+}
+
 /** Begin streaming video from the stream into the callback function.
  * @ingroup streaming
  *
@@ -1395,7 +2310,7 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 	/* Total amount of data per transfer */
 	size_t total_transfer_size;
 	struct libusb_transfer *transfer;
-	int transfer_id;
+	int transfer_id, num_submit;
 
 	ctrl = &strmh->cur_ctrl;
 
@@ -1412,6 +2327,12 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 	strmh->pts = 0;
 	strmh->last_scr = 0;
 	strmh->bfh_err = 0;	// XXX
+	strmh->frame_host_ns = strmh->capture_ns = 0;
+	memset(&strmh->stats, 0, sizeof(strmh->stats));
+	strmh->fps_frames = 0;
+	strmh->fps_start_ns = 0;
+	uvc_clock_init(&strmh->clock, ctrl->dwClockFrequency
+		? ctrl->dwClockFrequency : strmh->devh->info->ctrl_if.dwClockFrequency);
 
 	frame_desc = uvc_find_frame_desc_stream(strmh, ctrl->bFormatIndex, ctrl->bFrameIndex);
 	if (UNLIKELY(!frame_desc)) {
@@ -1420,6 +2341,8 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 		goto fail;
 	}
 	format_desc = frame_desc->parent;
+	strmh->frame_width = frame_desc->wWidth;
+	strmh->frame_height = frame_desc->wHeight;
 
 	strmh->frame_format = uvc_frame_format_for_guid(format_desc->guidFormat);
 	if (UNLIKELY(strmh->frame_format == UVC_FRAME_FORMAT_UNKNOWN)) {
@@ -1429,6 +2352,20 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 	}
 	const uint32_t dwMaxVideoFrameSize = ctrl->dwMaxVideoFrameSize <= frame_desc->dwMaxVideoFrameBufferSize
 		? ctrl->dwMaxVideoFrameSize : frame_desc->dwMaxVideoFrameBufferSize;
+	// frame interval in micro seconds (dwFrameInterval is in 100ns unit)
+	const uint32_t frame_interval = ctrl->dwFrameInterval ? ctrl->dwFrameInterval : frame_desc->dwDefaultFrameInterval;
+	const uint32_t frame_us = frame_interval ? (frame_interval + 9) / 10 : 33333;
+
+	if (UNLIKELY(strmh->zero_copy && !cb)) {
+		ret = UVC_ERROR_INVALID_PARAM;
+		LOGE("zero copy mode needs callback function");
+		goto fail;
+	}
+	ret = _uvc_stream_prepare_buffers(strmh, dwMaxVideoFrameSize);
+	if (UNLIKELY(ret != UVC_SUCCESS)) {
+		LOGE("failed to allocate frame buffers");
+		goto fail;
+	}
 
 	// Get the interface that provides the chosen format and frame configuration
 	interface_id = strmh->stream_if->bInterfaceNumber;
@@ -1490,17 +2427,7 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 			for (ep_idx = 0; ep_idx < altsetting->bNumEndpoints; ep_idx++) {
 				endpoint = altsetting->endpoint + ep_idx;
 				if (endpoint->bEndpointAddress == format_desc->parent->bEndpointAddress) {
-					endpoint_bytes_per_packet = endpoint->wMaxPacketSize;
-					// wMaxPacketSize: [unused:2 (multiplier-1):3 size:11]
-					// bit10…0:		maximum packet size
-					// bit12…11:	the number of additional transaction opportunities per microframe for high-speed
-					//				00 = None (1 transaction per microframe)
-					//				01 = 1 additional (2 per microframe)
-					//				10 = 2 additional (3 per microframe)
-					//				11 = Reserved
-					endpoint_bytes_per_packet
-						= (endpoint_bytes_per_packet & 0x07ff)
-							* (((endpoint_bytes_per_packet >> 11) & 3) + 1);
+					endpoint_bytes_per_packet = _uvc_endpoint_bytes_per_interval(strmh, endpoint);
 					break;
 				}
 			}
@@ -1508,16 +2435,15 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 			if (LIKELY(endpoint_bytes_per_packet)) {
 				if ( (endpoint_bytes_per_packet >= config_bytes_per_packet)
 					|| (alt_idx == num_alt) ) {	// XXX always match to last altsetting for buggy device
-					/* Transfers will be at most one frame long: Divide the maximum frame size
-					 * by the size of the endpoint and round up */
-					packets_per_transfer = (dwMaxVideoFrameSize
-							+ endpoint_bytes_per_packet - 1)
-							/ endpoint_bytes_per_packet;		// XXX cashed by zero divided exception occured
-
-					/* But keep a reasonable limit: Otherwise we start dropping data */
-					if (packets_per_transfer > 32)
-						packets_per_transfer = 32;
-
+					/* Decide the transfer size and the number of transfers from the frame interval
+					 * and the bandwidth of the endpoint */
+					_uvc_tune_iso_transfers(strmh, endpoint, frame_us, endpoint_bytes_per_packet);
+					strmh->alt_setting = altsetting->bAlternateSetting;
+					strmh->bytes_per_interval = endpoint_bytes_per_packet;
+					LOGI("altsetting=%d,bytes_per_interval=%d,interval=%dus,required=%d",
+						strmh->alt_setting, (int)endpoint_bytes_per_packet,
+						strmh->packet_us, (int)config_bytes_per_packet);
+					packets_per_transfer = strmh->packets_per_transfer;
 					total_transfer_size = packets_per_transfer * endpoint_bytes_per_packet;
 					break;
 				}
@@ -1551,11 +2477,19 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 		}
 
 		/* Set up the transfers */
-		MARK("Set up the transfers");
-		for (transfer_id = 0; transfer_id < LIBUVC_NUM_TRANSFER_BUFS; ++transfer_id) {
+		MARK("Set up the transfers:num=%d,packets=%d", strmh->num_transfers, (int)packets_per_transfer);
+		ret = _uvc_alloc_transfer_array(strmh);
+		if (UNLIKELY(ret != UVC_SUCCESS))
+			goto fail;
+		for (transfer_id = 0; transfer_id < strmh->num_transfers; ++transfer_id) {
 			transfer = libusb_alloc_transfer(packets_per_transfer);
 			strmh->transfers[transfer_id] = transfer;
 			strmh->transfer_bufs[transfer_id] = malloc(total_transfer_size);
+			if (UNLIKELY(!transfer || !strmh->transfer_bufs[transfer_id])) {
+				_uvc_free_transfers(strmh, 0, transfer_id + 1);
+				ret = UVC_ERROR_NO_MEM;
+				goto fail;
+			}
 
 			libusb_fill_iso_transfer(transfer, strmh->devh->usb_devh,
 				format_desc->parent->bEndpointAddress,
@@ -1568,10 +2502,19 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 	} else {
 		MARK("bulk transfer mode");
 		/** prepare for bulk transfer */
-		for (transfer_id = 0; transfer_id < LIBUVC_NUM_TRANSFER_BUFS; ++transfer_id) {
+		_uvc_tune_bulk_transfers(strmh, frame_us, dwMaxVideoFrameSize);
+		ret = _uvc_alloc_transfer_array(strmh);
+		if (UNLIKELY(ret != UVC_SUCCESS))
+			goto fail;
+		for (transfer_id = 0; transfer_id < strmh->num_transfers; ++transfer_id) {
 			transfer = libusb_alloc_transfer(0);
 			strmh->transfers[transfer_id] = transfer;
 			strmh->transfer_bufs[transfer_id] = malloc(strmh->cur_ctrl.dwMaxPayloadTransferSize);
+			if (UNLIKELY(!transfer || !strmh->transfer_bufs[transfer_id])) {
+				_uvc_free_transfers(strmh, 0, transfer_id + 1);
+				ret = UVC_ERROR_NO_MEM;
+				goto fail;
+			}
 			libusb_fill_bulk_transfer(transfer, strmh->devh->usb_devh,
 				format_desc->parent->bEndpointAddress,
 				strmh->transfer_bufs[transfer_id],
@@ -1580,6 +2523,31 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 		}
 	}
 
+	// the spare transfer is allocated with the others and is not submitted here
+	num_submit = strmh->num_transfers;
+	if (strmh->resubmit_first) {
+		num_submit--;
+		strmh->spare_transfer = strmh->transfers[num_submit];
+	}
+
+	// the trace of the previous stream is still open if its transfers were not reaped
+	_uvc_close_trace(strmh);
+	if (UNLIKELY(strmh->trace_path)) {
+		uvc_trace_info_t info;
+		memset(&info, 0, sizeof(info));
+		info.frame_format = strmh->frame_format;
+		info.width = strmh->frame_width;
+		info.height = strmh->frame_height;
+		info.max_frame_bytes = dwMaxVideoFrameSize;
+		info.max_payload_bytes = strmh->cur_ctrl.dwMaxPayloadTransferSize;
+		info.clock_frequency = strmh->clock.dev_hz;
+		info.packet_us = strmh->packet_us;
+		strmh->trace = uvc_trace_open_write(strmh->trace_path, &info,
+			strmh->transfers[0]->length, strmh->transfers[0]->num_iso_packets);
+		if (UNLIKELY(!strmh->trace))
+			LOGW("failed to create trace file %s", strmh->trace_path);
+	}
+
 	strmh->user_cb = cb;
 	strmh->user_ptr = user_ptr;
 
@@ -1591,7 +2559,7 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 		pthread_create(&strmh->cb_thread, NULL, _uvc_user_caller, (void*) strmh);
 	}
 	MARK("submit transfers");
-	for (transfer_id = 0; transfer_id < LIBUVC_NUM_TRANSFER_BUFS; transfer_id++) {
+	for (transfer_id = 0; transfer_id < num_submit; transfer_id++) {
 		ret = libusb_submit_transfer(strmh->transfers[transfer_id]);
 		if (UNLIKELY(ret != UVC_SUCCESS)) {
 			UVC_DEBUG("libusb_submit_transfer failed");
@@ -1600,8 +2568,13 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 	}
 
 	if (UNLIKELY(ret != UVC_SUCCESS)) {
-		/** @todo clean up transfers and memory */
-		goto fail;
+		// XXX the transfers not submitted are freed here, uvc_stream_stop cancels the submitted ones,
+		// joins the callback thread and closes the trace after they are reaped
+		_uvc_free_transfers(strmh, transfer_id, strmh->num_transfers);
+		strmh->spare_transfer = NULL;
+		uvc_stream_stop(strmh);
+		UVC_EXIT(ret);
+		return ret;
 	}
 
 	UVC_EXIT(ret);
@@ -1637,77 +2610,102 @@ uvc_error_t uvc_stream_start_iso(uvc_stream_handle_t *strmh,
 static void *_uvc_user_caller(void *arg) {
 	uvc_stream_handle_t *strmh = (uvc_stream_handle_t *) arg;
 
-	uint32_t last_seq = 0;
+	uvc_frame_t *frame;
+	int running;
 
 	for (; 1 ;) {
+		if (strmh->zero_copy && !strmh->hold_frame) {
+			// prepare the free frame buffer to leave in the ring instead of the frame we will take
+			strmh->hold_frame = _uvc_get_assemble_frame(strmh, strmh->assemble_bytes);
+		}
 		pthread_mutex_lock(&strmh->cb_mutex);
 		{
-			for (; strmh->running && (last_seq == strmh->hold_seq) ;) {
+			for (; (running = strmh->running) && !_uvc_ring_pop(strmh) ;) {
 				pthread_cond_wait(&strmh->cb_cond, &strmh->cb_mutex);
 			}
-
-			if (UNLIKELY(!strmh->running)) {
-				pthread_mutex_unlock(&strmh->cb_mutex);
-				break;
-			}
-
-			last_seq = strmh->hold_seq;
-			if (LIKELY(!strmh->hold_bfh_err))	// XXX
-				_uvc_populate_frame(strmh);
 		}
 		pthread_mutex_unlock(&strmh->cb_mutex);
 
-		if (LIKELY(!strmh->hold_bfh_err))	// XXX
-			strmh->user_cb(&strmh->frame, strmh->user_ptr);	// call user callback function
+		if (UNLIKELY(!running))
+			break;
+
+		if (strmh->zero_copy) {
+			// hand over the frame, the user callback will release it
+			frame = strmh->hold_frame;
+			strmh->hold_frame = NULL;
+			_uvc_populate_frame_info(strmh, frame);
+		} else {
+			_uvc_populate_frame(strmh);
+			frame = &strmh->frame;
+		}
+		strmh->user_cb(frame, strmh->user_ptr);	// call user callback function
 	}
 
 	return NULL; // return value ignored
 }
 
 /** @internal
- * @brief Populate the fields of a frame to be handed to user code
- * must be called with stream cb lock held!
+ * @brief Populate the fields except image data of a frame to be handed to user code
+ * must be called from the thread that took hold_frame from the frame ring!
  */
-void _uvc_populate_frame(uvc_stream_handle_t *strmh) {
-	size_t alloc_size = strmh->cur_ctrl.dwMaxVideoFrameSize;
-	uvc_frame_t *frame = &strmh->frame;
-	uvc_frame_desc_t *frame_desc;
-
-	/** @todo this stuff that hits the main config cache should really happen
-	 * in start() so that only one thread hits these data. all of this stuff
-	 * is going to be reopen_on_change anyway
-	 */
-
-	frame_desc = uvc_find_frame_desc(strmh->devh, strmh->cur_ctrl.bFormatIndex,
-			strmh->cur_ctrl.bFrameIndex);
+static void _uvc_populate_frame_info(uvc_stream_handle_t *strmh, uvc_frame_t *frame) {
 
+	// XXX frame size is taken from the frame descriptor in start()
 	frame->frame_format = strmh->frame_format;
 
-	frame->width = frame_desc->wWidth;
-	frame->height = frame_desc->wHeight;
+	frame->width = strmh->frame_width;
+	frame->height = strmh->frame_height;
 	// XXX set actual_bytes to zero when erro bits is on
 	frame->actual_bytes = LIKELY(!strmh->hold_bfh_err) ? strmh->hold_bytes : 0;
 
 	switch (frame->frame_format) {
 	case UVC_FRAME_FORMAT_YUYV:
+	case UVC_FRAME_FORMAT_UYVY:
 		frame->step = frame->width * 2;
 		break;
+	case UVC_FRAME_FORMAT_GRAY8:
+	case UVC_FRAME_FORMAT_BY8:
+	case UVC_FRAME_FORMAT_NV12:
+	case UVC_FRAME_FORMAT_I420:
+		// step of Y plane for planar formats
+		frame->step = frame->width;
+		break;
 	case UVC_FRAME_FORMAT_MJPEG:
+	case UVC_FRAME_FORMAT_H264:
+	case UVC_FRAME_FORMAT_H265:
 		frame->step = 0;
 		break;
 	default:
 		frame->step = 0;
 		break;
 	}
+	frame->color_matrix = strmh->color_matrix;
+	frame->color_range = strmh->color_range;
+	frame->sequence = strmh->hold_seq;
+	frame->capture_time.tv_sec = strmh->hold_capture_ns / 1000000000LL;
+	frame->capture_time.tv_usec = (strmh->hold_capture_ns % 1000000000LL) / 1000;
+	// XXX the frame may be reused, clear the stages of the application too
+	memset(frame->stage_ns, 0, sizeof(frame->stage_ns));
+	frame->stage_ns[UVC_FRAME_STAGE_RECEIVED] = strmh->hold_received_ns;
+	frame->stage_ns[UVC_FRAME_STAGE_COMPLETED] = strmh->hold_completed_ns;
+	frame->stage_ns[UVC_FRAME_STAGE_HANDED] = uvc_clock_host_ns();
+}
+
+/** @internal
+ * @brief Populate the fields of a frame to be handed to user code
+ * must be called from the thread that took hold_frame from the frame ring!
+ */
+void _uvc_populate_frame(uvc_stream_handle_t *strmh) {
+	uvc_frame_t *frame = &strmh->frame;
+
+	_uvc_populate_frame_info(strmh, frame);
 
 	/* copy the image data from the hold buffer to the frame (unnecessary extra buf?) */
 	if (UNLIKELY(frame->data_bytes < strmh->hold_bytes)) {
 		frame->data = realloc(frame->data, strmh->hold_bytes);	// TODO add error handling when failed realloc
-		frame->data_bytes = strmh->hold_bytes;
+		frame->data_bytes = frame->alloc_bytes = strmh->hold_bytes;
 	}
-	memcpy(frame->data, strmh->holdbuf, strmh->hold_bytes/*frame->data_bytes*/);	// XXX
-
-	/** @todo set the frame time */
+	memcpy(frame->data, strmh->hold_frame->data, strmh->hold_bytes/*frame->data_bytes*/);	// XXX
 }
 
 /** Poll for a frame
@@ -1732,10 +2730,9 @@ uvc_error_t uvc_stream_get_frame(uvc_stream_handle_t *strmh,
 
 	pthread_mutex_lock(&strmh->cb_mutex);
 	{
-		if (strmh->last_polled_seq < strmh->hold_seq) {
+		if (_uvc_ring_pop(strmh)) {
 			_uvc_populate_frame(strmh);
 			*frame = &strmh->frame;
-			strmh->last_polled_seq = strmh->hold_seq;
 		} else if (timeout_us != -1) {
 			if (!timeout_us) {
 				pthread_cond_wait(&strmh->cb_cond, &strmh->cb_mutex);
@@ -1759,10 +2756,9 @@ uvc_error_t uvc_stream_get_frame(uvc_stream_handle_t *strmh,
 				pthread_cond_timedwait(&strmh->cb_cond, &strmh->cb_mutex, &ts);
 			}
 
-			if (LIKELY(strmh->last_polled_seq < strmh->hold_seq)) {
+			if (LIKELY(_uvc_ring_pop(strmh))) {
 				_uvc_populate_frame(strmh);
 				*frame = &strmh->frame;
-				strmh->last_polled_seq = strmh->hold_seq;
 			} else {
 				*frame = NULL;
 			}
@@ -1812,11 +2808,14 @@ uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh) {
 		RETURN(UVC_ERROR_INVALID_PARAM, uvc_error_t);
 	}
 
-	strmh->running = 0;
+	__atomic_store_n(&strmh->running, 0, __ATOMIC_SEQ_CST);
+	// XXX the event thread may be submitting the spare transfer, it is in flight after this
+	for (; __atomic_load_n(&strmh->spare_users, __ATOMIC_SEQ_CST) ;)
+		sched_yield();
 
 	pthread_mutex_lock(&strmh->cb_mutex);
 	{
-		for (i = 0; i < LIBUVC_NUM_TRANSFER_BUFS; i++) {
+		for (i = 0; i < strmh->num_transfers; i++) {
 			if (strmh->transfers[i]) {
 				int res = libusb_cancel_transfer(strmh->transfers[i]);
 				if ((res < 0) && (res != LIBUSB_ERROR_NOT_FOUND)) {
@@ -1839,11 +2838,11 @@ uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh) {
 
 		/* Wait for transfers to complete/cancel */
 		for (; 1 ;) {
-			for (i = 0; i < LIBUVC_NUM_TRANSFER_BUFS; i++) {
+			for (i = 0; i < strmh->num_transfers; i++) {
 				if (strmh->transfers[i] != NULL)
 					break;
 			}
-			if (i == LIBUVC_NUM_TRANSFER_BUFS)
+			if (i == strmh->num_transfers)
 				break;
 
              ts.tv_sec = 0;
@@ -1864,6 +2863,9 @@ uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh) {
 		}
 		// Kick the user thread awake
 		pthread_cond_broadcast(&strmh->cb_cond);
+		// XXX otherwise the last transfer reaped closes the trace
+		if (_uvc_all_transfers_reaped(strmh))
+			_uvc_close_trace(strmh);
 	}
 	pthread_mutex_unlock(&strmh->cb_mutex);
 
@@ -1893,26 +2895,144 @@ void uvc_stream_close(uvc_stream_handle_t *strmh) {
 		uvc_stream_stop(strmh);
 
 	uvc_release_if(strmh->devh, strmh->stream_if->bInterfaceNumber);
+	DL_DELETE(strmh->devh->streams, strmh);
+	_uvc_stream_free(strmh);
 
+	UVC_EXIT_VOID();
+}
+
+/** @internal
+ * @brief Free the stream handle and all streaming resources
+ */
+static void _uvc_stream_free(uvc_stream_handle_t *strmh) {
 	if (strmh->frame.data) {
 		free(strmh->frame.data);
 		strmh->frame.data = NULL;
 	}
 
-	if (strmh->outbuf) {
-		free(strmh->outbuf);
-		strmh->outbuf = NULL;
+	if (strmh->assemble_frame) {
+		_uvc_release_frame(strmh, strmh->assemble_frame);
+		strmh->assemble_frame = NULL;
+		strmh->outbuf = NULL;	// outbuf was the data of assemble_frame
 	}
-	if (strmh->holdbuf) {
-		free(strmh->holdbuf);
-		strmh->holdbuf = NULL;
+	if (strmh->hold_frame) {
+		_uvc_release_frame(strmh, strmh->hold_frame);
+		strmh->hold_frame = NULL;
 	}
+	_uvc_free_frame_ring(strmh);
+	_uvc_close_trace(strmh);
+	_uvc_free_transfer_array(strmh);
+
+	if (strmh->trace_path)
+		free(strmh->trace_path);
 
 	pthread_cond_destroy(&strmh->cb_cond);
 	pthread_mutex_destroy(&strmh->cb_mutex);
 
-	DL_DELETE(strmh->devh->streams, strmh);
 	free(strmh);
+}
 
-	UVC_EXIT_VOID();
+/** XXX Feed a trace recorded with uvc_stream_set_trace to the callback function
+ * @ingroup streaming
+ *
+ * Transfers in the trace are processed by the same frame assembly as
+ * a real stream, and the assembled frames are passed to the callback
+ * function on the callback thread. This needs no device and returns
+ * after all transfers in the trace were processed.
+ *
+ * @param path path of the trace file
+ * @param cb   User callback function. See {uvc_frame_callback_t} for restrictions.
+ * @param user_ptr Pointer to pass to the callback function
+ * @param flags bitwise OR of enum uvc_replay_flags
+ * @param[out] stats statistics of the replayed stream, may be NULL
+ */
+uvc_error_t uvc_replay_trace(const char *path, uvc_frame_callback_t *cb, void *user_ptr,
+		int flags, uvc_stream_stats_t *stats) {
+
+	uvc_device_handle_t devh;
+	uvc_stream_handle_t *strmh;
+	uvc_trace_info_t info;
+	uvc_trace_t *trace;
+	struct libusb_transfer *transfer;
+	int64_t host_ns, first_ns = 0, start_ns = 0;
+	int r;
+	uvc_error_t ret;
+
+	UVC_ENTER();
+
+	if (UNLIKELY(!path || !cb)) {
+		UVC_EXIT(UVC_ERROR_INVALID_PARAM);
+		return UVC_ERROR_INVALID_PARAM;
+	}
+	trace = uvc_trace_open_read(path, &info);
+	if (UNLIKELY(!trace)) {
+		UVC_EXIT(UVC_ERROR_IO);
+		return UVC_ERROR_IO;
+	}
+	strmh = calloc(1, sizeof(*strmh));
+	if (UNLIKELY(!strmh)) {
+		uvc_trace_close(trace);
+		UVC_EXIT(UVC_ERROR_NO_MEM);
+		return UVC_ERROR_NO_MEM;
+	}
+
+	// there is no device, stream_if == NULL means replaying
+	memset(&devh, 0, sizeof(devh));
+	strmh->devh = &devh;
+	strmh->frame.library_owns_data = 1;
+	strmh->size_buf = LIBUVC_XFER_BUF_SIZE;
+	strmh->num_slots = LIBUVC_NUM_FRAME_SLOTS;
+	strmh->drop_policy = UVC_FRAME_DROP_OLDEST;
+	strmh->frame_format = info.frame_format;
+	strmh->frame_width = info.width;
+	strmh->frame_height = info.height;
+	strmh->cur_ctrl.dwMaxVideoFrameSize = info.max_frame_bytes;
+	strmh->cur_ctrl.dwMaxPayloadTransferSize = info.max_payload_bytes;
+	strmh->packet_us = info.packet_us;
+	uvc_clock_init(&strmh->clock, info.clock_frequency);
+	pthread_mutex_init(&strmh->cb_mutex, NULL);
+	pthread_cond_init(&strmh->cb_cond, NULL);
+
+	ret = _uvc_stream_prepare_buffers(strmh, info.max_frame_bytes);
+	if (LIKELY(ret == UVC_SUCCESS)) {
+		strmh->user_cb = cb;
+		strmh->user_ptr = user_ptr;
+		strmh->running = 1;
+		pthread_create(&strmh->cb_thread, NULL, _uvc_user_caller, (void*) strmh);
+
+		for (; (r = uvc_trace_read_transfer(trace, &transfer, &host_ns)) > 0 ;) {
+			if (flags & UVC_REPLAY_REALTIME) {
+				// keep the recorded interval between transfers
+				const int64_t now = uvc_clock_host_ns();
+				if (!start_ns) {
+					start_ns = now;
+					first_ns = host_ns;
+				}
+				const int64_t wait_ns = (host_ns - first_ns) - (now - start_ns);
+				if (wait_ns > 0)
+					usleep(wait_ns / 1000);
+			} else {
+				// wait for the callback so that no frame is dropped
+				for (; _uvc_ring_full(strmh) ;)
+					usleep(100);
+			}
+			_uvc_process_transfer(strmh, transfer, host_ns);
+		}
+		if (UNLIKELY(r < 0)) {
+			LOGW("broken trace file");
+			ret = UVC_ERROR_IO;
+		}
+		// the frame being assembled at the end of the trace is discarded
+		for (; !_uvc_ring_empty(strmh) ;)
+			usleep(100);
+		uvc_stream_stop(strmh);
+		if (stats)
+			uvc_stream_get_stats(strmh, stats);
+	}
+
+	_uvc_stream_free(strmh);
+	uvc_trace_close(trace);
+
+	UVC_EXIT(ret);
+	return ret;
 }
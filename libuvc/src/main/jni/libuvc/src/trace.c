@@ -0,0 +1,404 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/** @internal
+ * @file
+ * @brief Payload trace file to record and replay completed transfers
+ *
+ * The file starts with a header and stream info, followed by a record
+ * for each completed transfer:
+ * - bulk transfer: record, actual_length bytes of data
+ * - isochronous transfer: record, num_packets of packet descriptors,
+ *   actual_length bytes of data of each packet without gaps
+ *
+ * All values are in the byte order of the host (little endian on every
+ * platform we support).
+ *
+ * While recording, the USB event thread only copies each record into
+ * a chunk buffer. Filled chunks are handed to a writer thread that does
+ * the file I/O, so a slow storage never delays the event thread. When all
+ * chunks are waiting to be written, records are dropped and counted.
+ */
+
+#define LOG_TAG "libuvc/trace"
+#ifndef LOG_NDEBUG
+	#define	LOG_NDEBUG
+#endif
+#undef USE_LOGALL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#define TRACE_MAGIC "UVCT"
+#define TRACE_VERSION 1
+/* buffer of stdio, only the writer thread and the reader use it */
+#define TRACE_FILE_BUF_SIZE ( 256 * 1024 )
+/* chunks that the USB event thread fills and the writer thread writes */
+#define TRACE_NUM_CHUNKS 8	// must be a power of 2
+#define TRACE_CHUNK_SIZE ( 512 * 1024 )
+
+typedef struct uvc_trace_header {
+	char magic[4];
+	uint16_t version;
+	uint16_t info_bytes;
+} uvc_trace_header_t;
+
+typedef struct uvc_trace_record {
+	int64_t host_ns;
+	/** actual_length on bulk transfer, length of each packet on isochronous transfer */
+	uint32_t length;
+	uint16_t num_packets;
+	uint16_t reserved;
+} uvc_trace_record_t;
+
+typedef struct uvc_trace_packet {
+	uint32_t status;
+	uint32_t actual_length;
+} uvc_trace_packet_t;
+
+struct uvc_trace {
+	FILE *fp;
+	char *fbuf;
+	/* for writing, the event thread fills chunks[head] and publishes it by
+	 * advancing head, the writer thread writes chunks until tail reaches head */
+	uint8_t *chunks[TRACE_NUM_CHUNKS];
+	size_t chunk_bytes[TRACE_NUM_CHUNKS];
+	size_t chunk_size;
+	size_t fill_bytes;	// bytes in chunks[head], only the event thread touches this
+	uint32_t head, tail;
+	sem_t filled;
+	pthread_t writer;
+	uint8_t has_writer;
+	uint8_t stopping;
+	uint8_t error;
+	uint32_t dropped;
+	/* for reading */
+	struct libusb_transfer *transfer;
+	int max_packets;
+	uint8_t *buf;
+	size_t buf_bytes;
+	uvc_trace_packet_t *packets;
+};
+
+static uvc_trace_t *_uvc_trace_open(const char *path, const char *mode) {
+	uvc_trace_t *trace = calloc(1, sizeof(uvc_trace_t));
+
+	if (UNLIKELY(!trace))
+		return NULL;
+	trace->fp = fopen(path, mode);
+	if (UNLIKELY(!trace->fp)) {
+		LOGE("failed to open %s", path);
+		free(trace);
+		return NULL;
+	}
+	trace->fbuf = malloc(TRACE_FILE_BUF_SIZE);
+	if (LIKELY(trace->fbuf))
+		setvbuf(trace->fp, trace->fbuf, _IOFBF, TRACE_FILE_BUF_SIZE);
+	return trace;
+}
+
+/** @internal
+ * @brief Write the chunks published by the event thread until the trace is closed
+ */
+static void *_uvc_trace_writer(void *arg) {
+	uvc_trace_t *trace = arg;
+	int stopping;
+
+	do {
+		sem_wait(&trace->filled);
+		stopping = __atomic_load_n(&trace->stopping, __ATOMIC_ACQUIRE);
+		uint32_t tail = trace->tail;
+		const uint32_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+		for (; tail != head; tail++) {
+			const int ix = tail & (TRACE_NUM_CHUNKS - 1);
+			if (LIKELY(!trace->error)
+				&& UNLIKELY(fwrite(trace->chunks[ix], 1, trace->chunk_bytes[ix], trace->fp) != trace->chunk_bytes[ix])) {
+				LOGW("failed to write trace, following records are discarded");
+				trace->error = 1;
+			}
+			// give the chunk back to the event thread
+			__atomic_store_n(&trace->tail, tail + 1, __ATOMIC_RELEASE);
+		}
+	} while (!stopping);
+
+	return NULL;
+}
+
+/** @internal
+ * @brief Create the trace file, write the stream info and start the writer thread
+ * @param max_transfer_bytes maximum length of a transfer of the stream
+ * @param num_packets number of iso packets of a transfer, zero on bulk transfer
+ * @return NULL on failure
+ */
+uvc_trace_t *uvc_trace_open_write(const char *path, const uvc_trace_info_t *info,
+		size_t max_transfer_bytes, int num_packets) {
+
+	uvc_trace_header_t header;
+	uvc_trace_t *trace = _uvc_trace_open(path, "wb");
+	const size_t max_record = sizeof(uvc_trace_record_t)
+		+ num_packets * sizeof(uvc_trace_packet_t) + max_transfer_bytes;
+	int i;
+
+	if (UNLIKELY(!trace))
+		return NULL;
+
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.info_bytes = sizeof(*info);
+	if (UNLIKELY((fwrite(&header, sizeof(header), 1, trace->fp) != 1)
+		|| (fwrite(info, sizeof(*info), 1, trace->fp) != 1))) {
+		uvc_trace_close(trace);
+		return NULL;
+	}
+	// every record has to fit into a chunk
+	trace->chunk_size = max_record > TRACE_CHUNK_SIZE ? max_record : TRACE_CHUNK_SIZE;
+	for (i = 0; i < TRACE_NUM_CHUNKS; i++) {
+		trace->chunks[i] = malloc(trace->chunk_size);
+		if (UNLIKELY(!trace->chunks[i])) {
+			uvc_trace_close(trace);
+			return NULL;
+		}
+	}
+	sem_init(&trace->filled, 0, 0);
+	if (UNLIKELY(pthread_create(&trace->writer, NULL, _uvc_trace_writer, trace))) {
+		sem_destroy(&trace->filled);
+		uvc_trace_close(trace);
+		return NULL;
+	}
+	trace->has_writer = 1;
+	return trace;
+}
+
+/** @internal
+ * @brief Hand the chunk being filled to the writer thread
+ */
+static void _uvc_trace_publish(uvc_trace_t *trace) {
+	const uint32_t head = trace->head;
+
+	if (trace->fill_bytes) {
+		trace->chunk_bytes[head & (TRACE_NUM_CHUNKS - 1)] = trace->fill_bytes;
+		trace->fill_bytes = 0;
+		__atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+		sem_post(&trace->filled);
+	}
+}
+
+static inline void _uvc_trace_put(uint8_t **p, const void *data, size_t bytes) {
+	memcpy(*p, data, bytes);
+	*p += bytes;
+}
+
+/** @internal
+ * @brief Append a completed transfer to the trace
+ * This is called from the USB event thread, it only copies the transfer
+ * into a chunk and never blocks.
+ * @return 0 on success, -1 if the transfer was dropped
+ */
+int uvc_trace_write_transfer(uvc_trace_t *trace, const struct libusb_transfer *transfer, int64_t host_ns) {
+	uvc_trace_record_t record;
+	size_t bytes;
+	uint8_t *p;
+	int i;
+
+	memset(&record, 0, sizeof(record));
+	record.host_ns = host_ns;
+	record.num_packets = transfer->num_iso_packets;
+	if (!record.num_packets) {
+		record.length = transfer->actual_length;
+		bytes = sizeof(record) + record.length;
+	} else {
+		record.length = transfer->iso_packet_desc[0].length;
+		bytes = sizeof(record) + record.num_packets * sizeof(uvc_trace_packet_t);
+		for (i = 0; i < transfer->num_iso_packets; i++)
+			bytes += transfer->iso_packet_desc[i].actual_length;
+	}
+	if (UNLIKELY(trace->fill_bytes + bytes > trace->chunk_size))
+		_uvc_trace_publish(trace);
+	if (UNLIKELY((!trace->fill_bytes
+			&& (trace->head - __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE) >= TRACE_NUM_CHUNKS))
+		|| (bytes > trace->chunk_size))) {
+		// the writer thread has not written any chunk yet, lose this transfer rather than blocking
+		trace->dropped++;
+		return -1;
+	}
+
+	p = trace->chunks[trace->head & (TRACE_NUM_CHUNKS - 1)] + trace->fill_bytes;
+	_uvc_trace_put(&p, &record, sizeof(record));
+	if (!record.num_packets) {
+		_uvc_trace_put(&p, transfer->buffer, record.length);
+	} else {
+		for (i = 0; i < transfer->num_iso_packets; i++) {
+			uvc_trace_packet_t packet;
+			packet.status = transfer->iso_packet_desc[i].status;
+			packet.actual_length = transfer->iso_packet_desc[i].actual_length;
+			_uvc_trace_put(&p, &packet, sizeof(packet));
+		}
+		for (i = 0; i < transfer->num_iso_packets; i++) {
+			const size_t n = transfer->iso_packet_desc[i].actual_length;
+			if (n)
+				_uvc_trace_put(&p, transfer->buffer + i * record.length, n);
+		}
+	}
+	trace->fill_bytes += bytes;
+	return 0;
+}
+
+/** @internal
+ * @brief Open the trace file and read the stream info
+ * @return NULL on failure
+ */
+uvc_trace_t *uvc_trace_open_read(const char *path, uvc_trace_info_t *info) {
+	uvc_trace_header_t header;
+	uvc_trace_t *trace = _uvc_trace_open(path, "rb");
+
+	if (UNLIKELY(!trace))
+		return NULL;
+
+	memset(info, 0, sizeof(*info));
+	if (UNLIKELY((fread(&header, sizeof(header), 1, trace->fp) != 1)
+		|| memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic))
+		|| (header.version != TRACE_VERSION)
+		|| (header.info_bytes > sizeof(*info))
+		|| (fread(info, header.info_bytes, 1, trace->fp) != 1))) {
+		LOGE("%s is not a trace file", path);
+		uvc_trace_close(trace);
+		return NULL;
+	}
+	return trace;
+}
+
+static int _uvc_trace_ensure_buf(uvc_trace_t *trace, size_t bytes) {
+	if (trace->buf_bytes < bytes) {
+		uint8_t *buf = realloc(trace->buf, bytes);
+		if (UNLIKELY(!buf))
+			return -1;
+		trace->buf = buf;
+		trace->buf_bytes = bytes;
+	}
+	return 0;
+}
+
+/** @internal
+ * @brief Read next transfer from the trace file
+ * @param[out] transfer the transfer rebuilt from the record, this is owned by trace
+ * and valid until next call
+ * @param[out] host_ns the host time that the transfer completed
+ * @return 1 on success, 0 at the end of the file, negative on error
+ */
+int uvc_trace_read_transfer(uvc_trace_t *trace, struct libusb_transfer **transfer, int64_t *host_ns) {
+	uvc_trace_record_t record;
+	struct libusb_transfer *xfer;
+	uint8_t *p;
+	int i;
+
+	if (fread(&record, sizeof(record), 1, trace->fp) != 1)
+		return feof(trace->fp) ? 0 : -1;
+
+	if (!trace->transfer || (trace->max_packets < record.num_packets)) {
+		if (trace->transfer)
+			libusb_free_transfer(trace->transfer);
+		free(trace->packets);
+		trace->transfer = libusb_alloc_transfer(record.num_packets);
+		trace->packets = malloc(sizeof(uvc_trace_packet_t) * (record.num_packets ? record.num_packets : 1));
+		if (UNLIKELY(!trace->transfer || !trace->packets))
+			return -1;
+		trace->max_packets = record.num_packets;
+	}
+	xfer = trace->transfer;
+	xfer->status = LIBUSB_TRANSFER_COMPLETED;
+	xfer->num_iso_packets = record.num_packets;
+
+	if (!record.num_packets) {
+		if (UNLIKELY(_uvc_trace_ensure_buf(trace, record.length ? record.length : 1)
+			|| (fread(trace->buf, 1, record.length, trace->fp) != record.length)))
+			return -1;
+		xfer->buffer = trace->buf;
+		xfer->length = xfer->actual_length = record.length;
+	} else {
+		if (UNLIKELY(fread(trace->packets, sizeof(uvc_trace_packet_t), record.num_packets, trace->fp) != record.num_packets)
+			|| _uvc_trace_ensure_buf(trace, (size_t)record.length * record.num_packets))
+			return -1;
+		xfer->buffer = trace->buf;
+		xfer->length = record.length * record.num_packets;
+		xfer->actual_length = 0;
+		for (i = 0, p = trace->buf; i < record.num_packets; i++, p += record.length) {
+			const uvc_trace_packet_t *packet = &trace->packets[i];
+			if (UNLIKELY((packet->actual_length > record.length)
+				|| (fread(p, 1, packet->actual_length, trace->fp) != packet->actual_length)))
+				return -1;
+			xfer->iso_packet_desc[i].length = record.length;
+			xfer->iso_packet_desc[i].actual_length = packet->actual_length;
+			xfer->iso_packet_desc[i].status = packet->status;
+			xfer->actual_length += packet->actual_length;
+		}
+	}
+	*transfer = xfer;
+	*host_ns = record.host_ns;
+	return 1;
+}
+
+/** @internal
+ * @brief Close the trace file and free resources
+ */
+void uvc_trace_close(uvc_trace_t *trace) {
+	int i;
+
+	if (!trace)
+		return;
+	if (trace->has_writer) {
+		// write the last chunk and everything not written yet
+		_uvc_trace_publish(trace);
+		__atomic_store_n(&trace->stopping, 1, __ATOMIC_RELEASE);
+		sem_post(&trace->filled);
+		pthread_join(trace->writer, NULL);
+		sem_destroy(&trace->filled);
+		if (UNLIKELY(trace->dropped))
+			LOGW("%u transfers were not recorded", trace->dropped);
+	}
+	for (i = 0; i < TRACE_NUM_CHUNKS; i++)
+		free(trace->chunks[i]);
+	if (trace->fp)
+		fclose(trace->fp);
+	if (trace->transfer)
+		libusb_free_transfer(trace->transfer);
+	free(trace->packets);
+	free(trace->buf);
+	free(trace->fbuf);
+	free(trace);
+}
@@ -0,0 +1,120 @@
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+#include "uvc_test.h"
+#include <string.h>
+
+/* Feeds SCR samples of a simulated device clock with drift and random
+ * delays of arrival into the clock recovery and checks that PTS is
+ * converted back to the host time when the frame was captured. */
+
+#define DEV_HZ 48000000
+#define PACKET_NS 125000LL
+#define MAX_DELAY_NS 400000
+#define MAX_ERROR_NS 50000
+
+typedef struct sim_device {
+	double hz;	// actual frequency of the device clock
+	uint32_t stc0;	// device clock at host time zero
+	uint32_t seed;
+} sim_device_t;
+
+static uint32_t next_random(sim_device_t *dev) {
+	dev->seed = dev->seed * 1103515245u + 12345u;
+	return dev->seed >> 8;
+}
+
+static uint32_t dev_clock(const sim_device_t *dev, int64_t host_ns) {
+	return dev->stc0 + (uint32_t)(int64_t)((double)host_ns * dev->hz / 1e9);
+}
+
+/** feed a payload every PACKET_NS in [start_ns, end_ns), each arrives with random delay */
+static void feed(uvc_clock_t *clock, sim_device_t *dev, int64_t start_ns, int64_t end_ns) {
+	int64_t t;
+
+	for (t = start_ns; t < end_ns; t += PACKET_NS)
+		uvc_clock_add_sample(clock, dev_clock(dev, t), t + next_random(dev) % MAX_DELAY_NS);
+}
+
+/** @return error of the recovered capture time of a frame captured at capture_ns */
+static int64_t capture_error(const uvc_clock_t *clock, const sim_device_t *dev, int64_t capture_ns) {
+	int64_t host_ns = 0;
+
+	if (!uvc_clock_to_host(clock, dev_clock(dev, capture_ns), &host_ns))
+		return INT64_MAX;
+	return host_ns - capture_ns;
+}
+
+static int64_t abs64(const int64_t v) {
+	return v < 0 ? -v : v;
+}
+
+static void test_drift(const double ppm) {
+	uvc_clock_t clock;
+	sim_device_t dev;
+	int64_t err;
+	double drift;
+
+	memset(&dev, 0, sizeof(dev));
+	dev.hz = DEV_HZ * (1.0 + ppm * 1e-6);
+	// the 32 bits device clock wraps around in the first second
+	dev.stc0 = 0xffffffffu - DEV_HZ / 2;
+	dev.seed = 1;
+	uvc_clock_init(&clock, DEV_HZ);
+	EXPECT(!uvc_clock_to_host(&clock, 0, &err));
+
+	feed(&clock, &dev, 1000000000LL, 5000000000LL);
+	EXPECT(clock.valid);
+	drift = (1e9 / clock.ns_per_tick) / dev.hz - 1.0;
+	EXPECT_MSG(drift > -20e-6 && drift < 20e-6, "ppm=%.0f fitted drift=%.1f ppm", ppm, drift * 1e6);
+	// a frame captured 30 msec before the last payload
+	err = capture_error(&clock, &dev, 5000000000LL - 30000000LL);
+	EXPECT_MSG(abs64(err) < MAX_ERROR_NS, "ppm=%.0f err=%lld ns", ppm, (long long) err);
+}
+
+static void test_reset(void) {
+	uvc_clock_t clock;
+	sim_device_t dev;
+	int64_t err;
+
+	memset(&dev, 0, sizeof(dev));
+	dev.hz = DEV_HZ * (1.0 - 300e-6);
+	dev.stc0 = 0x40000000u;
+	dev.seed = 7;
+	uvc_clock_init(&clock, DEV_HZ);
+	feed(&clock, &dev, 1000000000LL, 3000000000LL);
+	EXPECT(clock.valid);
+
+	// the device was reset and its clock restarts from a smaller value
+	dev.stc0 = 0x1000u - dev_clock(&dev, 3000000000LL) + dev.stc0;
+	feed(&clock, &dev, 3000000000LL, 6000000000LL);
+	EXPECT(clock.valid);
+	// the samples before the reset were discarded
+	EXPECT(clock.count < LIBUVC_CLOCK_SAMPLES);
+	err = capture_error(&clock, &dev, 6000000000LL - 30000000LL);
+	EXPECT_MSG(abs64(err) < MAX_ERROR_NS, "err=%lld ns", (long long) err);
+}
+
+static void test_unknown_frequency(void) {
+	uvc_clock_t clock;
+	sim_device_t dev;
+	int64_t err;
+
+	memset(&dev, 0, sizeof(dev));
+	dev.hz = 15000000.0;
+	dev.seed = 3;
+	// the device did not tell the frequency, it is taken from the fit only
+	uvc_clock_init(&clock, 0);
+	feed(&clock, &dev, 1000000000LL, 5000000000LL);
+	EXPECT(clock.valid);
+	err = capture_error(&clock, &dev, 5000000000LL - 30000000LL);
+	EXPECT_MSG(abs64(err) < MAX_ERROR_NS, "err=%lld ns", (long long) err);
+}
+
+int main(int argc, char **argv) {
+	test_drift(0.0);
+	test_drift(200.0);
+	test_drift(-1000.0);
+	test_reset();
+	test_unknown_frequency();
+	return TEST_RESULT();
+}
@@ -0,0 +1,116 @@
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+#include "uvc_test.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Converts random YUYV/UYVY frames with every color matrix and range through
+ * the SIMD kernels and through the scalar loops of frame.c, the results have
+ * to be the same byte for byte. The width is not a multiple of the kernel
+ * width so that the scalar loop also converts the end of the rows. */
+
+#define WIDTH 200
+#define HEIGHT 6
+
+typedef uvc_error_t (*convert_func_t)(uvc_frame_t *in, uvc_frame_t *out);
+
+typedef struct convert_case {
+	const char *name;
+	enum uvc_frame_format in_format;
+	convert_func_t func;
+} convert_case_t;
+
+static const convert_case_t cases[] = {
+	{ "yuyv2rgbx", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2rgbx },
+	{ "yuyv2rgb", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2rgb },
+	{ "yuyv2bgr", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2bgr },
+	{ "yuyv2rgb565", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2rgb565 },
+	{ "uyvy2rgbx", UVC_FRAME_FORMAT_UYVY, uvc_uyvy2rgbx },
+	{ "uyvy2rgb", UVC_FRAME_FORMAT_UYVY, uvc_uyvy2rgb },
+	{ "uyvy2bgr", UVC_FRAME_FORMAT_UYVY, uvc_uyvy2bgr },
+	{ "uyvy2rgb565", UVC_FRAME_FORMAT_UYVY, uvc_uyvy2rgb565 },
+	{ "yuyv2yuv420SP", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2yuv420SP },
+	{ "yuyv2iyuv420SP", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2iyuv420SP },
+};
+
+static uvc_frame_t *random_frame(enum uvc_frame_format format, uint32_t seed) {
+	uvc_frame_t *frame = uvc_allocate_frame(WIDTH * HEIGHT * 2);
+	uint8_t *p = (uint8_t *) frame->data;
+	size_t i;
+
+	frame->width = WIDTH;
+	frame->height = HEIGHT;
+	frame->frame_format = format;
+	frame->step = WIDTH * 2;
+	frame->actual_bytes = frame->data_bytes;
+	for (i = 0; i < frame->data_bytes; i++) {
+		seed = seed * 1103515245u + 12345u;
+		p[i] = seed >> 16;
+	}
+	// the values at both ends of the range saturate
+	for (i = 0; i < 64; i++)
+		p[i] = (i & 2) ? 0xff : 0x00;
+	return frame;
+}
+
+static uvc_frame_t *convert(const convert_case_t *c, uvc_frame_t *in) {
+	uvc_frame_t *out = uvc_allocate_frame(WIDTH * HEIGHT * 4);
+
+	EXPECT_MSG(c->func(in, out) == UVC_SUCCESS, "%s", c->name);
+	return out;
+}
+
+/** compare the kernels against the scalar loops, kernels points to the table frame.c uses */
+static void test_kernels(uvc_convert_kernels_t *kernels, const uvc_convert_kernels_t *simd) {
+	const uvc_convert_kernels_t scalar = { "scalar" };
+	size_t i;
+	int m, r;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		for (m = 0; m < UVC_COLOR_MATRIX_COUNT; m++) {
+			for (r = 0; r < UVC_COLOR_RANGE_COUNT; r++) {
+				uvc_frame_t *in = random_frame(cases[i].in_format, i * 16 + m * 2 + r + 1);
+				uvc_frame_t *expected, *actual;
+
+				in->color_matrix = (enum uvc_color_matrix) m;
+				in->color_range = (enum uvc_color_range) r;
+				*kernels = scalar;
+				expected = convert(&cases[i], in);
+				*kernels = *simd;
+				actual = convert(&cases[i], in);
+				EXPECT_MSG((expected->data_bytes == actual->data_bytes)
+					&& !memcmp(expected->data, actual->data, expected->data_bytes),
+					"%s %s matrix=%d range=%d", simd->name, cases[i].name, m, r);
+				uvc_free_frame(expected);
+				uvc_free_frame(actual);
+				uvc_free_frame(in);
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	// the kernels selected at runtime are kept in a static table, swap them for this test
+	uvc_convert_kernels_t *kernels = (uvc_convert_kernels_t *) uvc_get_convert_kernels();
+	const uvc_convert_kernels_t selected = *kernels;
+	uvc_convert_kernels_t simd;
+
+	printf("selected kernels: %s\n", selected.name);
+	test_kernels(kernels, &selected);
+#if defined(__SSE2__)
+	memset(&simd, 0, sizeof(simd));
+	uvc_init_convert_kernels_sse2(&simd, 0);
+	test_kernels(kernels, &simd);
+	if (__builtin_cpu_supports("avx2")) {
+		memset(&simd, 0, sizeof(simd));
+		uvc_init_convert_kernels_sse2(&simd, 1);
+		test_kernels(kernels, &simd);
+	}
+#elif defined(__aarch64__)
+	memset(&simd, 0, sizeof(simd));
+	uvc_init_convert_kernels_neon(&simd);
+	test_kernels(kernels, &simd);
+#endif
+	*kernels = selected;
+	return TEST_RESULT();
+}
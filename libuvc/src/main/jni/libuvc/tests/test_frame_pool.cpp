@@ -0,0 +1,105 @@
+#include "libuvc/libuvc.h"
+#include "FramePool.h"
+#include "uvc_test.h"
+#include <stdint.h>
+#include <string.h>
+
+/* Round-trips frames of the FramePool of UVCCamera through the converters of
+ * libuvc. The converters set data_bytes to the image size, which is smaller
+ * than the size class the frame was obtained from, and the frame still has to
+ * go back to that class, so after the first frame every request hits. */
+
+#define ROUNDS 8
+
+static void expect_pooled(uvc_frame_t *frame, size_t need_bytes) {
+	EXPECT(frame != NULL);
+	if (!frame)
+		return;
+	EXPECT_MSG(frame->data_bytes >= need_bytes, "data_bytes=%d, need=%d",
+		(int)frame->data_bytes, (int)need_bytes);
+	EXPECT(!((uintptr_t)frame->data & (FRAME_POOL_ALIGNMENT - 1)));
+}
+
+static void expect_stats(FramePool &pool, uint64_t hits, uint64_t misses, uint32_t cached) {
+	frame_pool_stats_t stats;
+	pool.getStats(&stats);
+	EXPECT_MSG(stats.hits == hits, "hits=%d, expected %d", (int)stats.hits, (int)hits);
+	EXPECT_MSG(stats.misses == misses, "misses=%d, expected %d", (int)stats.misses, (int)misses);
+	EXPECT_MSG(stats.releases == 0, "releases=%d", (int)stats.releases);
+	EXPECT_MSG(stats.cached_frames == cached, "cached_frames=%d, expected %d",
+		(int)stats.cached_frames, (int)cached);
+}
+
+/* 1080p YUYV needs 4147200 bytes from the 4194304 class,
+ * RGBX needs 8294400 bytes from the 8388608 class */
+static void test_yuyv2rgbx(void) {
+	FramePool pool;
+	const uint32_t width = 1920, height = 1080;
+
+	for (int i = 0; i < ROUNDS; i++) {
+		uvc_frame_t *yuyv = pool.obtainFrame(width * height * 2);
+		expect_pooled(yuyv, width * height * 2);
+		uvc_frame_t *rgbx = pool.obtainFrame(width * height * 4);
+		expect_pooled(rgbx, width * height * 4);
+		if (!yuyv || !rgbx)
+			return;
+		yuyv->width = width;
+		yuyv->height = height;
+		yuyv->frame_format = UVC_FRAME_FORMAT_YUYV;
+		yuyv->step = width * 2;
+		yuyv->actual_bytes = yuyv->data_bytes = width * height * 2;
+		memset(yuyv->data, 0x80, yuyv->data_bytes);
+		EXPECT(uvc_any2rgbx(yuyv, rgbx) == UVC_SUCCESS);
+		EXPECT(rgbx->data_bytes == width * height * 4);
+		// the buffer was not reallocated to the image size
+		EXPECT(!((uintptr_t)rgbx->data & (FRAME_POOL_ALIGNMENT - 1)));
+		pool.recycleFrame(yuyv);
+		pool.recycleFrame(rgbx);
+	}
+	expect_stats(pool, (ROUNDS - 1) * 2, 2, 2);
+}
+
+#ifdef LIBUVC_HAS_JPEG
+typedef struct decode_context {
+	FramePool *pool;
+	int frames;
+} decode_context_t;
+
+static void decode_cb(uvc_frame_t *frame, void *user_ptr) {
+	decode_context_t *ctx = (decode_context_t *) user_ptr;
+	// ask for a bit more as the previews do for the largest size,
+	// uvc_mjpeg2yuyv then shrinks data_bytes to the image size
+	uvc_frame_t *yuyv = ctx->pool->obtainFrame(frame->width * frame->height * 2 + 1024);
+	uvc_frame_t *rgbx = ctx->pool->obtainFrame(frame->width * frame->height * 4 + 1024);
+
+	ctx->frames++;
+	if (!yuyv || !rgbx)
+		return;
+	EXPECT(uvc_mjpeg2yuyv(frame, yuyv) == UVC_SUCCESS);
+	EXPECT(yuyv->data_bytes == frame->width * frame->height * 2);
+	EXPECT(uvc_any2rgbx(yuyv, rgbx) == UVC_SUCCESS);
+	EXPECT(rgbx->data_bytes == frame->width * frame->height * 4);
+	ctx->pool->recycleFrame(yuyv);
+	ctx->pool->recycleFrame(rgbx);
+}
+
+/* decodes the MJPEG frames of the sample trace */
+static void test_mjpeg2yuyv(const char *trace) {
+	FramePool pool;
+	decode_context_t ctx = { &pool, 0 };
+
+	EXPECT(uvc_replay_trace(trace, decode_cb, &ctx, 0, NULL) == UVC_SUCCESS);
+	EXPECT(ctx.frames > 1);
+	if (ctx.frames > 0)
+		expect_stats(pool, (ctx.frames - 1) * 2, 2, 2);
+}
+#endif
+
+int main(int argc, char **argv) {
+	test_yuyv2rgbx();
+#ifdef LIBUVC_HAS_JPEG
+	if (argc > 1)
+		test_mjpeg2yuyv(argv[1]);
+#endif
+	return TEST_RESULT();
+}
@@ -0,0 +1,165 @@
+#include "libuvc/libuvc.h"
+#include "FrameQueue.h"
+#include "FramePool.h"
+#include "uvc_test.h"
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Drop strategies, deadline and tickets of the FrameQueue of UVCCamera.
+ * The frames are numbered by their sequence to check which ones were dropped. */
+
+static int64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uvc_frame_t *new_frame(uint32_t sequence, int64_t captured_ns) {
+	uvc_frame_t *frame = FramePool::shared().obtainFrame(4096);
+	EXPECT(frame != NULL);
+	frame->sequence = sequence;
+	frame->capture_time.tv_sec = captured_ns / 1000000000LL;
+	frame->capture_time.tv_usec = (captured_ns % 1000000000LL) / 1000;
+	return frame;
+}
+
+/* takes a frame and checks its sequence, 0 expects no frame */
+static void expect_take(FrameQueue &queue, uint32_t sequence) {
+	uvc_frame_t *frame = queue.take();
+	if (!sequence) {
+		EXPECT_MSG(!frame, "sequence=%d", frame ? (int)frame->sequence : 0);
+	} else {
+		EXPECT(frame != NULL);
+		if (frame)
+			EXPECT_MSG(frame->sequence == sequence, "sequence=%d, expected %d",
+				(int)frame->sequence, (int)sequence);
+	}
+	FramePool::shared().recycleFrame(frame);
+}
+
+static void test_policy_params(void) {
+	FrameQueue queue(1, FRAME_DROP_OLDEST);
+
+	EXPECT(queue.setPolicy(0, FRAME_DROP_NEWEST, 0) != 0);
+	EXPECT(queue.setPolicy(FRAME_QUEUE_CAPACITY + 1, FRAME_DROP_NEWEST, 0) != 0);
+	EXPECT(queue.setPolicy(1, FRAME_DROP_NONE + 1, 0) != 0);
+	EXPECT(queue.setPolicy(1, FRAME_DROP_NEWEST, -1) != 0);
+	EXPECT(queue.setPolicy(FRAME_QUEUE_CAPACITY, FRAME_DROP_NONE, 100) == 0);
+}
+
+static void test_drop_newest(void) {
+	FrameQueue queue(2, FRAME_DROP_NEWEST);
+
+	EXPECT(queue.put(new_frame(1, 0)));
+	EXPECT(queue.put(new_frame(2, 0)));
+	EXPECT(!queue.put(new_frame(3, 0)));
+	EXPECT(queue.dropped() == 1);
+	expect_take(queue, 1);
+	expect_take(queue, 2);
+	expect_take(queue, 0);
+}
+
+static void test_drop_oldest(void) {
+	FrameQueue queue(2, FRAME_DROP_OLDEST);
+
+	EXPECT(queue.put(new_frame(1, 0)));
+	EXPECT(queue.put(new_frame(2, 0)));
+	EXPECT(queue.put(new_frame(3, 0)));
+	EXPECT(queue.dropped() == 1);
+	expect_take(queue, 2);
+	expect_take(queue, 3);
+	expect_take(queue, 0);
+}
+
+/* a smaller depth applies to the frames already queued */
+static void test_shrink_depth(void) {
+	FrameQueue queue(4, FRAME_DROP_OLDEST);
+
+	for (uint32_t i = 1; i <= 4; i++)
+		EXPECT(queue.put(new_frame(i, 0)));
+	EXPECT(queue.setPolicy(1, FRAME_DROP_OLDEST, 0) == 0);
+	EXPECT(queue.put(new_frame(5, 0)));
+	EXPECT(queue.dropped() == 4);
+	expect_take(queue, 5);
+	queue.clear();
+}
+
+static void *consume_later(void *vptr_args) {
+	FrameQueue *queue = reinterpret_cast<FrameQueue *>(vptr_args);
+	usleep(50000);
+	FramePool::shared().recycleFrame(queue->take());
+	return NULL;
+}
+
+static void test_drop_none(void) {
+	FrameQueue queue(1, FRAME_DROP_NONE);
+	pthread_t thread;
+
+	// the producer waits until the consumer takes a frame
+	EXPECT(queue.put(new_frame(1, 0)));
+	pthread_create(&thread, NULL, consume_later, &queue);
+	const int64_t start = now_ns();
+	EXPECT(queue.put(new_frame(2, 0)));
+	EXPECT(now_ns() - start >= 40000000LL);
+	pthread_join(thread, NULL);
+	EXPECT(queue.dropped() == 0);
+
+	// a closed queue drops instead of blocking
+	queue.close();
+	const int64_t closed = now_ns();
+	EXPECT(!queue.put(new_frame(3, 0)));
+	EXPECT(now_ns() - closed < 50000000LL);
+	EXPECT(queue.dropped() == 1);
+	expect_take(queue, 2);
+	queue.open();
+}
+
+static void test_deadline(void) {
+	FrameQueue queue(4, FRAME_DROP_NEWEST);
+	const int64_t now = now_ns();
+
+	EXPECT(queue.setPolicy(4, FRAME_DROP_NEWEST, 50) == 0);
+	EXPECT(queue.put(new_frame(1, now - 200000000LL)));	// 200ms old
+	EXPECT(queue.put(new_frame(2, now)));
+	EXPECT(queue.put(new_frame(3, 0)));					// no capture time, never stale
+	expect_take(queue, 2);
+	EXPECT(queue.dropped() == 1);
+	expect_take(queue, 3);
+	expect_take(queue, 0);
+}
+
+/* tickets count up in the order of put whichever consumer takes the frames */
+static void test_tickets(void) {
+	FrameQueue queue(4, FRAME_DROP_NEWEST);
+	const uint32_t first = queue.nextTicket();
+	uint32_t ticket = ~0u;
+
+	for (uint32_t i = 1; i <= 3; i++)
+		EXPECT(queue.put(new_frame(i, 0)));
+	for (uint32_t i = 1; i <= 3; i++) {
+		uvc_frame_t *frame = queue.wait(0, &ticket);
+		EXPECT(frame && (frame->sequence == i));
+		EXPECT_MSG(ticket == first + i - 1, "ticket=%u, first=%u", ticket, first);
+		FramePool::shared().recycleFrame(frame);
+	}
+	EXPECT(queue.nextTicket() == first + 3);
+
+	// a closed queue does not sleep in wait
+	queue.close();
+	const int64_t start = now_ns();
+	EXPECT(!queue.wait(1000));
+	EXPECT(now_ns() - start < 50000000LL);
+	queue.open();
+}
+
+int main(int argc, char **argv) {
+	test_policy_params();
+	test_drop_newest();
+	test_drop_oldest();
+	test_shrink_depth();
+	test_drop_none();
+	test_deadline();
+	test_tickets();
+	return TEST_RESULT();
+}
@@ -0,0 +1,137 @@
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+#include "uvc_test.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Replays a synthetic bulk trace through the frame ring.
+ * Without UVC_REPLAY_REALTIME every frame has to reach the callback in order,
+ * at the recorded timing a slow callback makes the ring drop the oldest frames. */
+
+#define NUM_FRAMES 64
+#define FRAME_WIDTH 32
+#define FRAME_HEIGHT 8
+#define FRAME_BYTES (FRAME_WIDTH * FRAME_HEIGHT * 2)
+#define HEADER_BYTES 12
+#define FRAME_INTERVAL_NS 5000000LL
+
+typedef struct ring_result {
+	useconds_t cb_delay_us;
+	uint32_t frames;
+	uint32_t bad_frames;
+	uint32_t out_of_order;
+	int32_t last_index;
+} ring_result_t;
+
+static void put_payload(struct libusb_transfer *transfer, uint8_t *buf,
+		int fid, int eof, uint32_t index, size_t bytes) {
+	buf[0] = HEADER_BYTES;
+	buf[1] = 0x80 | 0x08 | 0x04 | (eof ? 0x02 : 0) | fid;
+	memset(buf + 2, 0, HEADER_BYTES - 2);
+	memset(buf + HEADER_BYTES, index & 0xff, bytes);
+	transfer->buffer = buf;
+	transfer->actual_length = HEADER_BYTES + bytes;
+}
+
+static int write_trace(const char *path) {
+	uvc_trace_info_t info;
+	struct libusb_transfer transfer;
+	uint8_t buf[HEADER_BYTES + FRAME_BYTES];
+	uvc_trace_t *trace;
+	int64_t host_ns = 1000000000LL;
+	uint32_t i;
+	int r = 0;
+
+	memset(&info, 0, sizeof(info));
+	info.frame_format = UVC_FRAME_FORMAT_YUYV;
+	info.width = FRAME_WIDTH;
+	info.height = FRAME_HEIGHT;
+	info.max_frame_bytes = FRAME_BYTES;
+	info.max_payload_bytes = sizeof(buf);
+	info.clock_frequency = 48000000;
+	trace = uvc_trace_open_write(path, &info, sizeof(buf), 0);
+	if (!trace)
+		return -1;
+	memset(&transfer, 0, sizeof(transfer));
+	for (i = 0; i < NUM_FRAMES; i++, host_ns += FRAME_INTERVAL_NS) {
+		// each frame is sent as two payloads, the index of the frame is the pixel value
+		put_payload(&transfer, buf, i & 1, 0, i, FRAME_BYTES / 2);
+		r |= uvc_trace_write_transfer(trace, &transfer, host_ns);
+		put_payload(&transfer, buf, i & 1, 1, i, FRAME_BYTES / 2);
+		r |= uvc_trace_write_transfer(trace, &transfer, host_ns + 1000000);
+	}
+	uvc_trace_close(trace);
+	return r;
+}
+
+static void cb(uvc_frame_t *frame, void *ptr) {
+	ring_result_t *result = (ring_result_t *) ptr;
+	const uint8_t *data = (const uint8_t *) frame->data;
+	const int32_t index = data[0];
+	size_t i;
+
+	result->frames++;
+	if (frame->actual_bytes != FRAME_BYTES) {
+		result->bad_frames++;
+	} else {
+		for (i = 1; i < FRAME_BYTES; i++) {
+			if (data[i] != data[0]) {
+				result->bad_frames++;
+				break;
+			}
+		}
+	}
+	if (index <= result->last_index)
+		result->out_of_order++;
+	result->last_index = index;
+	if (result->cb_delay_us)
+		usleep(result->cb_delay_us);
+}
+
+static void replay(const char *path, int flags, useconds_t cb_delay_us,
+		ring_result_t *result, uvc_stream_stats_t *stats) {
+
+	memset(result, 0, sizeof(*result));
+	memset(stats, 0, sizeof(*stats));
+	result->cb_delay_us = cb_delay_us;
+	result->last_index = -1;
+	EXPECT(uvc_replay_trace(path, cb, result, flags, stats) == UVC_SUCCESS);
+}
+
+int main(int argc, char **argv) {
+	char path[] = "/tmp/uvc_frame_ring_XXXXXX";
+	ring_result_t result;
+	uvc_stream_stats_t stats;
+	const int fd = mkstemp(path);
+
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+	EXPECT(write_trace(path) == 0);
+
+	// lossless: the producer waits for the slow callback
+	replay(path, 0, 2000, &result, &stats);
+	EXPECT_MSG(result.frames == NUM_FRAMES, "frames=%u", result.frames);
+	EXPECT(result.bad_frames == 0);
+	EXPECT(result.out_of_order == 0);
+	EXPECT(result.last_index == NUM_FRAMES - 1);
+	EXPECT(stats.frames_eof == NUM_FRAMES);
+	EXPECT(stats.frames_overwritten == 0);
+
+	// realtime: the callback takes 4 frame intervals, so the oldest frames are dropped
+	replay(path, UVC_REPLAY_REALTIME, 4 * FRAME_INTERVAL_NS / 1000, &result, &stats);
+	EXPECT(stats.frames_eof == NUM_FRAMES);
+	EXPECT_MSG(stats.frames_overwritten > 0, "overwritten=%u", stats.frames_overwritten);
+	EXPECT_MSG(result.frames + stats.frames_overwritten == NUM_FRAMES,
+		"frames=%u overwritten=%u", result.frames, stats.frames_overwritten);
+	EXPECT(result.bad_frames == 0);
+	EXPECT(result.out_of_order == 0);
+	// the newest frame is never dropped
+	EXPECT(result.last_index == NUM_FRAMES - 1);
+
+	unlink(path);
+	return TEST_RESULT();
+}
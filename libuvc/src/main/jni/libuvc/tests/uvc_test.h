@@ -0,0 +1,27 @@
+#ifndef UVC_TEST_H_
+#define UVC_TEST_H_
+
+#include <stdio.h>
+
+/* minimal checks for the host tests, each test is a program and
+ * returns non-zero from main when any check failed */
+
+static int test_failures;
+
+#define EXPECT(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define EXPECT_MSG(cond, fmt, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s, " fmt "\n", __FILE__, __LINE__, #cond, __VA_ARGS__); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define TEST_RESULT() (test_failures ? (fprintf(stderr, "%d checks failed\n", test_failures), 1) : 0)
+
+#endif /* UVC_TEST_H_ */
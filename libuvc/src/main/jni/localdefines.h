@@ -25,13 +25,18 @@
 #ifndef LOCALDEFINES_H_
 #define LOCALDEFINES_H_
 
+#ifdef __ANDROID__
 #include <jni.h>
+#endif
 
 #ifndef LOG_TAG
 #define LOG_TAG "libUVCCamera"
 #endif
 
+#ifdef __ANDROID__
+// the host build of libuvc defines this only when it found libjpeg
 #define LIBUVC_HAS_JPEG
+#endif
 
 // write back array that got by getXXXArrayElements into original Java object and release its array
 #define	ARRAYELEMENTS_COPYBACK_AND_RELEASE 0
@@ -70,6 +75,8 @@
 #define		JTYPE_SYSTEM				"Ljava/lang/System;"
 #define		JTYPE_UVCCAMERA				"Lcom/serenegiant/usb/UVCCamera;"
 //
+#ifdef __ANDROID__
 typedef		jlong						ID_TYPE;
+#endif
 
 #endif /* LOCALDEFINES_H_ */
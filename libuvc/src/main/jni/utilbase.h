@@ -25,8 +25,9 @@
 #ifndef UTILBASE_H_
 #define UTILBASE_H_
 
-#include <jni.h>
+// jni.h only exists in the NDK, libusb/libuvc also include this file when they are built on the host
 #ifdef __ANDROID__
+#include <jni.h>
 #include <android/log.h>
 #endif
 #include <unistd.h>
@@ -223,8 +224,10 @@
 			__FILE__ ":" LITERAL_TO_STRING(__LINE__)            \
 			" Should not be here.");
 
+#ifdef __ANDROID__
 void setVM(JavaVM *);
 JavaVM *getVM();
 JNIEnv *getEnv();
+#endif
 
 #endif /* UTILBASE_H_ */